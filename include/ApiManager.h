@@ -2,7 +2,9 @@
 
 #include "LLMApi.h"
 #include "Config.h"
+#include "HttpClient.h"
 #include <memory>
+#include <functional>
 #include <map>
 #include <string>
 
@@ -35,10 +37,19 @@ public:
     // Set last used API and model
     void setLastUsedModel(const std::string& api, const std::string& model);
 
+    // Open a connection to the last used API on the main loop and park it
+    // in the pool, so the first message skips DNS, TCP and TLS. onReady runs
+    // once the connection is up. Does nothing if turned off in the config.
+    void prewarm(const std::function<void()>& onReady);
+
 private:
     // Map of API name to API instance
     std::map<std::string, std::shared_ptr<LLMApi>> apis;
 
+    // Client and request for the startup connection
+    HttpClient prewarmClient;
+    std::shared_ptr<AsyncRequest> prewarmRequest;
+
     // Initialize APIs
     void initApis();
 }; 
\ No newline at end of file
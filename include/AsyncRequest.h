@@ -0,0 +1,237 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <gtkmm.h>
+#include "ConnectionPool.h"
+#include "HttpResponseParser.h"
+#include "RequestTimeouts.h"
+#include "RequestWriter.h"
+#include "RetryPolicy.h"
+#include "CancellationToken.h"
+#include "RequestMetrics.h"
+#include "RateLimiter.h"
+
+class Http2Session;
+
+// A single HTTP request driven by GIO async operations on the GLib main loop.
+// Each step (connect, TLS handshake, write, read) is started from the
+// completion of the previous one, so no thread is blocked while it runs.
+// Requests must be started and cancelled on the main loop thread; other
+// threads cancel them through their token.
+class AsyncRequest : public std::enable_shared_from_this<AsyncRequest> {
+public:
+    // Outcome of a request
+    struct Result {
+        // HTTP status code, 0 if no response was received
+        int statusCode = 0;
+
+        // Response body (buffered requests, or the error body of a stream)
+        std::string body;
+
+        // Error message, empty on success
+        std::string error;
+
+        // Set when the request was cancelled or the data callback stopped it
+        bool cancelled = false;
+
+        // The time limit that ended the request, if any
+        TimeoutPhase timeout = TimeoutPhase::None;
+
+        // When each phase of the final attempt was reached
+        RequestTiming timing;
+
+        // Check if the request succeeded
+        bool ok() const { return error.empty() && !cancelled; }
+    };
+
+    // The request to send
+    struct Message {
+        std::string method;
+        std::string path;
+
+        // Headers other than Host and Connection
+        HttpResponseParser::HeaderList headers;
+
+        // The HTTP/1.1 request head
+        std::string head;
+
+        // Body shared with the caller, or null
+        RequestWriter::Body body;
+
+        // Producer of a body made while it is written, used instead of body
+        std::shared_ptr<BodyProducer> producer;
+    };
+
+    // Where the request queues in RateLimiter; no provider means it is sent right away
+    struct Admission {
+        std::string provider;
+        std::string model;
+        long tokens = 0;
+    };
+
+    // Receives streamed body bytes as they arrive, as a view of the read
+    // buffer that is only valid during the call; return false to stop
+    using DataCallback = std::function<bool(std::string_view data)>;
+
+    // Called once when the request has finished, failed or was cancelled
+    using CompletionCallback = std::function<void(const Result& result)>;
+
+    // Constructor. Without a data callback the body is collected in Result::body.
+    AsyncRequest(const Glib::RefPtr<Gio::SocketClient>& client,
+                 const std::string& scheme, const std::string& host, int port,
+                 const Message& message,
+                 const DataCallback& onData, const CompletionCallback& onComplete);
+
+    // Destructor
+    ~AsyncRequest();
+
+    // Set the time limits; call before start
+    void setTimeouts(const RequestTimeouts& timeouts);
+
+    // Retry rate limits, server errors and failed connections under the
+    // policy; call before start. Streams are only retried before any body
+    // bytes reached the data callback.
+    void setRetryPolicy(const std::shared_ptr<RetryPolicy>& policy);
+
+    // Only open a connection and park it in the pool (or start an HTTP/2
+    // session) without sending anything; call before start
+    void setConnectOnly(bool connectOnly);
+
+    // Offer HTTP/2 through ALPN on https connections; call before start
+    void setHttp2Enabled(bool enabled);
+
+    // Set the name the timing is recorded under in RequestMetrics; defaults
+    // to the host. Call before start.
+    void setMetricsLabel(const std::string& label);
+
+    // Wait for room under the client-side rate limits before each attempt,
+    // and report the limits in responses back; call before start. Time in
+    // the queue doesn't count against the time limits.
+    void setAdmission(const Admission& admission);
+
+    // Fail at once while CircuitBreaker has the endpoint's circuit open,
+    // and report each attempt to it (on by default); call before start
+    void setCircuitBreakerEnabled(bool enabled);
+
+    // Start the request
+    void start();
+
+    // Cancel the request; the completion callback runs with Result::cancelled set
+    void cancel();
+
+    // Check if the request has finished
+    bool isFinished() const { return finished; }
+
+    // Token that cancels the request from any thread; the request then
+    // finishes on the main loop as if cancel() had been called
+    const std::shared_ptr<CancellationToken>& getToken() const { return token; }
+
+private:
+    // Connection settings; for the "unix" scheme the host is the socket path
+    Glib::RefPtr<Gio::SocketClient> client;
+    std::string scheme;
+    std::string host;
+    int port;
+    std::string key;
+
+    // The request to send
+    Message message;
+
+    // Callbacks
+    DataCallback onData;
+    CompletionCallback onComplete;
+
+    // Cancellation for the pending GIO operation, also used for timeouts
+    Glib::RefPtr<Gio::Cancellable> cancellable;
+
+    // Cancellation requested by the owner, and the handler watching it
+    std::shared_ptr<CancellationToken> token;
+    gulong cancelHandler;
+
+    // Connection checked out of the pool
+    ConnectionPool::Connection connection;
+
+    // HTTP/2 session and stream carrying the request, if any
+    std::shared_ptr<Http2Session> http2Session;
+    int http2Stream;
+    bool http2Enabled;
+
+    // Warm up a connection instead of sending the request
+    bool connectOnly;
+
+    // Response parsing
+    HttpResponseParser parser;
+    size_t received;
+    bool trailingData;
+
+    // Rate limit queue, and the place held in it
+    Admission admission;
+    std::shared_ptr<RateLimiter::Ticket> admissionTicket;
+    bool waitingForAdmission;
+
+    // Phase timestamps of the current attempt, and where they are recorded
+    RequestTiming timing;
+    std::string metricsLabel;
+
+    // Time limits, enforced with a main loop timer
+    RequestTimeouts timeouts;
+    RequestDeadline deadline;
+    sigc::connection timer;
+    TimeoutPhase timedOut;
+
+    // Circuit breaker endpoint, and whether the current attempt was let
+    // through and still has to report its outcome
+    bool circuitBreakerEnabled;
+    std::string endpoint;
+    bool breakerAdmitted;
+
+    // Retries of the whole request, and the wait before the last one
+    std::shared_ptr<RetryPolicy> retryPolicy;
+    int retries;
+    std::chrono::milliseconds retryDelay;
+    sigc::connection retryTimer;
+
+    // Set once body bytes were passed to the data callback
+    bool delivered;
+
+    // Set when no connection could be opened
+    bool connectFailed;
+
+    // Request state
+    Result result;
+    int attempt;
+    bool finished;
+    bool waitingForSlot;
+
+    // Steps of the request
+    void startAttempt();
+    void acquireConnection();
+    void connectUnix();
+    void onConnected(const Glib::RefPtr<Gio::SocketConnection>& socket, const std::string& error);
+    void onConnectionReady();
+    void startHttp2();
+    void onWritten(const std::string& error);
+    void readMore();
+    void onRead(Glib::RefPtr<Gio::AsyncResult>& asyncResult);
+
+    // Schedule the timer for the next limit
+    void armTimer();
+
+    // Stop the pending operation once a limit is reached
+    void onTimeout(TimeoutPhase phase);
+
+    // Retry on a fresh connection if a reused one failed before answering,
+    // otherwise fail with the message
+    void retryOrFail(const std::string& error);
+
+    // Start the request over after a backoff if the policy allows.
+    // Returns false if the outcome is final.
+    bool retryLater(const std::string& error);
+
+    // Finish the request and run the completion callback
+    void complete(const std::string& error);
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "LLMApi.h"
+
+// Produces a request body piece by piece while it is being sent, so a
+// large body doesn't have to be built in full before the first byte goes
+// out. A body whose length is known up front is sent with Content-Length;
+// otherwise it is sent with chunked transfer encoding.
+class BodyProducer {
+public:
+    virtual ~BodyProducer() = default;
+
+    // Length of the whole body, or -1 if it is only known at the end
+    virtual long long length() const = 0;
+
+    // Start over from the first piece; called before every send, so a
+    // retried request sends the same body again
+    virtual void rewind() = 0;
+
+    // Append the next piece of the body to out. Returns false once the
+    // body is complete, after appending its last piece.
+    virtual bool produce(std::string& out) = 0;
+};
+
+// Serializes a JSON document while it is sent: the members of the top
+// object one at a time, and the items of an array member, such as the
+// messages of a chat, one at a time. Pieces are about pieceSize bytes.
+// The length is counted up front, so the body goes out with Content-Length.
+class JsonBodyProducer : public BodyProducer {
+public:
+    // Constructor
+    explicit JsonBodyProducer(SimpleJson document, size_t pieceSize = 16 * 1024);
+
+    long long length() const override;
+    void rewind() override;
+    bool produce(std::string& out) override;
+
+private:
+    SimpleJson document;
+    std::vector<std::string> keys;
+    size_t pieceSize;
+    long long totalLength;
+
+    // Position in the document: the brace has been written, the member
+    // being written, and the next item when that member is an array
+    bool opened;
+    size_t keyIndex;
+    bool inArray;
+    size_t itemIndex;
+    bool finished;
+
+    // Append the next part of the document; returns false after the last
+    bool step(std::string& out);
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <gtkmm.h>
+
+// Cancellation state for one request. cancel() may be called from any
+// thread: it sets an atomic flag and cancels a Gio::Cancellable, which
+// wakes a blocking read, write, connect or wait on the request's own
+// connection right away without touching any other connection.
+class CancellationToken {
+public:
+    // Create a token that is not cancelled
+    static std::shared_ptr<CancellationToken> create();
+
+    // Cancel the request; safe to call more than once and from any thread
+    void cancel();
+
+    // Check if the request was cancelled
+    bool isCancelled() const { return cancelled.load(std::memory_order_acquire); }
+
+    // Cancellable to pass to GIO calls made for the request
+    const Glib::RefPtr<Gio::Cancellable>& getCancellable() const { return cancellable; }
+
+private:
+    CancellationToken();
+
+    CancellationToken(const CancellationToken&) = delete;
+    CancellationToken& operator=(const CancellationToken&) = delete;
+
+    std::atomic<bool> cancelled;
+    Glib::RefPtr<Gio::Cancellable> cancellable;
+};
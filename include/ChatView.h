@@ -3,6 +3,7 @@
 #include <gtkmm.h>
 #include "LLMApi.h"
 #include <string>
+#include <string_view>
 #include <vector>
 #include <memory>
 
@@ -40,6 +41,12 @@ private:
     // Current API and model
     std::shared_ptr<LLMApi> currentApi;
     std::string currentModel;
+    
+    // Token of the request waiting for a reply
+    std::shared_ptr<CancellationToken> pendingRequest;
+
+    // Cleared when the view is destroyed, for replies still queued on the main loop
+    std::shared_ptr<bool> alive = std::make_shared<bool>(true);
 
     // Text buffers
     Glib::RefPtr<Gtk::TextBuffer> chatBuffer;
@@ -63,7 +70,7 @@ private:
     void appendUserMessage(const std::string& content);
     void appendAssistantMessage(const std::string& content);
     void appendSystemMessage(const std::string& content);
-    void handleApiResponse(const std::string& response, bool isComplete);
+    void handleApiResponse(std::string_view response, bool isComplete);
     void setInputSensitivity(bool sensitive);
     void updateProgressBar(bool visible, double progress = 0.0);
 }; 
\ No newline at end of file
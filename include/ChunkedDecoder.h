@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+// Incremental decoder for HTTP/1.1 chunked transfer coding.
+// Input can be split anywhere, including inside a chunk size line or the
+// CRLF after a chunk; payload bytes are passed to the sink as spans of the
+// input buffer without being copied.
+class ChunkedDecoder {
+public:
+    // Receives payload bytes; return false to stop decoding
+    using Sink = std::function<bool(const char* data, size_t length)>;
+
+    // Constructor
+    explicit ChunkedDecoder(const Sink& sink);
+
+    // Prepare for a new body
+    void reset();
+
+    // Decode the next piece of the body. Returns the number of bytes
+    // consumed, which is less than length once the last chunk has been
+    // read or the sink asked to stop. Throws on malformed input.
+    size_t decode(const char* data, size_t length);
+
+    // Check if the zero-size last chunk has been read. Trailer fields, if
+    // any, follow in the input after the consumed bytes.
+    bool isDone() const { return state == State::Done; }
+
+    // Check if the sink asked to stop
+    bool isStopped() const { return stopped; }
+
+    // Size of the chunk being read
+    unsigned long long getChunkSize() const { return chunkSize; }
+
+private:
+    enum class State {
+        Size,
+        Extension,
+        Data,
+        DataEnd,
+        Done
+    };
+
+    Sink sink;
+    State state;
+    bool stopped;
+
+    // Size of the current chunk and bytes of it still to come
+    unsigned long long chunkSize;
+    unsigned long long remaining;
+
+    // Hex digits read for the current size
+    int sizeDigits;
+
+    // Called when the size line is complete
+    void onSizeLine();
+};
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <chrono>
+#include "RequestMetrics.h"
+
+class HttpClient;
+
+// Tracks the health of each endpoint (scheme, host and port) from the
+// requests sent to it. When too many recent requests failed to connect,
+// timed out, got a server error or answered too slowly, the circuit opens
+// and requests to the endpoint fail at once instead of waiting for a
+// connection that won't come. While it is open the endpoint is probed in
+// the background with HEAD /, and any answer closes the circuit again.
+// Once the open time is over, one request is let through as a trial
+// (half-open): success closes the circuit, failure opens it for longer.
+// Thread-safe; probes run on the main loop.
+class CircuitBreaker {
+public:
+    enum class State {
+        Closed,
+        Open,
+        HalfOpen
+    };
+
+    struct Settings {
+        // Recent outcomes looked at, and how many are needed before their
+        // failure rate counts
+        size_t windowSize = 20;
+        size_t minimumRequests = 5;
+
+        // Share of failed or slow requests in the window that opens the circuit
+        double failureRate = 0.5;
+
+        // Failures in a row that open it regardless of the window
+        int consecutiveFailures = 3;
+
+        // Time to first byte after which an answer counts as slow
+        std::chrono::milliseconds slowCall{60000};
+
+        // How long the circuit stays open; doubled each time a trial fails
+        std::chrono::milliseconds openTime{5000};
+        std::chrono::milliseconds maxOpenTime{60000};
+
+        // Time between probes while the circuit is open
+        std::chrono::milliseconds probeInterval{5000};
+    };
+
+    // Get singleton instance
+    static CircuitBreaker& getInstance();
+
+    // Destructor
+    ~CircuitBreaker();
+
+    // Name of the endpoint of a request, which is also the URL it is probed at
+    static std::string endpointUrl(const std::string& scheme, const std::string& host, int port);
+
+    // Set the thresholds
+    void setSettings(const Settings& settings);
+
+    // Check if a request to the endpoint may be sent. Every request allowed
+    // must report its outcome with record.
+    bool allowRequest(const std::string& endpoint);
+
+    // Report how an allowed request went. statusCode is 0 if no response
+    // arrived; failed is set if it then ended with an error or timeout
+    // rather than being cancelled, which says nothing about the endpoint.
+    void record(const std::string& endpoint, int statusCode, bool failed, const RequestTiming& timing);
+
+    // Get the state of an endpoint
+    State getState(const std::string& endpoint) const;
+
+    // Error for requests turned away while the circuit is open
+    static std::string unavailableError(const std::string& endpoint);
+
+private:
+    // Private constructor for singleton
+    CircuitBreaker();
+
+    // Delete copy constructor and assignment operator
+    CircuitBreaker(const CircuitBreaker&) = delete;
+    CircuitBreaker& operator=(const CircuitBreaker&) = delete;
+
+    struct Endpoint {
+        State state = State::Closed;
+
+        // Recent outcomes, true for a failed or slow request
+        std::deque<bool> outcomes;
+        int failuresInRow = 0;
+
+        // Times the circuit opened since it was last closed, and until when
+        // it stays open
+        int trips = 0;
+        std::chrono::steady_clock::time_point openUntil;
+
+        // The half-open trial has been let through
+        bool trialSent = false;
+
+        // A probe is scheduled or running
+        bool probing = false;
+    };
+
+    mutable std::mutex mutex;
+    std::map<std::string, Endpoint> endpoints;
+    Settings settings;
+
+    // Client for probes, made on the main loop when first needed
+    std::unique_ptr<HttpClient> probeClient;
+
+    // Change the state of an endpoint; the lock must be held
+    void open(const std::string& name, Endpoint& endpoint);
+    void close(const std::string& name, Endpoint& endpoint);
+
+    // Probe an open endpoint after the probe interval
+    void scheduleProbe(const std::string& name);
+    void probe(const std::string& name);
+    void onProbeResult(const std::string& name, bool alive);
+};
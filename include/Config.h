@@ -6,6 +6,12 @@
 
 class Config {
 public:
+    // Client-side rate limit; zero means no limit
+    struct RateLimit {
+        double requestsPerMinute = 0;
+        double tokensPerMinute = 0;
+    };
+    
     // Get singleton instance
     static Config& getInstance();
 
@@ -32,6 +38,33 @@ public:
     
     // Set last used API and model
     void setLastUsedModel(const std::string& api, const std::string& model);
+    
+    // Check if a connection to the last used API is opened at startup
+    bool getPrewarm() const;
+    
+    // Set whether a connection to the last used API is opened at startup
+    void setPrewarm(bool prewarm);
+    
+    // Check if the model list is refreshed once that connection is ready
+    bool getPrewarmModels() const;
+    
+    // Set whether the model list is refreshed once that connection is ready
+    void setPrewarmModels(bool prewarmModels);
+    
+    // Get how many connections may be open to one host, which bounds how
+    // many requests to a provider run at once
+    int getMaxConnectionsPerHost() const;
+    
+    // Set how many connections may be open to one host
+    void setMaxConnectionsPerHost(int maxConnections);
+    
+    // Get the rate limit for a model of a service, falling back to the
+    // limit set for the whole service
+    RateLimit getRateLimit(const std::string& apiName, const std::string& model) const;
+    
+    // Set the rate limit for a model of a service, or for the whole service
+    // when the model is empty
+    void setRateLimit(const std::string& apiName, const std::string& model, const RateLimit& limit);
 
 private:
     // Private constructor for singleton
@@ -46,6 +79,12 @@ private:
     std::map<std::string, std::string> endpoints;
     std::string lastUsedApi;
     std::string lastUsedModel;
+    bool prewarm;
+    bool prewarmModels;
+    int maxConnectionsPerHost;
+    
+    // Rate limits keyed by "api" or "api/model"
+    std::map<std::string, RateLimit> rateLimits;
     
     // Configuration file path
     std::string getConfigPath() const;
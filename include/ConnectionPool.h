@@ -0,0 +1,139 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include <condition_variable>
+#include <gtkmm.h>
+#include "ReadBuffer.h"
+
+// Pool of keep-alive HTTP/1.1 connections shared by all HttpClient instances
+class ConnectionPool {
+public:
+    // A connection checked out of the pool
+    struct Connection {
+        // Pool key ("scheme://host:port")
+        std::string key;
+
+        // Underlying socket connection
+        Glib::RefPtr<Gio::SocketConnection> socket;
+
+        // Stream requests are sent over: the socket itself, or TLS on top of it
+        Glib::RefPtr<Gio::IOStream> stream;
+
+        // Time the connection was parked in the pool
+        std::chrono::steady_clock::time_point idleSince;
+
+        // Number of requests already sent over this connection
+        unsigned int useCount = 0;
+
+        // Response bytes are read into this; kept while the connection lives
+        std::shared_ptr<ReadBuffer> buffer;
+
+        // Get the read buffer, taking one from the free list on first use
+        ReadBuffer& readBuffer() {
+            if (!buffer) {
+                buffer = ReadBuffer::acquire();
+            }
+            return *buffer;
+        }
+
+        // Check if a connection is held
+        explicit operator bool() const { return static_cast<bool>(socket); }
+
+        // Check if the connection was taken from the idle list
+        bool isReused() const { return useCount > 0; }
+    };
+
+    // Function used to open a new connection when no idle one is available
+    using Connector = std::function<Connection()>;
+
+    // Outcome of tryAcquire
+    enum class Lease {
+        // An idle connection was handed out
+        Idle,
+        // A slot was reserved; the caller opens the connection itself
+        Reserved,
+        // The host is at its connection cap
+        Full
+    };
+
+    // Get singleton instance
+    static ConnectionPool& getInstance();
+
+    // Build the pool key for a scheme, host and port
+    static std::string makeKey(const std::string& scheme, const std::string& host, int port);
+
+    // Take an idle connection for the key, or open one with the connector.
+    // Blocks while the per-host connection cap is reached.
+    Connection acquire(const std::string& key, const Connector& connect);
+
+    // Non-blocking variant of acquire for callers on the main loop. On
+    // Reserved the caller must either release() the connection it opens
+    // (with the key set) or give the slot back with cancelReservation().
+    Lease tryAcquire(const std::string& key, Connection& connection);
+
+    // Give back a slot reserved by tryAcquire when the connect failed
+    void cancelReservation(const std::string& key);
+
+    // Call back once when a connection or slot for the key may have become
+    // free. The callback runs on the thread that released it.
+    void notifyWhenAvailable(const std::string& key, const std::function<void()>& callback);
+
+    // Return a connection to the pool, or close it if it can't be reused
+    void release(Connection& connection, bool reusable);
+
+    // Close all idle connections
+    void clear();
+
+    // Set how long an idle connection is kept before it is closed
+    void setIdleTimeout(std::chrono::seconds timeout);
+
+    // Get how long an idle connection is kept
+    std::chrono::seconds getIdleTimeout() const;
+
+    // Set the maximum number of open connections per host (idle and in use)
+    void setMaxConnectionsPerHost(size_t maxConnections);
+
+    // Get the maximum number of open connections per host
+    size_t getMaxConnectionsPerHost() const;
+
+    // Get the number of idle connections for a key
+    size_t idleCount(const std::string& key) const;
+
+private:
+    // Private constructor for singleton
+    ConnectionPool();
+
+    // Delete copy constructor and assignment operator
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+    // Per-host state
+    struct Host {
+        std::deque<Connection> idle;
+        size_t open = 0;
+        std::vector<std::function<void()>> waiters;
+    };
+
+    std::map<std::string, Host> hosts;
+    mutable std::mutex mutex;
+    std::condition_variable slotAvailable;
+
+    // Settings
+    std::chrono::seconds idleTimeout;
+    size_t maxConnectionsPerHost;
+
+    // Check if an idle connection can still be used
+    bool isUsable(const Connection& connection, std::chrono::steady_clock::time_point now) const;
+
+    // Close a connection, ignoring errors
+    static void closeQuietly(Connection& connection);
+
+    // Wake blocked and asynchronous waiters for a host
+    void wakeWaiters(const std::string& key);
+};
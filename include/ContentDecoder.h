@@ -0,0 +1,93 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+
+// Incremental decoder for HTTP content codings (gzip, deflate and, when
+// built with libzstd, zstd). Compressed bytes are decoded as they arrive
+// into a small fixed buffer that is handed to the sink, so the body is
+// never held in memory as a whole.
+class ContentDecoder {
+public:
+    // Receives decoded bytes; return false to stop decoding
+    using Sink = std::function<bool(const char* data, size_t length)>;
+
+    // Byte counters over all decoded responses
+    struct Totals {
+        // Responses that had a supported content coding
+        unsigned long long responses = 0;
+
+        // Compressed bytes received
+        unsigned long long bytesIn = 0;
+
+        // Decoded bytes produced
+        unsigned long long bytesOut = 0;
+    };
+
+    // Constructor
+    explicit ContentDecoder(const Sink& sink);
+
+    // Destructor
+    ~ContentDecoder();
+
+    // The decoder state can't be shared
+    ContentDecoder(const ContentDecoder&) = delete;
+    ContentDecoder& operator=(const ContentDecoder&) = delete;
+
+    // Value for the Accept-Encoding request header
+    static const char* acceptEncoding();
+
+    // Prepare for a body with the given Content-Encoding header. Returns
+    // false if the coding isn't supported; the decoder then stays inactive.
+    bool start(const std::string& contentEncoding);
+
+    // Drop any decoding state
+    void reset();
+
+    // Check if a body is being decoded
+    bool isActive() const { return coding != Coding::Identity; }
+
+    // Decode the next piece of the body. Returns false if the sink asked
+    // to stop. Throws on corrupt input.
+    bool decode(const char* data, size_t length);
+
+    // The body is complete; throws if the compressed stream was cut short
+    void finish();
+
+    // Bytes received and produced for the current body
+    unsigned long long getBytesIn() const { return bytesIn; }
+    unsigned long long getBytesOut() const { return bytesOut; }
+
+    // Get the counters over all responses
+    static Totals getTotals();
+
+private:
+    enum class Coding {
+        Identity,
+        Gzip,
+        Deflate,
+        Zstd
+    };
+
+    // Library state, kept out of this header
+    struct Stream;
+
+    Sink sink;
+    Coding coding;
+    std::unique_ptr<Stream> stream;
+    std::vector<char> output;
+
+    // Set once the compressed stream has ended
+    bool ended;
+
+    unsigned long long bytesIn;
+    unsigned long long bytesOut;
+
+    bool decodeZlib(const char* data, size_t length);
+    bool decodeZstd(const char* data, size_t length);
+
+    // Pass decoded bytes on and count them
+    bool emit(size_t length);
+};
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include <gtkmm.h>
+
+// Host name resolution cache shared by all HttpClient instances, with
+// lookup and per-address connect metrics
+class DnsCache {
+public:
+    // Resolved addresses, ordered for connection attempts
+    using AddressList = std::vector<Glib::RefPtr<Gio::InetAddress>>;
+
+    // Completion of an asynchronous lookup; addresses is empty on failure
+    using ResolveCallback = std::function<void(const AddressList& addresses, const std::string& error)>;
+
+    // Lookup counters
+    struct Stats {
+        // Lookups answered from the cache
+        unsigned long hits = 0;
+
+        // Lookups that went to the system resolver
+        unsigned long misses = 0;
+
+        // Lookups the system resolver failed
+        unsigned long failures = 0;
+    };
+
+    // Connect counters for one address
+    struct AddressStats {
+        unsigned long attempts = 0;
+        unsigned long successes = 0;
+        unsigned long failures = 0;
+
+        // Time to establish the TCP connection, for successful attempts
+        std::chrono::microseconds totalConnectTime{0};
+        std::chrono::microseconds lastConnectTime{0};
+
+        // Average time to connect
+        std::chrono::microseconds averageConnectTime() const;
+    };
+
+    // Get singleton instance
+    static DnsCache& getInstance();
+
+    // Resolve a host name, using the cache when the entry is still fresh.
+    // Throws if the name can't be resolved, and Gio::Error CANCELLED as
+    // soon as the cancellable is cancelled.
+    AddressList resolve(const std::string& host,
+                        const Glib::RefPtr<Gio::Cancellable>& cancellable = Glib::RefPtr<Gio::Cancellable>());
+
+    // Same as resolve, but asks the system resolver without blocking the main loop.
+    // Cache hits call back before returning.
+    void resolveAsync(const std::string& host,
+                      const Glib::RefPtr<Gio::Cancellable>& cancellable,
+                      const ResolveCallback& callback);
+
+    // Record the outcome of a connection attempt to an address
+    void recordConnect(const Glib::RefPtr<Gio::InetAddress>& address,
+                       std::chrono::microseconds elapsed, bool success);
+
+    // Set how long resolved addresses are reused
+    void setTtl(std::chrono::seconds ttl);
+
+    // Forget all cached entries
+    void clear();
+
+    // Get a snapshot of the lookup metrics
+    Stats getStats() const;
+
+    // Get a snapshot of the connect metrics, keyed by address
+    std::map<std::string, AddressStats> getAddressStats() const;
+
+private:
+    // Private constructor for singleton
+    DnsCache();
+
+    // Delete copy constructor and assignment operator
+    DnsCache(const DnsCache&) = delete;
+    DnsCache& operator=(const DnsCache&) = delete;
+
+    struct Entry {
+        AddressList addresses;
+        std::chrono::steady_clock::time_point expires;
+    };
+
+    std::map<std::string, Entry> entries;
+    std::chrono::seconds ttl;
+
+    Stats stats;
+    std::map<std::string, AddressStats> addressStats;
+    mutable std::mutex mutex;
+
+    // Look the host up in the cache; counts a hit or a miss
+    bool lookupCached(const std::string& host, AddressList& addresses);
+
+    // Store resolver results and return them in connection order
+    AddressList store(const std::string& host, const std::vector<Glib::RefPtr<Gio::InetAddress>>& resolved);
+
+    // Count a failed lookup
+    void recordFailure();
+
+    // Alternate address families, starting with the one the resolver put first (RFC 8305)
+    static AddressList interleave(const std::vector<Glib::RefPtr<Gio::InetAddress>>& resolved);
+};
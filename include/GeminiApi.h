@@ -2,12 +2,12 @@
 
 #include "LLMApi.h"
 #include "HttpClient.h"
+#include "RequestSet.h"
 #include <string>
+#include <string_view>
 #include <vector>
 #include <functional>
-#include <mutex>
-#include <thread>
-#include <atomic>
+#include <memory>
 
 class GeminiApi : public LLMApi {
 public:
@@ -20,13 +20,15 @@ public:
     // Set API endpoint
     void setEndpoint(const std::string& endpoint) override;
     
-    // Get available models
-    std::vector<std::string> getAvailableModels() override;
+    // Describe how to list the models
+    std::string getModelsUrl() const override;
+    std::vector<std::string> parseModelsResponse(const std::string& response) override;
+    std::vector<std::string> getDefaultModels() const override;
     
     // Send a chat completion request
-    void sendChatRequest(const std::vector<Message>& messages, 
+    std::shared_ptr<CancellationToken> sendChatRequest(const std::vector<Message>& messages, 
                         const std::string& model,
-                        const std::function<void(const std::string&, bool)>& callback) override;
+                        const ResponseCallback& callback) override;
     
     // Check if API is properly configured
     bool isConfigured() const override;
@@ -37,8 +39,8 @@ public:
     }
 
     // Override base class methods
-    virtual void sendMessage(const std::string& message, const std::string& model, 
-                            const std::function<void(const std::string&, bool)>& callback) override;
+    virtual std::shared_ptr<CancellationToken> sendMessage(const std::string& message, const std::string& model, 
+                            const ResponseCallback& callback) override;
 
     // Cancel ongoing requests
     void cancelRequest() override;
@@ -47,19 +49,16 @@ private:
     // HTTP client
     HttpClient httpClient;
     
-    // Available models
-    std::vector<std::string> availableModels;
-    
     // Helper methods
     SimpleJson createRequestPayload(const std::vector<Message>& messages, const std::string& model);
     std::string performHttpRequest(const std::string& url, const std::string& jsonPayload);
-    std::vector<std::string> parseModelsResponse(const std::string& response);
-    std::string parseCompletionResponse(const std::string& response);
-
-    // Thread management
-    std::mutex threadMutex;
-    std::atomic<bool> cancelRequestFlag;
-    std::thread requestThread;
     
-    void cleanupThread();
+    // Pass the text of one event of a streamGenerateContent reply
+    // ({"candidates":[{"content":{"parts":[{"text":"..."}]}}]}) on to
+    // callback, using scratch for unescaping. Returns false if the event
+    // was an error, which has then been reported as the end of the reply.
+    static bool handleStreamEvent(std::string_view data, std::string& scratch, const ResponseCallback& callback);
+
+    // Chat requests running on the main loop
+    RequestSet requests;
 }; 
\ No newline at end of file
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <gtkmm.h>
+
+// Opens TCP connections to a host by racing its addresses (RFC 8305):
+// attempts start one after another, a short delay apart, across
+// alternating address families, and the first one to connect wins.
+// A slow or broken address family then only costs the attempt delay.
+class HappyEyeballs {
+public:
+    // Completion of an asynchronous connect; connection is empty on failure
+    using ConnectCallback = std::function<void(const Glib::RefPtr<Gio::SocketConnection>& connection,
+                                               const std::string& error)>;
+
+    // Called once the host name is resolved, before the first attempt starts
+    using ResolvedCallback = std::function<void()>;
+
+    // Get singleton instance
+    static HappyEyeballs& getInstance();
+
+    // Connect to a host, blocking until an attempt wins or all have failed.
+    // A zero timeout uses the configured connect timeout. Throws on failure,
+    // TimeoutError when the timeout is reached, and Gio::Error CANCELLED
+    // as soon as the cancellable is cancelled.
+    Glib::RefPtr<Gio::SocketConnection> connect(const std::string& host, int port,
+                                                std::chrono::milliseconds timeout,
+                                                const Glib::RefPtr<Gio::Cancellable>& cancellable = Glib::RefPtr<Gio::Cancellable>(),
+                                                const ResolvedCallback& onResolved = ResolvedCallback());
+
+    // Same as connect, but runs on the GLib main loop
+    void connectAsync(const Glib::RefPtr<Gio::SocketClient>& client,
+                      const std::string& host, int port,
+                      const Glib::RefPtr<Gio::Cancellable>& cancellable,
+                      const ConnectCallback& callback,
+                      const ResolvedCallback& onResolved = ResolvedCallback());
+
+    // Set the delay before the next address is tried while earlier attempts are pending
+    void setAttemptDelay(std::chrono::milliseconds delay);
+
+    // Set how long connect waits for any attempt to succeed
+    void setConnectTimeout(std::chrono::milliseconds timeout);
+
+private:
+    // Private constructor for singleton
+    HappyEyeballs();
+
+    // Delete copy constructor and assignment operator
+    HappyEyeballs(const HappyEyeballs&) = delete;
+    HappyEyeballs& operator=(const HappyEyeballs&) = delete;
+
+    std::chrono::milliseconds attemptDelay;
+    std::chrono::milliseconds connectTimeout;
+    mutable std::mutex mutex;
+
+    // State of one connectAsync call
+    struct Race;
+};
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <gtkmm.h>
+#include "HttpResponseParser.h"
+#include "RequestWriter.h"
+
+struct nghttp2_session;
+
+// An HTTP/2 connection to one host, carrying any number of concurrent
+// requests as separate streams. Driven by GIO async operations on the GLib
+// main loop; all methods must be called on the main loop thread.
+// Sessions can only be created when built with nghttp2 (HAVE_NGHTTP2).
+class Http2Session : public std::enable_shared_from_this<Http2Session> {
+public:
+    // Callbacks for one stream
+    struct StreamHandler {
+        // Response status and headers
+        std::function<void(int status, const HttpResponseParser::HeaderList& headers)> onHeaders;
+
+        // Body bytes; return false to reset the stream
+        std::function<bool(const char* data, size_t length)> onData;
+
+        // The stream ended; error is empty if the response is complete
+        std::function<void(const std::string& error)> onClose;
+    };
+
+    // Flow control windows, sized so token streams never wait for WINDOW_UPDATE
+    static const int streamWindowSize = 1 << 20;
+    static const int connectionWindowSize = 16 << 20;
+
+    // Check if HTTP/2 support was built in
+    static bool isSupported();
+
+    // Start a session on a TLS connection that negotiated "h2" and make it
+    // available to later requests for the same key
+    static std::shared_ptr<Http2Session> create(const std::string& key,
+                                                const Glib::RefPtr<Gio::SocketConnection>& socket,
+                                                const Glib::RefPtr<Gio::IOStream>& stream);
+
+    // Find a session for the key that can take another stream
+    static std::shared_ptr<Http2Session> find(const std::string& key);
+
+    // Destructor
+    ~Http2Session();
+
+    // Open a stream for a request with a shared or a produced body, either
+    // of which may be null. Returns the stream id; throws on failure.
+    int submit(const std::string& method, const std::string& authority, const std::string& path,
+               const HttpResponseParser::HeaderList& headers, const RequestWriter::Body& body,
+               const std::shared_ptr<BodyProducer>& producer, const StreamHandler& handler);
+
+    // Reset a stream; its close callback is not called
+    void cancel(int streamId);
+
+    // Check if the session can take another stream
+    bool isUsable() const;
+
+    // Number of open streams
+    size_t getStreamCount() const { return streams.size(); }
+
+private:
+    // Use create()
+    Http2Session(const std::string& key,
+                 const Glib::RefPtr<Gio::SocketConnection>& socket,
+                 const Glib::RefPtr<Gio::IOStream>& stream);
+
+    Http2Session(const Http2Session&) = delete;
+    Http2Session& operator=(const Http2Session&) = delete;
+
+    struct Stream {
+        StreamHandler handler;
+        int status = 0;
+        HttpResponseParser::HeaderList headers;
+
+        // Request body, shared with the caller, and how much of it nghttp2 has taken
+        RequestWriter::Body body;
+        size_t bodyOffset = 0;
+
+        // Producer of the body instead, its current piece, which bodyOffset
+        // then points into, and whether that piece is the last
+        std::shared_ptr<BodyProducer> producer;
+        std::string piece;
+        bool produced = false;
+
+        // Reset by us; no more callbacks are made
+        bool cancelled = false;
+    };
+
+    std::string key;
+    Glib::RefPtr<Gio::SocketConnection> socket;
+    Glib::RefPtr<Gio::IOStream> stream;
+    nghttp2_session* session;
+
+    std::map<int, Stream> streams;
+
+    // Frames being written and the read buffer
+    std::string output;
+    size_t written;
+    std::vector<char> input;
+    bool writing;
+
+    // Set while nghttp2 is processing input; output is sent afterwards
+    bool receiving;
+
+    // Closes the connection once it has been idle for the pool's idle timeout
+    sigc::connection idleTimer;
+
+    // Set once the server sent GOAWAY or the connection failed
+    bool goingAway;
+    bool closed;
+
+    // Sessions that accept new streams, by pool key
+    static std::map<std::string, std::weak_ptr<Http2Session>> sessions;
+
+    // Start the connection preface and the read loop
+    void start();
+
+    // Write whatever nghttp2 has queued
+    void flush();
+    void onWritten(Glib::RefPtr<Gio::AsyncResult>& result);
+    void readMore();
+    void onRead(Glib::RefPtr<Gio::AsyncResult>& result);
+
+    // Start or stop the idle timer as streams come and go
+    void updateIdleTimer();
+
+    // Fail every open stream and close the connection
+    void fail(const std::string& error);
+
+    // Stop offering this session to new requests
+    void retire();
+
+    // nghttp2 callbacks
+    struct Callbacks;
+};
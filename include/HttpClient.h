@@ -1,8 +1,22 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
 #include <gtkmm.h>
+#include "ConnectionPool.h"
+#include "HttpResponseParser.h"
+#include "AsyncRequest.h"
+#include "RequestTimeouts.h"
+#include "RequestWriter.h"
+#include "RetryPolicy.h"
+#include "CancellationToken.h"
+#include "RequestMetrics.h"
+#include "SseParser.h"
+#include "UringTransport.h"
 
 // Simple HTTP client using standard C++ and GTK
 class HttpClient {
@@ -19,20 +33,173 @@ public:
     // Clear all headers
     void clearHeaders();
     
+    // Set the time limits for requests made after this call
+    void setTimeouts(const RequestTimeouts& timeouts);
+    
+    // Get the time limits
+    const RequestTimeouts& getTimeouts() const { return timeouts; }
+    
+    // Set how failed requests are retried (rate limits, 5xx, failed connections)
+    void setRetryPolicy(const RetryPolicy::Settings& settings);
+    
+    // Fail requests on the first error
+    void disableRetries();
+    
+    // Offer HTTP/2 to https servers on async requests (on by default when
+    // built with nghttp2); blocking requests always use HTTP/1.1
+    void setHttp2Enabled(bool enabled);
+    
+    // Fail requests at once while CircuitBreaker has the endpoint's
+    // circuit open (on by default)
+    void setCircuitBreakerEnabled(bool enabled);
+    
+    // Set the name request timings are recorded under in RequestMetrics;
+    // defaults to the host of each request
+    void setMetricsLabel(const std::string& label);
+    
+    // Queue async requests started after this call behind the RateLimiter
+    // buckets of a provider and model, charging the estimated tokens. An
+    // empty provider sends them right away.
+    void setAdmission(const std::string& provider, const std::string& model, long estimatedTokens);
+    
     // Perform a GET request
     std::string get(const std::string& url);
     
     // Perform a POST request
     std::string post(const std::string& url, const std::string& data);
     
-    // Perform a POST request with streaming response
+    // Perform a POST request whose body is produced while it is sent
+    std::string post(const std::string& url, const std::shared_ptr<BodyProducer>& body);
+    
+    // Receives streamed body bytes as they arrive, as a view of the read
+    // buffer that is only valid during the call; return false to stop
+    using StreamCallback = std::function<bool(std::string_view data)>;
+    
+    // Perform a POST request with streaming response, passing the decoded
+    // body on as views of the read buffer without copying
     void postStreaming(
         const std::string& url, 
         const std::string& data,
-        const std::function<bool(const std::string&)>& dataCallback
+        const StreamCallback& dataCallback
+    );
+    
+    // Perform a POST request whose response is a Server-Sent Events stream,
+    // passing each event on as it completes. Events after "[DONE]" are ignored.
+    void postEventStream(
+        const std::string& url,
+        const std::string& data,
+        const SseParser::EventCallback& eventCallback
+    );
+    
+    // Start a request on the GLib main loop without blocking. Without a data
+    // callback the body is collected in the result. Must be called on the main loop thread.
+    std::shared_ptr<AsyncRequest> sendAsync(
+        const std::string& method,
+        const std::string& url,
+        const std::string& data,
+        const AsyncRequest::DataCallback& onData,
+        const AsyncRequest::CompletionCallback& onComplete
+    );
+    
+    // Same as above with a body shared with the caller instead of copied
+    std::shared_ptr<AsyncRequest> sendAsync(
+        const std::string& method,
+        const std::string& url,
+        const RequestWriter::Body& body,
+        const AsyncRequest::DataCallback& onData,
+        const AsyncRequest::CompletionCallback& onComplete
+    );
+    
+    // Same as above with a body produced while it is written, so making
+    // the body overlaps with sending it
+    std::shared_ptr<AsyncRequest> sendAsync(
+        const std::string& method,
+        const std::string& url,
+        const std::shared_ptr<BodyProducer>& body,
+        const AsyncRequest::DataCallback& onData,
+        const AsyncRequest::CompletionCallback& onComplete
+    );
+    
+    // Perform a GET request asynchronously
+    std::shared_ptr<AsyncRequest> getAsync(const std::string& url, const AsyncRequest::CompletionCallback& onComplete);
+    
+    // Perform a POST request asynchronously
+    std::shared_ptr<AsyncRequest> postAsync(const std::string& url, const std::string& data,
+                                            const AsyncRequest::CompletionCallback& onComplete);
+    
+    // Perform a POST request asynchronously with a shared body
+    std::shared_ptr<AsyncRequest> postAsync(const std::string& url, const RequestWriter::Body& body,
+                                            const AsyncRequest::CompletionCallback& onComplete);
+    
+    // Perform a POST request asynchronously with a produced body
+    std::shared_ptr<AsyncRequest> postAsync(const std::string& url, const std::shared_ptr<BodyProducer>& body,
+                                            const AsyncRequest::CompletionCallback& onComplete);
+    
+    // Perform a POST request asynchronously with streaming response
+    std::shared_ptr<AsyncRequest> postStreamingAsync(
+        const std::string& url,
+        const std::string& data,
+        const AsyncRequest::DataCallback& onData,
+        const AsyncRequest::CompletionCallback& onComplete
+    );
+    
+    // Same as above with a body shared with the caller instead of copied
+    std::shared_ptr<AsyncRequest> postStreamingAsync(
+        const std::string& url,
+        const RequestWriter::Body& body,
+        const AsyncRequest::DataCallback& onData,
+        const AsyncRequest::CompletionCallback& onComplete
     );
     
-    // Cancel ongoing requests
+    // Same as above with a produced body
+    std::shared_ptr<AsyncRequest> postStreamingAsync(
+        const std::string& url,
+        const std::shared_ptr<BodyProducer>& body,
+        const AsyncRequest::DataCallback& onData,
+        const AsyncRequest::CompletionCallback& onComplete
+    );
+    
+    // Perform a POST request with a Server-Sent Events response on the
+    // main loop, passing each event on as it completes. The request
+    // completes when the response ends, including after "[DONE]".
+    std::shared_ptr<AsyncRequest> postEventStreamAsync(
+        const std::string& url,
+        const std::shared_ptr<BodyProducer>& body,
+        const SseParser::EventCallback& onEvent,
+        const AsyncRequest::CompletionCallback& onComplete
+    );
+    
+    // One request of a batch
+    struct BatchRequest {
+        std::string method;
+        std::string url;
+        std::string data;
+        
+        // Streamed body; without it the body is collected in the result
+        StreamCallback onData;
+    };
+    
+    // Run a batch of requests at once and wait for all of them, for
+    // headless use: it runs the main loop itself. Results are in the same
+    // order. When built with io_uring, batches of http:// and unix://
+    // requests go through UringTransport; others use the async GIO path.
+    // At most maxConnectionsPerHost requests run at once either way.
+    std::vector<AsyncRequest::Result> runBatch(const std::vector<BatchRequest>& requests);
+    
+    // Send batches through io_uring when it is built in (on by default)
+    void setUringEnabled(bool enabled);
+    
+    // Get the io_uring counts of the last batch; all zero if it ran on GIO
+    const UringTransport::Stats& getBatchStats() const { return batchStats; }
+    
+    // Open a connection to the URL's host, including the TLS handshake, and
+    // park it in the pool for the next request without sending anything
+    std::shared_ptr<AsyncRequest> preconnectAsync(const std::string& url,
+                                                  const AsyncRequest::CompletionCallback& onComplete);
+    
+    // Cancel ongoing requests started by this client. Safe to call from any
+    // thread; blocking calls return within milliseconds, and connections
+    // other requests are using are left alone.
     void cancelRequest();
 
 private:
@@ -42,16 +209,42 @@ private:
     // Connection object
     Glib::RefPtr<Gio::SocketClient> client;
     
-    // Current connection
-    Glib::RefPtr<Gio::SocketConnection> connection;
+    // Current connection, checked out of the shared pool
+    ConnectionPool::Connection connection;
+    
+    // Tokens of the requests in flight, cancelled by cancelRequest()
+    std::mutex tokenMutex;
+    std::vector<std::weak_ptr<CancellationToken>> tokens;
+    
+    // Time limits for each request
+    RequestTimeouts timeouts;
+    
+    // Offer HTTP/2 through ALPN
+    bool http2Enabled;
+    
+    // Check CircuitBreaker before sending
+    bool circuitBreakerEnabled;
+    
+    // Run batches on io_uring
+    bool uringEnabled;
+    UringTransport::Stats batchStats;
     
-    // Cancel flag
-    bool cancelled;
+    // Retry policy, shared with the async requests so they draw on one budget
+    std::shared_ptr<RetryPolicy> retryPolicy;
+    
+    // Name for recorded timings
+    std::string metricsLabel;
+    
+    // Rate limit queue for async requests
+    AsyncRequest::Admission admission;
+    
+    // Register a token for a new request, dropping those of finished ones
+    void trackToken(const std::shared_ptr<CancellationToken>& token);
     
     // Common code for making a request
     std::string makeRequest(const std::string& method, const std::string& url, const std::string& data);
     
-    // Parse URL
+    // Parse URL. For unix:// URLs the host is the socket path and the port is 0.
     struct UrlParts {
         std::string protocol;
         std::string host;
@@ -59,4 +252,52 @@ private:
         std::string path;
     };
     UrlParts parseUrl(const std::string& url);
+    
+    // Send a built request and return the response body
+    std::string makeRequest(const std::string& method, const std::string& url,
+                            const UrlParts& parts, const RequestWriter& request);
+    
+    // Build the request headers, apart from Host and Connection, for a
+    // body of the given length: 0 for none, -1 to send it chunked
+    HttpResponseParser::HeaderList buildHeaders(long long bodyLength);
+    
+    // Build the HTTP/1.1 request head; the body is written separately
+    std::string buildHead(const std::string& method, const UrlParts& parts, long long bodyLength);
+    
+    // Run a batch of plain HTTP requests on io_uring
+    std::vector<AsyncRequest::Result> runUringBatch(const std::vector<BatchRequest>& requests,
+                                                    const std::vector<UrlParts>& parts);
+    
+    // Start a request built by sendAsync
+    std::shared_ptr<AsyncRequest> startAsync(const UrlParts& parts, const AsyncRequest::Message& message,
+                                             const AsyncRequest::DataCallback& onData,
+                                             const AsyncRequest::CompletionCallback& onComplete);
+    
+    // Send a request and feed the response to the parser until it is
+    // complete, marking each phase in the timing
+    void exchange(const UrlParts& parts, const RequestWriter& request, HttpResponseParser& parser,
+                  const CancellationToken& token, RequestTiming& timing);
+    
+    // Run exchange, retrying under the policy; restart is called before
+    // each retry to drop what the failed attempt collected. The timing of
+    // the final attempt is recorded in RequestMetrics.
+    void exchangeWithRetry(const UrlParts& parts, const RequestWriter& request,
+                           HttpResponseParser& parser, const CancellationToken& token,
+                           const std::function<void()>& restart);
+    
+    // Wait out the backoff before the next attempt. Returns false if the
+    // request should fail instead.
+    bool waitToRetry(int attempt, int statusCode, const HttpResponseParser::HeaderList& headers,
+                     std::chrono::milliseconds& delay, const CancellationToken& token);
+    
+    // Take a connection for the URL from the pool, opening one if needed
+    void openConnection(const UrlParts& parts, const RequestDeadline& deadline, const CancellationToken& token,
+                        RequestTiming& timing);
+    
+    // Block until the connection has data to read; throws TimeoutError
+    // when the next limit is reached first, and Gio::Error when cancelled
+    void waitForData(const RequestDeadline& deadline, const CancellationToken& token);
+    
+    // Hand the current connection back to the pool
+    void releaseConnection(bool reusable);
 }; 
\ No newline at end of file
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <functional>
+#include "ChunkedDecoder.h"
+#include "ContentDecoder.h"
+#include "ReadBuffer.h"
+
+// Incremental HTTP/1.1 response parser.
+// Bytes can be fed in pieces of any size; each byte is looked at once and
+// body bytes are handed to the body handler as spans of the input buffer,
+// or of the decompression buffer for compressed bodies.
+class HttpResponseParser {
+public:
+    // Receives body bytes; return false to stop parsing
+    using BodyHandler = std::function<bool(const char* data, size_t length)>;
+
+    // Header name/value pairs in the order they were received
+    using HeaderList = std::vector<std::pair<std::string, std::string>>;
+
+    // Constructor
+    HttpResponseParser();
+
+    // The chunked decoder calls back into this object
+    HttpResponseParser(const HttpResponseParser&) = delete;
+    HttpResponseParser& operator=(const HttpResponseParser&) = delete;
+
+    // Prepare for a new response
+    void reset();
+
+    // Set the handler for body bytes
+    void setBodyHandler(const BodyHandler& handler);
+
+    // Responses to HEAD requests have no body, whatever the headers say
+    void setHeadRequest(bool head);
+
+    // Parse the next piece of the response. Returns the number of bytes
+    // consumed, which is less than length once the response is complete or
+    // the body handler asked to stop. Throws on malformed input.
+    size_t feed(const char* data, size_t length);
+
+    // Parse the unread bytes of a read buffer and consume them. Returns true
+    // if parsing stopped with bytes left over; those are dropped.
+    bool feed(ReadBuffer& buffer);
+
+    // Take a response whose head was framed by another protocol (HTTP/2).
+    // The body that follows is passed to feedBody and ends with endBody.
+    void setHead(int status, const HeaderList& headerList);
+
+    // Pass body bytes of a response started with setHead. Returns false
+    // if the body handler asked to stop. Throws on a corrupt compressed body.
+    bool feedBody(const char* data, size_t length);
+
+    // The body of a response started with setHead is complete
+    void endBody();
+
+    // Tell the parser the connection was closed. Completes a response that
+    // is delimited by the connection close; throws if the response is cut short.
+    void finish();
+
+    // Check parser state
+    bool headersComplete() const;
+    bool isComplete() const;
+    bool isAborted() const;
+
+    // Status line
+    int getStatusCode() const { return statusCode; }
+    const std::string& getReason() const { return reason; }
+
+    // Get a header value by case-insensitive name, or "" if absent
+    std::string getHeader(const std::string& name) const;
+
+    // Get all headers and trailers
+    const HeaderList& getHeaders() const { return headers; }
+    const HeaderList& getTrailers() const { return trailers; }
+
+    // Body framing
+    bool isChunked() const { return framing == Framing::Chunked; }
+
+    // Check if the connection can carry another request after this response
+    bool keepAlive() const;
+
+    // Number of body bytes received so far, before decompression
+    size_t getBodyBytes() const { return bodyBytes; }
+
+    // Number of body bytes delivered to the handler so far
+    unsigned long long getDecodedBytes() const;
+
+    // Check if the body is being decompressed
+    bool isCompressed() const { return contentDecoder.isActive(); }
+
+    // Largest accepted status line or header line
+    static const size_t maxLineLength = 64 * 1024;
+
+private:
+    enum class State {
+        StatusLine,
+        HeaderLine,
+        Body,
+        ChunkedBody,
+        TrailerLine,
+        Complete,
+        Aborted
+    };
+
+    enum class Framing {
+        None,
+        ContentLength,
+        Chunked,
+        UntilClose
+    };
+
+    State state;
+    Framing framing;
+    BodyHandler bodyHandler;
+    bool headRequest;
+
+    // Status line
+    int versionMajor;
+    int versionMinor;
+    int statusCode;
+    std::string reason;
+
+    // Headers and trailers
+    HeaderList headers;
+    HeaderList trailers;
+
+    // Partial line carried over between feed() calls
+    std::string line;
+
+    // Bytes left in a fixed-length body
+    unsigned long long remaining;
+
+    // Decoder for chunked bodies
+    ChunkedDecoder chunkedDecoder;
+
+    // Decompressor for bodies with a Content-Encoding
+    ContentDecoder contentDecoder;
+
+    // Number of body bytes received
+    size_t bodyBytes;
+
+    // Collect bytes up to the end of a line. Returns true once the line in
+    // 'line' is complete (without its CRLF); 'pos' is advanced past what was read.
+    bool readLine(const char* data, size_t length, size_t& pos);
+
+    // Handle complete lines
+    void parseStatusLine();
+    void parseHeaderLine(HeaderList& list);
+    void onHeadersComplete();
+
+    // Pass body bytes on; returns false if the handler asked to stop
+    bool deliver(const char* data, size_t length);
+
+    // Pass decoded body bytes to the handler
+    bool deliverDecoded(const char* data, size_t length);
+
+    // Check the compressed stream once the response is complete
+    void finishBody();
+};
@@ -1,9 +1,11 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <functional>
 #include <map>
+#include <memory>
 
 // Message structure for chat requests
 struct Message {
@@ -47,6 +49,14 @@ public:
         return type == Object && objectValues.find(key) != objectValues.end();
     }
     
+    std::vector<std::string> getKeys() const {
+        std::vector<std::string> keys;
+        for (const auto& entry : objectValues) {
+            keys.push_back(entry.first);
+        }
+        return keys;
+    }
+    
     const SimpleJson& operator[](const std::string& key) const {
         static SimpleJson nullValue;
         if (type != Object) return nullValue;
@@ -55,8 +65,17 @@ public:
         return nullValue;
     }
     
+    size_t getArraySize() const { return type == Array ? arrayValues.size() : 0; }
+    const SimpleJson& getArrayItem(size_t index) const { return arrayValues[index]; }
+    
     std::string toJsonString() const;
     
+    // Append the JSON text to out instead of building a string of its own
+    void appendJson(std::string& out) const;
+    
+    // Length of the JSON text, counted without building it
+    size_t jsonLength() const;
+    
 private:
     Type type;
     bool boolValue = false;
@@ -66,9 +85,16 @@ private:
     std::map<std::string, SimpleJson> objectValues;
 };
 
+class CancellationToken;
+
 // Base class for LLM API implementations
-class LLMApi {
+class LLMApi : public std::enable_shared_from_this<LLMApi> {
 public:
+    // Receives reply text as it arrives and whether the reply is complete.
+    // Runs on the main loop; the text is a view that is only valid during
+    // the call, so keep a copy to use it later.
+    using ResponseCallback = std::function<void(std::string_view text, bool isComplete)>;
+    
     // Constructor and destructor
     LLMApi() = default;
     virtual ~LLMApi() = default;
@@ -81,17 +107,33 @@ public:
     virtual std::string getApiKey() const;
     virtual std::string getEndpoint() const;
     
-    // Get available models
-    virtual std::vector<std::string> getAvailableModels() = 0;
+    // Get available models from the shared catalog. Never blocks: returns
+    // what is cached, or the defaults, and fetches the list in the background.
+    // Only works on APIs owned by a shared_ptr.
+    std::vector<std::string> getAvailableModels();
+    
+    // URL that lists the models; empty if they can't be listed
+    virtual std::string getModelsUrl() const = 0;
+    
+    // Headers for listing the models
+    virtual std::map<std::string, std::string> getModelsHeaders() const;
+    
+    // Extract model names from the model list response
+    virtual std::vector<std::string> parseModelsResponse(const std::string& response) = 0;
+    
+    // Models to offer when the list can't be fetched
+    virtual std::vector<std::string> getDefaultModels() const;
     
     // Send a single message
-    virtual void sendMessage(const std::string& message, const std::string& model, 
-                           const std::function<void(const std::string&, bool)>& callback) = 0;
+    virtual std::shared_ptr<CancellationToken> sendMessage(const std::string& message, const std::string& model, 
+                           const ResponseCallback& callback) = 0;
     
-    // Send a chat request with multiple messages
-    virtual void sendChatRequest(const std::vector<Message>& messages, 
+    // Send a chat request with multiple messages. Any number of requests
+    // may run at once, each on its own connection; the returned token
+    // cancels just this one. Null if the request couldn't be started.
+    virtual std::shared_ptr<CancellationToken> sendChatRequest(const std::vector<Message>& messages, 
                                const std::string& model,
-                               const std::function<void(const std::string&, bool)>& callback) = 0;
+                               const ResponseCallback& callback) = 0;
     
     // Check if API is configured
     virtual bool isConfigured() const = 0;
@@ -99,9 +141,23 @@ public:
     // Get API name
     virtual std::string getName() const = 0;
     
-    // Cancel any ongoing requests
+    // Cancel all requests in flight
     virtual void cancelRequest();
 
+protected:
+    // Find the string value of key in a piece of JSON, starting at from.
+    // Values without escapes are returned as views of json; others are
+    // unescaped into scratch. Empty if the key is missing or not a string.
+    static std::string_view findJsonString(std::string_view json, std::string_view key,
+                                           std::string& scratch, size_t from = 0);
+    
+    // Pass the text of one event of an OpenAI-style chat completion stream
+    // ({"choices":[{"delta":{"content":"text"}}]}) on to callback, using
+    // scratch for unescaping. Returns false if the event was an error,
+    // which has then been reported as the end of the reply.
+    static bool handleChatCompletionEvent(std::string_view data, std::string& scratch,
+                                          const ResponseCallback& callback);
+
 private:
     std::string apiKey;
     std::string endpoint;
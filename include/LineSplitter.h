@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <functional>
+
+// Splits a streamed body into lines. Lines that arrive whole are passed on
+// as views of the caller's data; only a line cut by a chunk boundary is
+// collected, and each byte of it is copied once, so long bursts stay linear.
+class LineSplitter {
+public:
+    // Receives one line without its "\n" or "\r\n", as a view that is only
+    // valid during the call; return false to stop
+    using LineCallback = std::function<bool(std::string_view line)>;
+
+    // Pass on every line completed by data. Returns false if onLine asked
+    // to stop, in which case the rest of data is dropped.
+    bool feed(std::string_view data, const LineCallback& onLine);
+
+    // Pass on what is left after the last newline, as a line of its own
+    bool finish(const LineCallback& onLine);
+
+    // Forget a partial line
+    void clear() { partial.clear(); }
+
+    // Number of bytes of the line that is not complete yet
+    size_t pendingSize() const { return partial.size(); }
+
+private:
+    // Start of a line cut by a chunk boundary
+    std::string partial;
+};
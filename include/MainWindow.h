@@ -22,6 +22,7 @@ private:
     Gtk::MenuItem settingsMenuItem;
     Gtk::MenuItem saveMenuItem;
     Gtk::MenuItem loadMenuItem;
+    Gtk::MenuItem timingsMenuItem;
     Gtk::MenuItem aboutMenuItem;
     Gtk::MenuItem quitMenuItem;
     
@@ -37,6 +38,7 @@ private:
     void onSettingsClicked();
     void onSaveClicked();
     void onLoadClicked();
+    void onTimingsClicked();
     void onAboutClicked();
     void onQuitClicked();
     void onApiConfigChanged();
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <gtkmm.h>
+#include "LLMApi.h"
+#include "HttpClient.h"
+
+// Model lists of all APIs, fetched on the main loop and shared by every
+// caller. Callers get the cached list right away, even when it is older
+// than the TTL, and a stale or missing list is fetched in the background.
+// Calls made while a fetch is running share it instead of starting
+// another. Must be used on the main loop thread.
+class ModelCatalog {
+public:
+    // Get singleton instance
+    static ModelCatalog& getInstance();
+
+    // Get the models of an API: the cached list, or the API's defaults if
+    // there is none yet. Starts a fetch if the list is missing or stale.
+    std::vector<std::string> getModels(const std::shared_ptr<LLMApi>& api);
+
+    // Forget the models of an API and stop its fetch, e.g. after its key
+    // or endpoint changed
+    void invalidate(const std::string& apiName);
+
+    // Set how long a fetched list is fresh
+    void setTtl(std::chrono::seconds ttl);
+
+    // Emitted with the API's name when a fetch changed its model list
+    sigc::signal<void, const std::string&> signal_models_changed();
+
+private:
+    // Private constructor for singleton
+    ModelCatalog();
+
+    // Delete copy constructor and assignment operator
+    ModelCatalog(const ModelCatalog&) = delete;
+    ModelCatalog& operator=(const ModelCatalog&) = delete;
+
+    struct Entry {
+        // URL and headers the list comes from
+        std::string source;
+
+        // Fetched models, valid once loaded is set
+        std::vector<std::string> models;
+        bool loaded = false;
+
+        // When the last fetch finished, and whether it failed
+        std::chrono::steady_clock::time_point fetched;
+        bool failed = false;
+
+        // Fetch in flight, and its number, which tells its result apart
+        // from that of a fetch for an older source
+        std::shared_ptr<AsyncRequest> request;
+        unsigned long generation = 0;
+    };
+
+    std::map<std::string, Entry> entries;
+    std::chrono::seconds ttl;
+
+    // Fetches started so far
+    unsigned long fetchCount;
+
+    // Client for the model list requests, apart from the APIs' own so
+    // cancelling a chat doesn't cancel a fetch
+    HttpClient httpClient;
+
+    sigc::signal<void, const std::string&> modelsChanged;
+
+    // Check if it is time to fetch an entry's list again
+    bool isStale(const Entry& entry) const;
+
+    // Start fetching the list of an API
+    void fetch(const std::shared_ptr<LLMApi>& api, Entry& entry);
+};
@@ -16,6 +16,9 @@ public:
     // Set the selected model
     void setSelectedModel(const std::string& apiName, const std::string& modelName);
     
+    // Fetch the model list of the selected API again
+    void refreshModels();
+    
     // Signal for API configuration changed
     sigc::signal<void> signal_api_config_changed();
     
@@ -69,6 +72,7 @@ private:
     // Signal handlers
     void onApiChanged();
     void onSaveClicked();
+    void onModelsChanged(const std::string& changedApiName);
     
     // Helper methods
     void populateApiComboBox();
@@ -2,11 +2,10 @@
 
 #include "LLMApi.h"
 #include "HttpClient.h"
+#include "RequestSet.h"
 #include <string>
 #include <vector>
-#include <thread>
-#include <mutex>
-#include <atomic>
+#include <memory>
 #include <functional>
 
 class OllamaApi : public LLMApi {
@@ -15,12 +14,13 @@ public:
     ~OllamaApi() override;
 
     // LLMApi interface implementation
-    std::vector<std::string> getAvailableModels() override;
-    void sendMessage(const std::string& message, const std::string& model, 
-                    const std::function<void(const std::string&, bool)>& callback) override;
-    void sendChatRequest(const std::vector<Message>& messages, 
+    std::string getModelsUrl() const override;
+    std::vector<std::string> parseModelsResponse(const std::string& response) override;
+    std::shared_ptr<CancellationToken> sendMessage(const std::string& message, const std::string& model, 
+                    const ResponseCallback& callback) override;
+    std::shared_ptr<CancellationToken> sendChatRequest(const std::vector<Message>& messages, 
                         const std::string& model,
-                        const std::function<void(const std::string&, bool)>& callback) override;
+                        const ResponseCallback& callback) override;
     bool isConfigured() const override;
     std::string getName() const override {
         return "Ollama";
@@ -29,14 +29,12 @@ public:
 
 private:
     HttpClient httpClient;
-    std::thread requestThread;
-    std::atomic<bool> cancelRequestFlag;
-    std::mutex threadMutex;
+    
+    // Chat requests running on the main loop
+    RequestSet requests;
 
     // Helper methods
     SimpleJson createRequestPayload(const std::vector<Message>& messages, const std::string& model);
     std::string performHttpRequest(const std::string& url, const std::string& data);
-    std::vector<std::string> parseModelsResponse(const std::string& response);
     std::string parseStreamingResponse(const std::string& response);
-    void cleanupThread();
 }; 
\ No newline at end of file
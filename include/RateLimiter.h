@@ -0,0 +1,96 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <deque>
+#include <memory>
+#include <chrono>
+#include <functional>
+#include <gtkmm.h>
+#include "Config.h"
+#include "HttpResponseParser.h"
+
+// Client-side admission control for provider APIs. Each provider and
+// model gets token buckets for requests and estimated tokens per minute,
+// sized from Config and tightened by the rate limit headers of responses.
+// Requests that don't fit wait in a local queue instead of being sent
+// only to be rejected with 429. Must be used on the main loop thread.
+class RateLimiter {
+public:
+    // A request waiting for admission. Dropping the last reference to it
+    // takes it out of the queue.
+    struct Ticket {
+        long tokens = 0;
+        std::function<void()> ready;
+    };
+
+    // Get singleton instance
+    static RateLimiter& getInstance();
+
+    // Queue a request that will use about the given number of tokens.
+    // ready runs once there is room, before returning if there is room now.
+    std::shared_ptr<Ticket> admit(const std::string& provider, const std::string& model,
+                                  long tokens, const std::function<void()>& ready);
+
+    // Adjust the buckets from a response: x-ratelimit-limit-*, -remaining-*
+    // and -reset-* headers, Retry-After, and 429 itself
+    void update(const std::string& provider, const std::string& model,
+                int statusCode, const HttpResponseParser::HeaderList& headers);
+
+    // Rough token count of a request body
+    static long estimateTokens(const std::string& text);
+
+    // Rough token count of a request body of the given length in bytes
+    static long estimateTokens(size_t length);
+
+    // Get the number of requests waiting for a provider and model
+    size_t getQueueLength(const std::string& provider, const std::string& model) const;
+
+private:
+    // Private constructor for singleton
+    RateLimiter();
+
+    // Delete copy constructor and assignment operator
+    RateLimiter(const RateLimiter&) = delete;
+    RateLimiter& operator=(const RateLimiter&) = delete;
+
+    // Units available now, refilled continuously up to one minute's worth
+    struct Bucket {
+        double perMinute = 0;
+        double level = 0;
+        std::chrono::steady_clock::time_point refilled;
+
+        // Set the limit, keeping the level within it; zero means no limit
+        void setLimit(double perMinute, std::chrono::steady_clock::time_point now);
+
+        // Add what accrued since the last refill
+        void refill(std::chrono::steady_clock::time_point now);
+
+        // Time until the given amount is available
+        std::chrono::milliseconds waitFor(double amount) const;
+    };
+
+    struct Queue {
+        std::string provider;
+        std::string model;
+        Bucket requests;
+        Bucket tokens;
+
+        // Limits the server reported, zero when unknown
+        Config::RateLimit serverLimits;
+
+        // Nothing is sent before this, after a 429 or an exhausted limit
+        std::chrono::steady_clock::time_point blockedUntil;
+
+        std::deque<std::weak_ptr<Ticket>> waiting;
+        sigc::connection timer;
+    };
+
+    std::map<std::string, Queue> queues;
+
+    // Get the queue for a provider and model, with its limits brought up to date
+    Queue& getQueue(const std::string& provider, const std::string& model);
+
+    // Admit waiting requests while there is room, then wait for more
+    void drain(const std::string& key);
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <string_view>
+#include <memory>
+#include <vector>
+
+// Growable ring buffer that response bytes are read into. Each pooled
+// connection keeps one for its lifetime, and closed connections hand theirs
+// back for reuse, so once a stream is under way reads allocate nothing.
+// The read size adapts to how much the socket delivers per read.
+class ReadBuffer {
+public:
+    // Counters over all read buffers
+    struct Stats {
+        // Heap allocations made for buffer storage
+        unsigned long long allocations = 0;
+
+        // Bytes allocated for buffer storage
+        unsigned long long allocatedBytes = 0;
+
+        // Buffers handed out from the free list instead of allocated
+        unsigned long long reused = 0;
+
+        // Reads committed into buffers
+        unsigned long long reads = 0;
+    };
+
+    // Smallest and largest read offered to the socket
+    static const size_t minReadSize = 4096;
+    static const size_t maxReadSize = 65536;
+
+    // Take a buffer from the free list, or allocate one. The buffer goes
+    // back to the free list when the last reference is dropped.
+    static std::shared_ptr<ReadBuffer> acquire();
+
+    // Get the counters
+    static Stats getStats();
+
+    // Space for the next read, at most the current read size. Grows the
+    // buffer only if unread bytes leave too little room.
+    std::pair<char*, size_t> prepare();
+
+    // Mark bytes written into the prepared space as readable
+    void commit(size_t length);
+
+    // The oldest unread bytes. When the unread data wraps around the end of
+    // the ring, this is the part up to the end; consume it to get the rest.
+    std::string_view peek() const;
+
+    // Drop bytes from the front
+    void consume(size_t length);
+
+    // Drop everything unread
+    void clear();
+
+    // Number of unread bytes
+    size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+
+    // Current read size
+    size_t getReadSize() const { return readSize; }
+
+private:
+    ReadBuffer();
+
+    ReadBuffer(const ReadBuffer&) = delete;
+    ReadBuffer& operator=(const ReadBuffer&) = delete;
+
+    std::vector<char> storage;
+    size_t start;
+    size_t length;
+
+    // Adaptive read size, and how many reads in a row used little of it
+    size_t readSize;
+    size_t prepared;
+    int smallReads;
+
+    // Reallocate with at least the given capacity, unwrapping unread data
+    void grow(size_t capacity);
+
+    // Return a buffer to the free list
+    static void recycle(ReadBuffer* buffer);
+};
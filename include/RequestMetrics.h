@@ -0,0 +1,105 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <array>
+#include <vector>
+#include <mutex>
+#include <chrono>
+
+// Points in the life of a request, in the order they are reached
+enum class RequestPhase {
+    Dns,            // Host name resolved
+    Connect,        // TCP or unix socket connected
+    Tls,            // TLS handshake done
+    RequestSent,    // Request head and body written
+    FirstByte,      // First response bytes read
+    FirstToken,     // First body bytes passed on to the caller
+    LastByte        // Response complete
+};
+
+// Timestamps of one request, as time since it started. Phases that were
+// skipped (DNS, connect and TLS on a reused connection) stay unset.
+struct RequestTiming {
+    static const size_t phaseCount = 7;
+
+    std::chrono::steady_clock::time_point started;
+    std::array<std::chrono::microseconds, phaseCount> phases;
+
+    // Set when the request went out on a pooled connection or HTTP/2 session
+    bool reusedConnection = false;
+
+    // Constructor; starts the clock
+    RequestTiming();
+
+    // Restart the clock and forget every phase
+    void start();
+
+    // Record the current time for a phase, unless it is already set
+    void mark(RequestPhase phase);
+
+    // Check if a phase was reached
+    bool reached(RequestPhase phase) const;
+
+    // Time from the start to a phase; negative if it wasn't reached
+    std::chrono::microseconds at(RequestPhase phase) const;
+
+    // Name of a phase for reports
+    static const char* phaseName(RequestPhase phase);
+};
+
+// Recent request timings for each provider (or host), with percentiles
+// over a rolling window. Shared by all HttpClient instances; thread-safe.
+class RequestMetrics {
+public:
+    // Percentiles of one phase over the window
+    struct Percentiles {
+        size_t count = 0;
+        std::chrono::microseconds p50{0};
+        std::chrono::microseconds p95{0};
+        std::chrono::microseconds p99{0};
+    };
+
+    // Get singleton instance
+    static RequestMetrics& getInstance();
+
+    // Add a finished request to the provider's window
+    void record(const std::string& provider, const RequestTiming& timing);
+
+    // Get the percentiles of a phase for a provider
+    Percentiles getPercentiles(const std::string& provider, RequestPhase phase) const;
+
+    // Get the most recent timing recorded for a provider. Returns false if there is none.
+    bool getLast(const std::string& provider, RequestTiming& timing) const;
+
+    // Get the providers with recorded requests
+    std::vector<std::string> getProviders() const;
+
+    // Set how many recent requests each provider's window keeps
+    void setWindowSize(size_t size);
+
+    // Forget everything recorded
+    void clear();
+
+    // Render every provider's percentiles as a plain text table
+    std::string dump() const;
+
+private:
+    // Private constructor for singleton
+    RequestMetrics();
+
+    // Delete copy constructor and assignment operator
+    RequestMetrics(const RequestMetrics&) = delete;
+    RequestMetrics& operator=(const RequestMetrics&) = delete;
+
+    // Ring of recent samples for each phase of one provider
+    struct Window {
+        std::array<std::vector<std::chrono::microseconds>, RequestTiming::phaseCount> samples;
+        std::array<size_t, RequestTiming::phaseCount> next{};
+        RequestTiming last;
+    };
+
+    std::map<std::string, Window> windows;
+    size_t windowSize;
+    mutable std::mutex mutex;
+};
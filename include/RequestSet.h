@@ -0,0 +1,27 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "AsyncRequest.h"
+
+// Requests a provider has in flight on the main loop. Each request has its
+// own connection lease and cancellation token, so any number of them can
+// run at once; the set keeps them alive until they finish and cancels them
+// all when the provider shuts down. Must be used on the main loop thread.
+class RequestSet {
+public:
+    // Keep a request alive until it finishes
+    void add(const std::shared_ptr<AsyncRequest>& request);
+
+    // Cancel every request in flight
+    void cancelAll();
+
+    // Get the number of requests in flight
+    size_t size();
+
+private:
+    std::vector<std::shared_ptr<AsyncRequest>> requests;
+
+    // Drop requests that have finished
+    void prune();
+};
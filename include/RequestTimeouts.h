@@ -0,0 +1,82 @@
+#pragma once
+
+#include <string>
+#include <chrono>
+#include <stdexcept>
+
+// Time limits for one HTTP request; zero disables a limit
+struct RequestTimeouts {
+    // Opening the connection, including DNS and the TLS handshake
+    std::chrono::milliseconds connect{15000};
+
+    // From sending the request to the first byte of the response
+    std::chrono::milliseconds firstByte{120000};
+
+    // Between two reads once the response has started
+    std::chrono::milliseconds idle{60000};
+
+    // The whole request
+    std::chrono::milliseconds total{0};
+};
+
+// The limit a request ran into
+enum class TimeoutPhase {
+    None,
+    Connect,
+    FirstByte,
+    Idle,
+    Total
+};
+
+// Thrown by the blocking HttpClient calls when a limit is reached
+class TimeoutError : public std::runtime_error {
+public:
+    TimeoutError(TimeoutPhase phase, std::chrono::milliseconds limit);
+
+    // Get the limit that was reached
+    TimeoutPhase getPhase() const { return phase; }
+
+    // Describe a timeout for error messages
+    static std::string describe(TimeoutPhase phase, std::chrono::milliseconds limit);
+
+private:
+    TimeoutPhase phase;
+};
+
+// Tracks which limit applies to a request as it moves from connecting to
+// waiting for the response to streaming it
+class RequestDeadline {
+public:
+    // Starts the clock for the total limit and the connect phase
+    explicit RequestDeadline(const RequestTimeouts& timeouts);
+
+    // A new connection is being opened; the connect limit applies
+    void startConnect();
+
+    // The request is being sent; the first-byte limit applies
+    void awaitResponse();
+
+    // Response bytes arrived; the idle limit applies from now
+    void onData();
+
+    // Get the next limit to be reached. Returns false if no limit applies.
+    bool next(std::chrono::steady_clock::time_point& when, TimeoutPhase& phase) const;
+
+    // Get the configured value of a limit
+    std::chrono::milliseconds getLimit(TimeoutPhase phase) const;
+
+    // Build the error for a limit
+    TimeoutError error(TimeoutPhase phase) const;
+
+private:
+    enum class Stage {
+        Connecting,
+        Waiting,
+        Receiving
+    };
+
+    RequestTimeouts timeouts;
+    Stage stage;
+    std::chrono::steady_clock::time_point started;
+    std::chrono::steady_clock::time_point stageStarted;
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <functional>
+#include <gtkmm.h>
+#include "BodyProducer.h"
+
+// Sends an HTTP/1.1 request as two buffers, the header block and the body,
+// with one vectored write, so the body is never copied into a combined
+// request string. The body is either shared with the caller or borrowed
+// from it; a borrowed body must outlive the write. A produced body is
+// written piece by piece as the producer makes it, with the head going out
+// together with the first piece.
+class RequestWriter {
+public:
+    // Request body shared between the caller and pending writes
+    using Body = std::shared_ptr<const std::string>;
+
+    // Called when an async write has finished; error is empty on success
+    using WriteCallback = std::function<void(const std::string& error)>;
+
+    // Constructor for a request without a body
+    explicit RequestWriter(const std::string& head);
+
+    // Constructor for a shared body
+    RequestWriter(const std::string& head, const Body& body);
+
+    // Constructor for a borrowed body
+    RequestWriter(const std::string& head, const std::string& body);
+
+    // Constructor for a produced body. Each write rewinds the producer;
+    // pieces are framed as chunks if its length is unknown, in which case
+    // the head must ask for chunked transfer encoding.
+    RequestWriter(const std::string& head, const std::shared_ptr<BodyProducer>& producer);
+
+    // Write the whole request; throws Glib::Error, or std::runtime_error
+    // if a produced body doesn't match its length
+    void write(const Glib::RefPtr<Gio::OutputStream>& stream,
+               const Glib::RefPtr<Gio::Cancellable>& cancellable = Glib::RefPtr<Gio::Cancellable>()) const;
+
+    // Write the whole request on the GLib main loop
+    void writeAsync(const Glib::RefPtr<Gio::OutputStream>& stream,
+                    const Glib::RefPtr<Gio::Cancellable>& cancellable,
+                    const WriteCallback& callback) const;
+
+    // Size of the request on the wire, not counting chunk framing
+    size_t size() const;
+
+private:
+    std::string head;
+
+    // Body bytes, and the owner keeping them alive when shared
+    const char* bodyData;
+    size_t bodyLength;
+    Body owner;
+
+    // Producer of the body, if it is made while writing
+    std::shared_ptr<BodyProducer> producer;
+
+    // State of one async write
+    struct PendingWrite;
+
+    // State of one write of a produced body
+    struct ProducedWrite;
+
+    static void onWritten(GObject* source, GAsyncResult* result, gpointer data);
+
+    // Write the head and produced body
+    void writeProduced(const Glib::RefPtr<Gio::OutputStream>& stream,
+                       const Glib::RefPtr<Gio::Cancellable>& cancellable) const;
+    void writeProducedAsync(const Glib::RefPtr<Gio::OutputStream>& stream,
+                            const Glib::RefPtr<Gio::Cancellable>& cancellable,
+                            const WriteCallback& callback) const;
+
+    // Write the next piece of a produced body on the main loop
+    static void writeNextPiece(ProducedWrite* pending);
+    static void onPieceWritten(GObject* source, GAsyncResult* result, gpointer data);
+};
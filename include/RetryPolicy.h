@@ -0,0 +1,82 @@
+#pragma once
+
+#include <string>
+#include <mutex>
+#include <chrono>
+#include <random>
+#include <stdexcept>
+#include "HttpResponseParser.h"
+
+// Thrown by the blocking HttpClient calls when no connection could be
+// opened; nothing reached the server, so the request can be retried
+class ConnectionError : public std::runtime_error {
+public:
+    explicit ConnectionError(const std::string& message) : std::runtime_error(message) {}
+};
+
+// Decides whether a failed request is tried again and how long to wait.
+// Rate limits (429) and overloaded or failing upstreams (5xx) are retried
+// with decorrelated-jitter backoff, or after the delay the server asked
+// for in Retry-After, or for a 429 the x-ratelimit-reset of the limit that
+// ran out, plus some jitter. A retry budget shared by all
+// requests using the policy stops retries from piling onto a server that
+// keeps failing. Thread-safe.
+class RetryPolicy {
+public:
+    struct Settings {
+        // Attempts per request, including the first
+        int maxAttempts = 4;
+
+        // Bounds of the backoff delay
+        std::chrono::milliseconds baseDelay{500};
+        std::chrono::milliseconds maxDelay{30000};
+
+        // Longest server-requested delay we're willing to wait; a longer one fails the request
+        std::chrono::milliseconds maxRetryAfter{60000};
+
+        // Retry budget: each retry spends a token, each success earns some back
+        double budget = 10.0;
+        double refillPerSuccess = 0.2;
+    };
+
+    // Constructor with the default settings
+    RetryPolicy();
+
+    // Constructor
+    explicit RetryPolicy(const Settings& settings);
+
+    // Check if a response status is worth retrying
+    static bool isRetryableStatus(int statusCode);
+
+    // Get the delay the server asked for. Retry-After counts for any status;
+    // a 429 without it waits for the rate limit that ran out to reset.
+    // Returns false if the headers don't say.
+    static bool serverDelay(int statusCode, const HttpResponseParser::HeaderList& headers,
+                            std::chrono::milliseconds& delay);
+
+    // Get the time until the rate limits that ran out reset: the
+    // x-ratelimit-reset of each bucket whose x-ratelimit-remaining is 0
+    // (requests and tokens for OpenAI, a single one for OpenRouter).
+    // Returns false if no bucket is used up or its reset isn't given.
+    static bool exhaustedReset(const HttpResponseParser::HeaderList& headers, std::chrono::milliseconds& delay);
+
+    // Decide whether to retry after a failed attempt. attempt counts the
+    // attempts made so far. statusCode is 0 when the connection failed before
+    // a response. delay holds the previous delay (zero after the first
+    // attempt) and is set to the wait before the next one.
+    bool shouldRetry(int attempt, int statusCode, const HttpResponseParser::HeaderList& headers,
+                     std::chrono::milliseconds& delay);
+
+    // Record a request that succeeded
+    void onSuccess();
+
+    // Get the settings
+    const Settings& getSettings() const { return settings; }
+
+private:
+    Settings settings;
+
+    mutable std::mutex mutex;
+    double tokens;
+    std::mt19937 random;
+};
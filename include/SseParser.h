@@ -0,0 +1,86 @@
+#pragma once
+
+#include "LineSplitter.h"
+#include <string>
+#include <string_view>
+#include <functional>
+
+// Parses a Server-Sent Events stream (text/event-stream) as it arrives, in
+// chunks split anywhere. Events whose lines all arrive in one chunk are
+// passed on as views of the caller's data; only the parts of an event cut
+// by a chunk boundary, or the joined lines of a multi-line event, are
+// copied, into buffers that are reused from event to event. Comments and
+// keep-alive pings are skipped, and after a "[DONE]" event the rest of the
+// stream is ignored.
+class SseParser {
+public:
+    // One event; the views are only valid during the callback
+    struct Event {
+        // Event type, "message" unless an "event:" field set it
+        std::string_view type;
+
+        // The "data:" lines of the event, joined with "\n"
+        std::string_view data;
+
+        // Last event ID seen on the stream, which carries over to later events
+        std::string_view id;
+    };
+
+    // Receives each complete event; return false to stop
+    using EventCallback = std::function<bool(const Event& event)>;
+
+    SseParser() = default;
+
+    SseParser(const SseParser&) = delete;
+    SseParser& operator=(const SseParser&) = delete;
+
+    // Pass on every event completed by data. Returns false if onEvent asked
+    // to stop, in which case the rest of data is dropped. Once the stream
+    // sent "[DONE]", data is dropped but true is returned, so the caller
+    // keeps reading until the response ends.
+    bool feed(std::string_view data, const EventCallback& onEvent);
+
+    // End of the stream; an event without its closing blank line is dropped
+    void finish();
+
+    // Forget everything, for a new stream
+    void clear();
+
+    // Check if the stream sent "[DONE]"
+    bool isDone() const { return done; }
+
+    // Reconnection delay the server asked for with "retry:", -1 if none
+    long getRetryMs() const { return retryMs; }
+
+private:
+    // Handle one line of the stream
+    bool onLine(std::string_view line);
+
+    // Hand the collected event to the callback and start a new one
+    bool dispatch();
+
+    // Move data that still points into the caller's chunk to our buffer
+    void keepData();
+
+    // Line splitting, with the part of a line cut by a chunk boundary
+    LineSplitter lines;
+
+    // The chunk and callback of the feed call in progress
+    std::string_view chunk;
+    const EventCallback* callback = nullptr;
+
+    // Data of the event being collected: a view of the current chunk while
+    // it is a single line from it, our buffer otherwise
+    std::string_view dataView;
+    std::string dataBuffer;
+    bool hasData = false;
+    bool dataBuffered = false;
+
+    // Type of the event being collected, and the last event ID
+    std::string eventType;
+    std::string lastId;
+
+    long retryMs = -1;
+    bool started = false;
+    bool done = false;
+};
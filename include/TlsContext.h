@@ -0,0 +1,121 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include <gtkmm.h>
+
+// TLS settings, session cache and handshake metrics shared by all HttpClient instances
+class TlsContext {
+public:
+    // Handshake counters. GLib's TLS backends don't report whether a
+    // session was actually resumed, so what resumption saves shows as the
+    // gap between handshakes offered a cached session and fresh ones.
+    struct Stats {
+        // Completed handshakes
+        unsigned long handshakes = 0;
+
+        // Completed handshakes that were offered a cached session
+        unsigned long sessionOffers = 0;
+
+        // Handshakes that failed
+        unsigned long failures = 0;
+
+        // Total and slowest handshake time
+        std::chrono::microseconds totalHandshakeTime{0};
+        std::chrono::microseconds maxHandshakeTime{0};
+
+        // Total time of the handshakes that were offered a cached session
+        std::chrono::microseconds totalOfferedTime{0};
+
+        // Average handshake time
+        std::chrono::microseconds averageHandshakeTime() const;
+
+        // Average time of handshakes with and without a cached session
+        std::chrono::microseconds averageOfferedTime() const;
+        std::chrono::microseconds averageFreshTime() const;
+    };
+
+    // Get singleton instance
+    static TlsContext& getInstance();
+
+    // Completion of an asynchronous handshake; stream is empty on failure
+    using HandshakeCallback = std::function<void(const Glib::RefPtr<Gio::IOStream>& stream,
+                                                 const std::string& error)>;
+
+    // Wrap a connected socket in a TLS client connection and run the handshake
+    Glib::RefPtr<Gio::IOStream> connect(const Glib::RefPtr<Gio::SocketConnection>& socket,
+                                        const std::string& host, int port,
+                                        const Glib::RefPtr<Gio::Cancellable>& cancellable = Glib::RefPtr<Gio::Cancellable>());
+
+    // Same as connect, but runs the handshake on the GLib main loop and
+    // offers the given application protocols through ALPN
+    void connectAsync(const Glib::RefPtr<Gio::SocketConnection>& socket,
+                      const std::string& host, int port,
+                      const std::vector<std::string>& protocols,
+                      const Glib::RefPtr<Gio::Cancellable>& cancellable,
+                      const HandshakeCallback& callback);
+
+    // Get the protocol the server picked through ALPN, or "" if none
+    static std::string negotiatedProtocol(const Glib::RefPtr<Gio::IOStream>& stream);
+
+    // Trust only the CA certificates in a PEM file (empty to use the system store)
+    void setCaFile(const std::string& path);
+
+    // Set how long a cached session is offered for resumption
+    void setSessionLifetime(std::chrono::seconds lifetime);
+
+    // Forget all cached sessions
+    void clearSessions();
+
+    // Get a snapshot of the handshake metrics
+    Stats getStats() const;
+
+private:
+    // Private constructor for singleton
+    TlsContext();
+    ~TlsContext();
+
+    // Delete copy constructor and assignment operator
+    TlsContext(const TlsContext&) = delete;
+    TlsContext& operator=(const TlsContext&) = delete;
+
+    // Last connection that completed a handshake with a host, used as the
+    // session source for the next connection to the same host
+    struct CachedSession {
+        Glib::RefPtr<Gio::IOStream> connection;
+        std::chrono::steady_clock::time_point created;
+    };
+
+    std::map<std::string, CachedSession> sessions;
+    std::chrono::seconds sessionLifetime;
+
+    // CA database used instead of the system one, if set
+    GTlsDatabase* database;
+
+    Stats stats;
+    mutable std::mutex mutex;
+
+    // Handshake in progress
+    struct Handshake {
+        Glib::RefPtr<Gio::IOStream> stream;
+        std::string host;
+        int port;
+        bool offeredSession;
+        std::chrono::steady_clock::time_point start;
+        HandshakeCallback callback;
+    };
+
+    // Create the TLS connection and offer a cached session
+    Handshake prepare(const Glib::RefPtr<Gio::SocketConnection>& socket, const std::string& host, int port,
+                      const std::vector<std::string>& protocols);
+
+    // Record the outcome of a handshake; returns the error message, empty on success
+    std::string finish(Handshake& handshake, gboolean ok, GError* error);
+
+    // GIO callback for connectAsync
+    static void onHandshakeReady(GObject* source, GAsyncResult* result, gpointer data);
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <functional>
+
+// Runs a batch of plain HTTP/1.1 requests at once on the calling thread
+// with io_uring, for headless use on Linux with hundreds of streams. The
+// connects, writes and reads of every request in flight go on one ring and
+// are submitted together, one system call per turn of the loop, and
+// responses are read into buffers registered with the kernel up front.
+// A connection is kept for the next request to the same endpoint when the
+// server allows it. Only http and unix sockets are supported; TLS stays
+// with the GIO path. Built only with liburing (HAVE_IO_URING).
+class UringTransport {
+public:
+    struct Request {
+        // "http" or "unix"; for unix the host is the socket path
+        std::string scheme;
+        std::string host;
+        int port = 80;
+
+        // HTTP/1.1 request head, and the body sent after it
+        std::string head;
+        std::shared_ptr<const std::string> body;
+
+        // Receives streamed body bytes as views of the registered buffer
+        // that are only valid during the call; return false to stop.
+        // Without it the body is collected in the result.
+        std::function<bool(std::string_view data)> onData;
+    };
+
+    struct Result {
+        // HTTP status code, 0 if no response was received
+        int statusCode = 0;
+
+        // Response body, when there is no data callback, or the error body
+        std::string body;
+
+        // Error message, empty on success
+        std::string error;
+    };
+
+    struct Settings {
+        // Requests in flight at once; each has its own registered buffer
+        unsigned maxInFlight = 256;
+
+        // Size of each registered read buffer
+        size_t bufferSize = 16 * 1024;
+
+        // Longest wait for a connect or a read; zero for none
+        std::chrono::milliseconds ioTimeout{60000};
+    };
+
+    // Counts from the last run
+    struct Stats {
+        // System calls that submitted or waited on the ring
+        size_t submits = 0;
+
+        // Completed operations
+        size_t completions = 0;
+
+        // Connections opened, and requests sent on a kept connection
+        size_t connects = 0;
+        size_t reused = 0;
+    };
+
+    // Check if the io_uring transport was built in and the kernel allows it
+    static bool isSupported();
+
+    // Constructor with the default settings; throws if the ring can't be set up
+    UringTransport();
+
+    // Constructor; throws if the ring can't be set up
+    explicit UringTransport(const Settings& settings);
+
+    // Destructor
+    ~UringTransport();
+
+    UringTransport(const UringTransport&) = delete;
+    UringTransport& operator=(const UringTransport&) = delete;
+
+    // Run the requests and return their results in the same order
+    std::vector<Result> run(const std::vector<Request>& requests);
+
+    // Get the counts of the last run
+    const Stats& getStats() const { return stats; }
+
+private:
+    // The ring, its registered buffers and the state of each request slot
+    struct Ring;
+    std::unique_ptr<Ring> ring;
+
+    Settings settings;
+    Stats stats;
+};
@@ -28,6 +28,9 @@ ApiManager::ApiManager() {
             api->setEndpoint(endpoint);
         }
     }
+    
+    // Requests to one provider run side by side up to the connection limit
+    ConnectionPool::getInstance().setMaxConnectionsPerHost(config.getMaxConnectionsPerHost());
 }
 
 ApiManager::~ApiManager() {
@@ -90,6 +93,44 @@ void ApiManager::setLastUsedModel(const std::string& api, const std::string& mod
     Config::getInstance().save();
 }
 
+void ApiManager::prewarm(const std::function<void()>& onReady) {
+    if (!Config::getInstance().getPrewarm()) {
+        return;
+    }
+    
+    // Get the API the user is about to talk to
+    auto [apiName, modelName] = getLastUsedModel();
+    auto api = getApi(apiName);
+    if (!api || !api->isConfigured()) {
+        return;
+    }
+    
+    std::string name = apiName;
+    
+    // The connect phases show up in Request Timings next to the provider's requests
+    prewarmClient.setMetricsLabel(name + " (prewarm)");
+    
+    try {
+        prewarmRequest = prewarmClient.preconnectAsync(api->getEndpoint(),
+            [name, onReady](const AsyncRequest::Result& result) {
+                if (result.cancelled) {
+                    return;
+                }
+                
+                if (!result.ok()) {
+                    std::cerr << "Failed to prewarm connection to " << name << ": " << result.error << std::endl;
+                    return;
+                }
+                
+                if (onReady) {
+                    onReady();
+                }
+            });
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to prewarm connection to " << name << ": " << e.what() << std::endl;
+    }
+}
+
 void ApiManager::initApis() {
     // Create API instances
     apis["Ollama"] = std::make_shared<OllamaApi>();
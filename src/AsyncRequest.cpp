@@ -0,0 +1,658 @@
+#include "AsyncRequest.h"
+#include "TlsContext.h"
+#include "HappyEyeballs.h"
+#include "Http2Session.h"
+#include "CircuitBreaker.h"
+#include <iostream>
+
+AsyncRequest::AsyncRequest(const Glib::RefPtr<Gio::SocketClient>& client,
+                           const std::string& scheme, const std::string& host, int port,
+                           const Message& message,
+                           const DataCallback& onData, const CompletionCallback& onComplete)
+    : client(client),
+      scheme(scheme),
+      host(host),
+      port(port),
+      key(ConnectionPool::makeKey(scheme, host, port)),
+      message(message),
+      onData(onData),
+      onComplete(onComplete),
+      cancellable(Gio::Cancellable::create()),
+      token(CancellationToken::create()),
+      cancelHandler(0),
+      http2Stream(0),
+      http2Enabled(false),
+      connectOnly(false),
+      received(0),
+      trailingData(false),
+      waitingForAdmission(false),
+      deadline(timeouts),
+      timedOut(TimeoutPhase::None),
+      circuitBreakerEnabled(true),
+      endpoint(CircuitBreaker::endpointUrl(scheme, host, port)),
+      breakerAdmitted(false),
+      retries(0),
+      retryDelay(0),
+      delivered(false),
+      connectFailed(false),
+      attempt(0),
+      finished(false),
+      waitingForSlot(false) {
+    parser.setHeadRequest(message.method == "HEAD");
+    parser.setBodyHandler([this](const char* data, size_t length) {
+        if (result.cancelled || token->isCancelled()) {
+            return false;
+        }
+        // Buffered bodies and error details are kept for the result
+        if (!this->onData || parser.getStatusCode() >= 400) {
+            result.body.append(data, length);
+            return true;
+        }
+        delivered = true;
+        return this->onData(std::string_view(data, length));
+    });
+}
+
+AsyncRequest::~AsyncRequest() {
+    timer.disconnect();
+    retryTimer.disconnect();
+    if (cancelHandler != 0) {
+        token->getCancellable()->disconnect(cancelHandler);
+    }
+
+    // A request dropped mid-flight can't leave its connection in the pool
+    ConnectionPool::getInstance().release(connection, false);
+}
+
+void AsyncRequest::setTimeouts(const RequestTimeouts& timeouts) {
+    this->timeouts = timeouts;
+}
+
+void AsyncRequest::setRetryPolicy(const std::shared_ptr<RetryPolicy>& policy) {
+    retryPolicy = policy;
+}
+
+void AsyncRequest::setConnectOnly(bool connectOnly) {
+    this->connectOnly = connectOnly;
+}
+
+void AsyncRequest::setHttp2Enabled(bool enabled) {
+    http2Enabled = enabled;
+}
+
+void AsyncRequest::setMetricsLabel(const std::string& label) {
+    metricsLabel = label;
+}
+
+void AsyncRequest::setAdmission(const Admission& admission) {
+    this->admission = admission;
+}
+
+void AsyncRequest::setCircuitBreakerEnabled(bool enabled) {
+    circuitBreakerEnabled = enabled;
+}
+
+void AsyncRequest::start() {
+    // The token may be cancelled from another thread; finish on the main loop
+    std::weak_ptr<AsyncRequest> weak = shared_from_this();
+    cancelHandler = token->getCancellable()->connect([weak]() {
+        Glib::signal_idle().connect_once([weak]() {
+            if (auto self = weak.lock()) {
+                self->cancel();
+            }
+        });
+    });
+
+    startAttempt();
+}
+
+void AsyncRequest::cancel() {
+    if (finished) {
+        return;
+    }
+
+    token->cancel();
+    result.cancelled = true;
+
+    // Nothing is pending while we wait for admission, a pool slot or a retry,
+    // and an HTTP/2 stream is reset without a callback, so finish right away
+    if (waitingForAdmission || waitingForSlot || retryTimer.connected() || http2Session) {
+        complete("");
+        return;
+    }
+
+    // The pending GIO operation completes with an error and finishes the request
+    cancellable->cancel();
+}
+
+void AsyncRequest::startAttempt() {
+    // Don't queue or wait on an endpoint that is known to be down
+    if (circuitBreakerEnabled && !connectOnly) {
+        if (!CircuitBreaker::getInstance().allowRequest(endpoint)) {
+            complete(CircuitBreaker::unavailableError(endpoint));
+            return;
+        }
+        breakerAdmitted = true;
+    }
+
+    if (admission.provider.empty()) {
+        deadline = RequestDeadline(timeouts);
+        armTimer();
+        acquireConnection();
+        return;
+    }
+
+    // The limits for the whole attempt start once the request is admitted
+    waitingForAdmission = true;
+    std::weak_ptr<AsyncRequest> weak = shared_from_this();
+    admissionTicket = RateLimiter::getInstance().admit(admission.provider, admission.model, admission.tokens,
+        [weak]() {
+            if (auto self = weak.lock()) {
+                self->waitingForAdmission = false;
+                self->deadline = RequestDeadline(self->timeouts);
+                self->armTimer();
+                self->acquireConnection();
+            }
+        });
+}
+
+void AsyncRequest::acquireConnection() {
+    if (finished) {
+        return;
+    }
+
+    // Time spent waiting for a pool slot counts towards the attempt
+    if (!waitingForSlot) {
+        timing.start();
+    }
+    waitingForSlot = false;
+
+    if (result.cancelled) {
+        complete("");
+        return;
+    }
+
+    // Share an HTTP/2 connection to the host if one has room for another stream
+    if (http2Enabled && scheme == "https") {
+        http2Session = Http2Session::find(key);
+        if (http2Session) {
+            timing.reusedConnection = true;
+            startHttp2();
+            return;
+        }
+    }
+
+    auto self = shared_from_this();
+
+    switch (ConnectionPool::getInstance().tryAcquire(key, connection)) {
+        case ConnectionPool::Lease::Idle:
+            timing.reusedConnection = true;
+            onConnectionReady();
+            break;
+
+        case ConnectionPool::Lease::Reserved:
+            deadline.startConnect();
+            armTimer();
+            if (scheme == "unix") {
+                connectUnix();
+                break;
+            }
+            HappyEyeballs::getInstance().connectAsync(client, host, port, cancellable,
+                [self](const Glib::RefPtr<Gio::SocketConnection>& socket, const std::string& error) {
+                    self->onConnected(socket, error);
+                },
+                [self]() {
+                    self->timing.mark(RequestPhase::Dns);
+                });
+            break;
+
+        case ConnectionPool::Lease::Full:
+            // Try again on the main loop once another request frees a connection
+            waitingForSlot = true;
+            ConnectionPool::getInstance().notifyWhenAvailable(key, [self]() {
+                Glib::signal_idle().connect_once([self]() {
+                    self->acquireConnection();
+                });
+            });
+            break;
+    }
+}
+
+void AsyncRequest::connectUnix() {
+    // For unix:// URLs the host is the socket path
+    auto self = shared_from_this();
+    client->connect_async(Gio::UnixSocketAddress::create(host), cancellable,
+        [self](Glib::RefPtr<Gio::AsyncResult>& asyncResult) {
+            Glib::RefPtr<Gio::SocketConnection> socket;
+            std::string error;
+            try {
+                socket = self->client->connect_finish(asyncResult);
+            } catch (const Glib::Error& e) {
+                error = e.what();
+            }
+            self->onConnected(socket, error);
+        });
+}
+
+void AsyncRequest::onConnected(const Glib::RefPtr<Gio::SocketConnection>& socket, const std::string& error) {
+    if (!socket) {
+        ConnectionPool::getInstance().cancelReservation(key);
+        std::cerr << "Connection failed to " << key << " - " << error << std::endl;
+        connectFailed = true;
+        complete(result.cancelled ? "" : "Connection failed: " + error);
+        return;
+    }
+
+    connection.socket = socket;
+    connection.key = key;
+    timing.mark(RequestPhase::Connect);
+
+    if (scheme != "https") {
+        connection.stream = connection.socket;
+        onConnectionReady();
+        return;
+    }
+
+    // Run the TLS handshake on top of the socket
+    std::vector<std::string> protocols;
+    if (http2Enabled) {
+        protocols = {"h2", "http/1.1"};
+    }
+
+    auto self = shared_from_this();
+    try {
+        TlsContext::getInstance().connectAsync(connection.socket, host, port, protocols, cancellable,
+            [self](const Glib::RefPtr<Gio::IOStream>& stream, const std::string& error) {
+                if (!stream) {
+                    self->complete(self->result.cancelled ? "" : error);
+                    return;
+                }
+                self->connection.stream = stream;
+                self->timing.mark(RequestPhase::Tls);
+
+                // The server picked HTTP/2: the connection becomes a shared
+                // session and leaves the HTTP/1.1 pool
+                if (self->http2Enabled && TlsContext::negotiatedProtocol(stream) == "h2") {
+                    try {
+                        self->http2Session = Http2Session::create(self->key, self->connection.socket, stream);
+                    } catch (const std::exception& e) {
+                        self->complete(e.what());
+                        return;
+                    }
+                    self->connection = ConnectionPool::Connection();
+                    ConnectionPool::getInstance().cancelReservation(self->key);
+                    self->startHttp2();
+                    return;
+                }
+
+                self->onConnectionReady();
+            });
+    } catch (const std::exception& e) {
+        complete(e.what());
+    }
+}
+
+void AsyncRequest::onConnectionReady() {
+    // A warm-up ends here; complete() parks the connection
+    if (result.cancelled || connectOnly) {
+        complete("");
+        return;
+    }
+
+    received = 0;
+    trailingData = false;
+    deadline.awaitResponse();
+    armTimer();
+
+    // Head and body go out in one vectored write, straight from the shared
+    // body; a produced body follows the head piece by piece
+    auto self = shared_from_this();
+    RequestWriter writer = message.producer ? RequestWriter(message.head, message.producer)
+                                            : RequestWriter(message.head, message.body);
+    writer.writeAsync(connection.stream->get_output_stream(), cancellable,
+        [self](const std::string& error) {
+            self->onWritten(error);
+        });
+}
+
+void AsyncRequest::startHttp2() {
+    // The session stays open for the requests that follow a warm-up
+    if (result.cancelled || connectOnly) {
+        complete("");
+        return;
+    }
+
+    deadline.awaitResponse();
+    armTimer();
+
+    // The session only holds the handler while the stream is open
+    auto self = shared_from_this();
+    Http2Session::StreamHandler handler;
+    handler.onHeaders = [self](int status, const HttpResponseParser::HeaderList& headers) {
+        self->timing.mark(RequestPhase::FirstByte);
+        self->deadline.onData();
+        self->armTimer();
+        try {
+            self->parser.setHead(status, headers);
+        } catch (const std::exception& e) {
+            self->complete(e.what());
+        }
+    };
+    handler.onData = [self](const char* data, size_t length) {
+        if (self->finished) {
+            return false;
+        }
+        self->received += length;
+        self->deadline.onData();
+        self->armTimer();
+        try {
+            if (!self->parser.feedBody(data, length) || self->result.cancelled) {
+                self->result.cancelled = true;
+                self->complete("");
+                return false;
+            }
+            if (self->parser.getDecodedBytes() > 0) {
+                self->timing.mark(RequestPhase::FirstToken);
+            }
+        } catch (const std::exception& e) {
+            self->complete(e.what());
+            return false;
+        }
+        return true;
+    };
+    handler.onClose = [self](const std::string& error) {
+        self->http2Stream = 0;
+        if (!error.empty()) {
+            self->complete(self->result.cancelled ? "" : error);
+            return;
+        }
+        if (self->parser.getStatusCode() == 0) {
+            self->complete("Connection closed before a response was received");
+            return;
+        }
+        try {
+            self->parser.endBody();
+        } catch (const std::exception& e) {
+            self->complete(e.what());
+            return;
+        }
+        self->complete("");
+    };
+
+    std::string authority = port == 443 ? host : host + ":" + std::to_string(port);
+    try {
+        http2Stream = http2Session->submit(message.method, authority, message.path,
+                                           message.headers, message.body, message.producer, handler);
+
+        // The frames are queued on the session, which flushes them right away
+        timing.mark(RequestPhase::RequestSent);
+    } catch (const std::exception& e) {
+        complete(e.what());
+    }
+}
+
+void AsyncRequest::onWritten(const std::string& error) {
+    if (!error.empty()) {
+        retryOrFail("Failed to send request: " + error);
+        return;
+    }
+    timing.mark(RequestPhase::RequestSent);
+
+    readMore();
+}
+
+void AsyncRequest::readMore() {
+    // Read straight into the connection's buffer
+    auto [space, size] = connection.readBuffer().prepare();
+
+    auto self = shared_from_this();
+    connection.stream->get_input_stream()->read_async(
+        space, size,
+        [self](Glib::RefPtr<Gio::AsyncResult>& asyncResult) {
+            self->onRead(asyncResult);
+        },
+        cancellable);
+}
+
+void AsyncRequest::onRead(Glib::RefPtr<Gio::AsyncResult>& asyncResult) {
+    gssize count;
+    try {
+        count = connection.stream->get_input_stream()->read_finish(asyncResult);
+    } catch (const Glib::Error& e) {
+        retryOrFail("Error reading response: " + std::string(e.what()));
+        return;
+    }
+
+    try {
+        if (count <= 0) {
+            // A reused connection that closes without answering is retried
+            if (received == 0) {
+                retryOrFail("Connection closed before a response was received");
+                return;
+            }
+            parser.finish();
+            complete("");
+            return;
+        }
+
+        ReadBuffer& buffer = connection.readBuffer();
+        buffer.commit(count);
+        received += count;
+        deadline.onData();
+        timing.mark(RequestPhase::FirstByte);
+
+        // Anything after the end of the response leaves the connection in an unknown state
+        if (parser.feed(buffer) && parser.isComplete()) {
+            trailingData = true;
+        }
+        if (parser.getDecodedBytes() > 0) {
+            timing.mark(RequestPhase::FirstToken);
+        }
+    } catch (const std::exception& e) {
+        complete(e.what());
+        return;
+    }
+
+    // The data callback asked to stop, or cancelled us
+    if (parser.isAborted() || result.cancelled) {
+        result.cancelled = true;
+        complete("");
+        return;
+    }
+
+    if (parser.isComplete()) {
+        complete("");
+        return;
+    }
+
+    armTimer();
+    readMore();
+}
+
+void AsyncRequest::armTimer() {
+    timer.disconnect();
+
+    std::chrono::steady_clock::time_point when;
+    TimeoutPhase phase;
+    if (finished || !deadline.next(when, phase)) {
+        return;
+    }
+
+    auto delay = std::chrono::duration_cast<std::chrono::milliseconds>(when - std::chrono::steady_clock::now()).count();
+    if (delay < 0) {
+        delay = 0;
+    }
+
+    // The timer doesn't keep the request alive
+    std::weak_ptr<AsyncRequest> weak = shared_from_this();
+    timer = Glib::signal_timeout().connect([weak, phase]() {
+        if (auto self = weak.lock()) {
+            self->timer = sigc::connection();
+            self->onTimeout(phase);
+        }
+        return false;
+    }, delay);
+}
+
+void AsyncRequest::onTimeout(TimeoutPhase phase) {
+    if (finished || result.cancelled) {
+        return;
+    }
+
+    timedOut = phase;
+    std::cerr << deadline.error(phase).what() << " (" << host << ":" << port << ")" << std::endl;
+
+    // Nothing is pending while we wait for a pool slot, and an HTTP/2 stream
+    // is reset without a callback, so finish right away
+    if (waitingForSlot || http2Session) {
+        complete("");
+        return;
+    }
+
+    // The pending GIO operation completes with an error and finishes the request
+    cancellable->cancel();
+}
+
+void AsyncRequest::retryOrFail(const std::string& error) {
+    if (result.cancelled || timedOut != TimeoutPhase::None) {
+        complete("");
+        return;
+    }
+
+    // An idle pooled connection may have been closed by the server just as we
+    // picked it up; retry once on a fresh connection
+    if (connection.isReused() && attempt == 0 && received == 0) {
+        attempt++;
+        ConnectionPool::getInstance().release(connection, false);
+        acquireConnection();
+        return;
+    }
+
+    complete(error);
+}
+
+bool AsyncRequest::retryLater(const std::string& error) {
+    // Tokens already shown can't be taken back, and a limit or the caller ended it
+    if (!retryPolicy || connectOnly || result.cancelled || timedOut != TimeoutPhase::None || delivered) {
+        return false;
+    }
+
+    int status = parser.getStatusCode();
+    bool retryable = status == 0 ? connectFailed : error.empty() && RetryPolicy::isRetryableStatus(status);
+    if (!retryable || !retryPolicy->shouldRetry(retries + 1, status, parser.getHeaders(), retryDelay)) {
+        return false;
+    }
+    retries++;
+
+    std::cerr << "Retrying request to " << host << ":" << port << " in " << retryDelay.count() << " ms ("
+              << (status != 0 ? "HTTP " + std::to_string(status) : error) << ")" << std::endl;
+
+    // A complete error response leaves the connection reusable
+    timer.disconnect();
+    bool reusable = parser.isComplete() && parser.keepAlive() && !trailingData;
+    ConnectionPool::getInstance().release(connection, reusable);
+    http2Session.reset();
+    http2Stream = 0;
+
+    parser.reset();
+    result = Result();
+    received = 0;
+    trailingData = false;
+    connectFailed = false;
+    attempt = 0;
+
+    // Each attempt gets the full time limits
+    std::weak_ptr<AsyncRequest> weak = shared_from_this();
+    retryTimer = Glib::signal_timeout().connect([weak]() {
+        if (auto self = weak.lock()) {
+            self->retryTimer = sigc::connection();
+            self->startAttempt();
+        }
+        return false;
+    }, retryDelay.count());
+    return true;
+}
+
+void AsyncRequest::complete(const std::string& error) {
+    if (finished) {
+        return;
+    }
+
+    // The breaker learns from every attempt; a cancelled one doesn't count
+    if (breakerAdmitted) {
+        breakerAdmitted = false;
+        bool failed = !result.cancelled && (!error.empty() || timedOut != TimeoutPhase::None);
+        CircuitBreaker::getInstance().record(endpoint, parser.getStatusCode(), failed, timing);
+    }
+
+    // The limiter learns from every response, including one about to be retried
+    if (!admission.provider.empty() && parser.getStatusCode() > 0) {
+        RateLimiter::getInstance().update(admission.provider, admission.model,
+                                          parser.getStatusCode(), parser.getHeaders());
+    }
+
+    if (retryLater(error)) {
+        return;
+    }
+    finished = true;
+    waitingForAdmission = false;
+    admissionTicket.reset();
+    retryTimer.disconnect();
+    timer.disconnect();
+    if (cancelHandler != 0) {
+        token->getCancellable()->disconnect(cancelHandler);
+        cancelHandler = 0;
+    }
+
+    // Whatever the interrupted operation reported, the limit is the cause
+    std::string message = error;
+    if (timedOut != TimeoutPhase::None) {
+        result.timeout = timedOut;
+        message = deadline.error(timedOut).what();
+    }
+
+    // Only a connection positioned exactly at the end of a response can be reused
+    bool reusable = message.empty() && !result.cancelled &&
+                    (connectOnly || (parser.isComplete() && parser.keepAlive() && !trailingData));
+    ConnectionPool::getInstance().release(connection, reusable);
+
+    // Reset a stream that is still open; the session stays up for other requests
+    if (http2Session) {
+        if (http2Stream != 0) {
+            http2Session->cancel(http2Stream);
+            http2Stream = 0;
+        }
+        http2Session.reset();
+    }
+
+    result.statusCode = parser.getStatusCode();
+    result.error = message;
+
+    // Only requests that got an answer say anything about the server
+    if (parser.isComplete()) {
+        timing.mark(RequestPhase::LastByte);
+    }
+    result.timing = timing;
+    // A prewarmed connection has no response, but its connect phases count
+    bool answered = connectOnly ? message.empty() : result.statusCode > 0;
+    if (!result.cancelled && answered) {
+        RequestMetrics::getInstance().record(metricsLabel.empty() ? host : metricsLabel, timing);
+    }
+    if (result.error.empty() && !result.cancelled && result.statusCode >= 400) {
+        result.error = "HTTP error " + std::to_string(result.statusCode) + ": " + result.body;
+    }
+
+    // Successes earn back retry budget
+    if (retryPolicy && result.ok()) {
+        retryPolicy->onSuccess();
+    }
+
+    // Drop the callbacks, and whatever they captured, once we're done
+    CompletionCallback callback = std::move(onComplete);
+    onComplete = nullptr;
+    onData = nullptr;
+
+    if (callback) {
+        callback(result);
+    }
+}
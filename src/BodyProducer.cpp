@@ -0,0 +1,92 @@
+#include "BodyProducer.h"
+
+JsonBodyProducer::JsonBodyProducer(SimpleJson document, size_t pieceSize)
+    : document(std::move(document)),
+      pieceSize(pieceSize > 0 ? pieceSize : 1) {
+    keys = this->document.getKeys();
+    totalLength = static_cast<long long>(this->document.jsonLength());
+    rewind();
+}
+
+long long JsonBodyProducer::length() const {
+    return totalLength;
+}
+
+void JsonBodyProducer::rewind() {
+    opened = false;
+    keyIndex = 0;
+    inArray = false;
+    itemIndex = 0;
+    finished = false;
+}
+
+bool JsonBodyProducer::produce(std::string& out) {
+    if (finished) {
+        return false;
+    }
+
+    size_t target = out.size() + pieceSize;
+    bool more = true;
+    while (more && out.size() < target) {
+        more = step(out);
+    }
+    return more;
+}
+
+bool JsonBodyProducer::step(std::string& out) {
+    // Anything but an object goes out in one piece
+    if (document.getType() != SimpleJson::Object) {
+        document.appendJson(out);
+        finished = true;
+        return false;
+    }
+
+    if (!opened) {
+        out += '{';
+        opened = true;
+        return true;
+    }
+
+    if (keyIndex == keys.size()) {
+        out += '}';
+        finished = true;
+        return false;
+    }
+
+    const std::string& key = keys[keyIndex];
+    const SimpleJson& value = document[key];
+    if (!inArray) {
+        if (keyIndex > 0) {
+            out += ',';
+        }
+        out += '"';
+        out += key;
+        out += "\":";
+
+        // Open an array and write its items one step at a time
+        if (value.getType() == SimpleJson::Array) {
+            out += '[';
+            inArray = true;
+            itemIndex = 0;
+            return true;
+        }
+
+        value.appendJson(out);
+        keyIndex++;
+        return true;
+    }
+
+    if (itemIndex < value.getArraySize()) {
+        if (itemIndex > 0) {
+            out += ',';
+        }
+        value.getArrayItem(itemIndex).appendJson(out);
+        itemIndex++;
+        return true;
+    }
+
+    out += ']';
+    inArray = false;
+    keyIndex++;
+    return true;
+}
@@ -0,0 +1,17 @@
+#include "CancellationToken.h"
+
+CancellationToken::CancellationToken()
+    : cancelled(false),
+      cancellable(Gio::Cancellable::create()) {
+}
+
+std::shared_ptr<CancellationToken> CancellationToken::create() {
+    return std::shared_ptr<CancellationToken>(new CancellationToken());
+}
+
+void CancellationToken::cancel() {
+    // The flag is set first so whoever wakes up sees why
+    if (!cancelled.exchange(true, std::memory_order_acq_rel)) {
+        cancellable->cancel();
+    }
+}
@@ -1,6 +1,7 @@
 #include "ChatView.h"
 #include "MainWindow.h"
 #include "LLMApi.h"
+#include "CancellationToken.h"
 #include <gtkmm.h>
 #include <iostream>
 #include <fstream>
@@ -67,6 +68,13 @@ ChatView::ChatView()
 }
 
 ChatView::~ChatView() {
+    // Replies already handed to the main loop find the view gone
+    *alive = false;
+
+    // The reply callback points at this view, so stop the request
+    if (pendingRequest) {
+        pendingRequest->cancel();
+    }
 }
 
 void ChatView::setApi(std::shared_ptr<LLMApi> api, const std::string& model) {
@@ -199,8 +207,8 @@ void ChatView::onSendClicked() {
     
     // Start progress bar animation
     Glib::signal_timeout().connect(
-        [this]() {
-            if (progressBar.get_visible()) {
+        [this, alive = alive]() {
+            if (*alive && progressBar.get_visible()) {
                 progressBar.pulse();
                 return true;
             }
@@ -209,15 +217,27 @@ void ChatView::onSendClicked() {
         100
     );
     
-    // Send request to API
-    currentApi->sendChatRequest(
+    // Send request to API; other views may have their own requests to the
+    // same API running, so only this one is tracked here
+    pendingRequest = currentApi->sendChatRequest(
         messages,
         currentModel,
-        [this](const std::string& response, bool isComplete) {
-            // Use Glib::signal_idle to update UI from main thread
+        [this, alive = alive](std::string_view response, bool isComplete) {
+            // Replies arrive on the main loop, so the text is shown straight
+            // from the provider's buffer
+            if (g_main_context_is_owner(g_main_context_default())) {
+                handleApiResponse(response, isComplete);
+                return;
+            }
+            
+            // From any other thread the provider's buffer is gone once we
+            // return, so the text is copied and handed to the main loop. The
+            // view may be closed before that runs.
             Glib::signal_idle().connect_once(
-                [this, response, isComplete]() {
-                    handleApiResponse(response, isComplete);
+                [this, alive, text = std::string(response), isComplete]() {
+                    if (*alive) {
+                        handleApiResponse(text, isComplete);
+                    }
                 }
             );
         }
@@ -302,7 +322,7 @@ void ChatView::appendSystemMessage(const std::string& content) {
     appendMessage("system", content);
 }
 
-void ChatView::handleApiResponse(const std::string& response, bool isComplete) {
+void ChatView::handleApiResponse(std::string_view response, bool isComplete) {
     // Hide progress bar when complete
     if (isComplete) {
         updateProgressBar(false);
@@ -339,7 +359,7 @@ void ChatView::handleApiResponse(const std::string& response, bool isComplete) {
         Glib::RefPtr<Gtk::TextBuffer::Mark> contentStartMark = chatBuffer->create_mark("content_start", iter, true);
         
         // Add the first chunk of content
-        chatBuffer->insert(iter, response);
+        chatBuffer->insert(iter, response.data(), response.data() + response.size());
         
         // Create a mark for the end of the content
         responseEndMark = chatBuffer->create_mark("response_end", chatBuffer->end(), false);
@@ -356,7 +376,7 @@ void ChatView::handleApiResponse(const std::string& response, bool isComplete) {
         Gtk::TextBuffer::iterator endIter = chatBuffer->get_iter_at_mark(responseEndMark);
         
         // Add the new content
-        chatBuffer->insert(endIter, response);
+        chatBuffer->insert(endIter, response.data(), response.data() + response.size());
         
         // Update the end mark
         chatBuffer->move_mark(responseEndMark, chatBuffer->end());
@@ -368,14 +388,14 @@ void ChatView::handleApiResponse(const std::string& response, bool isComplete) {
         // This is the final chunk
         if (isFirstResponseChunk) {
             // If this is both the first and last chunk, just append it normally
-            appendAssistantMessage(response);
+            appendAssistantMessage(std::string(response));
             currentResponseText = response;
         } 
         else {
             // Add the final chunk if there is any
             if (!response.empty()) {
                 Gtk::TextBuffer::iterator endIter = chatBuffer->get_iter_at_mark(responseEndMark);
-                chatBuffer->insert(endIter, response);
+                chatBuffer->insert(endIter, response.data(), response.data() + response.size());
                 currentResponseText += response;
             }
             
@@ -0,0 +1,104 @@
+#include "ChunkedDecoder.h"
+#include <cstring>
+#include <stdexcept>
+
+ChunkedDecoder::ChunkedDecoder(const Sink& sink) : sink(sink) {
+    reset();
+}
+
+void ChunkedDecoder::reset() {
+    state = State::Size;
+    stopped = false;
+    chunkSize = 0;
+    remaining = 0;
+    sizeDigits = 0;
+}
+
+void ChunkedDecoder::onSizeLine() {
+    sizeDigits = 0;
+    remaining = chunkSize;
+    state = chunkSize > 0 ? State::Data : State::Done;
+}
+
+size_t ChunkedDecoder::decode(const char* data, size_t length) {
+    size_t pos = 0;
+    stopped = false;
+
+    while (pos < length && state != State::Done) {
+        switch (state) {
+            case State::Size: {
+                char c = data[pos++];
+                int digit = -1;
+                if (c >= '0' && c <= '9') digit = c - '0';
+                else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+                else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+
+                if (digit >= 0) {
+                    if (sizeDigits == 0) {
+                        chunkSize = 0;
+                    }
+                    if (++sizeDigits > 15) {
+                        throw std::runtime_error("Malformed HTTP response: chunk size too large");
+                    }
+                    chunkSize = chunkSize * 16 + digit;
+                } else if (sizeDigits == 0) {
+                    throw std::runtime_error("Malformed HTTP response: bad chunk size");
+                } else if (c == '\n') {
+                    onSizeLine();
+                } else {
+                    // CR, whitespace or a ';' chunk extension: skip to the end of the line
+                    state = State::Extension;
+                }
+                break;
+            }
+
+            case State::Extension: {
+                const char* newline = static_cast<const char*>(std::memchr(data + pos, '\n', length - pos));
+                if (!newline) {
+                    pos = length;
+                    break;
+                }
+                pos = newline - data + 1;
+                onSizeLine();
+                break;
+            }
+
+            case State::Data: {
+                size_t available = length - pos;
+                if (available > remaining) {
+                    available = static_cast<size_t>(remaining);
+                }
+
+                const char* start = data + pos;
+                pos += available;
+                remaining -= available;
+                if (remaining == 0) {
+                    state = State::DataEnd;
+                }
+
+                // Hand over what we have now rather than waiting for the whole chunk
+                if (!sink(start, available)) {
+                    stopped = true;
+                    return pos;
+                }
+                break;
+            }
+
+            case State::DataEnd: {
+                // CRLF after the chunk payload
+                char c = data[pos++];
+                if (c == '\n') {
+                    state = State::Size;
+                } else if (c != '\r') {
+                    throw std::runtime_error("Malformed HTTP response: missing CRLF after chunk");
+                }
+                break;
+            }
+
+            case State::Done:
+                break;
+        }
+    }
+
+    return pos;
+}
@@ -0,0 +1,206 @@
+#include "CircuitBreaker.h"
+#include "HttpClient.h"
+#include <algorithm>
+#include <iostream>
+
+CircuitBreaker::CircuitBreaker() {
+}
+
+CircuitBreaker::~CircuitBreaker() {
+}
+
+CircuitBreaker& CircuitBreaker::getInstance() {
+    static CircuitBreaker instance;
+    return instance;
+}
+
+std::string CircuitBreaker::endpointUrl(const std::string& scheme, const std::string& host, int port) {
+    // The host of a unix socket is its path
+    if (scheme == "unix") {
+        return "unix://" + host + "/";
+    }
+    return scheme + "://" + host + ":" + std::to_string(port) + "/";
+}
+
+std::string CircuitBreaker::unavailableError(const std::string& endpoint) {
+    return "Endpoint " + endpoint + " is unavailable; waiting for it to recover";
+}
+
+void CircuitBreaker::setSettings(const Settings& settings) {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->settings = settings;
+}
+
+bool CircuitBreaker::allowRequest(const std::string& endpoint) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = endpoints.find(endpoint);
+    if (it == endpoints.end()) {
+        return true;
+    }
+
+    Endpoint& entry = it->second;
+    switch (entry.state) {
+        case State::Closed:
+            return true;
+        case State::Open:
+            if (std::chrono::steady_clock::now() < entry.openUntil) {
+                return false;
+            }
+            // Let one request find out whether the endpoint is back
+            entry.state = State::HalfOpen;
+            entry.trialSent = true;
+            std::cerr << "Circuit for " << endpoint << " half-open, sending a trial request" << std::endl;
+            return true;
+        case State::HalfOpen:
+            if (entry.trialSent) {
+                return false;
+            }
+            entry.trialSent = true;
+            return true;
+    }
+    return true;
+}
+
+void CircuitBreaker::record(const std::string& endpoint, int statusCode, bool failed, const RequestTiming& timing) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Endpoint& entry = endpoints[endpoint];
+
+    // A cancelled request says nothing; let another trial through
+    if (statusCode == 0 && !failed) {
+        if (entry.state == State::HalfOpen) {
+            entry.trialSent = false;
+        }
+        return;
+    }
+
+    bool slow = timing.reached(RequestPhase::FirstByte) && timing.at(RequestPhase::FirstByte) > settings.slowCall;
+    bool bad = statusCode == 0 || statusCode >= 500 || slow;
+
+    switch (entry.state) {
+        case State::HalfOpen:
+            if (bad) {
+                open(endpoint, entry);
+            } else {
+                close(endpoint, entry);
+            }
+            return;
+        case State::Open:
+            // Requests sent before it opened are still coming back
+            return;
+        case State::Closed:
+            break;
+    }
+
+    entry.outcomes.push_back(bad);
+    while (entry.outcomes.size() > settings.windowSize) {
+        entry.outcomes.pop_front();
+    }
+    entry.failuresInRow = bad ? entry.failuresInRow + 1 : 0;
+
+    size_t failures = static_cast<size_t>(std::count(entry.outcomes.begin(), entry.outcomes.end(), true));
+    bool tooMany = entry.outcomes.size() >= settings.minimumRequests &&
+                   failures >= settings.failureRate * static_cast<double>(entry.outcomes.size());
+    if (entry.failuresInRow >= settings.consecutiveFailures || tooMany) {
+        open(endpoint, entry);
+    }
+}
+
+CircuitBreaker::State CircuitBreaker::getState(const std::string& endpoint) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = endpoints.find(endpoint);
+    return it != endpoints.end() ? it->second.state : State::Closed;
+}
+
+void CircuitBreaker::open(const std::string& name, Endpoint& endpoint) {
+    // Each failed trial keeps the circuit open twice as long
+    auto openTime = settings.openTime;
+    for (int i = 0; i < endpoint.trips && openTime < settings.maxOpenTime; i++) {
+        openTime *= 2;
+    }
+    openTime = std::min(openTime, settings.maxOpenTime);
+
+    endpoint.state = State::Open;
+    endpoint.trips++;
+    endpoint.openUntil = std::chrono::steady_clock::now() + openTime;
+    endpoint.outcomes.clear();
+    endpoint.failuresInRow = 0;
+    endpoint.trialSent = false;
+    std::cerr << "Circuit for " << name << " open for " << openTime.count() << " ms" << std::endl;
+
+    if (!endpoint.probing) {
+        endpoint.probing = true;
+        scheduleProbe(name);
+    }
+}
+
+void CircuitBreaker::close(const std::string& name, Endpoint& endpoint) {
+    endpoint.state = State::Closed;
+    endpoint.trips = 0;
+    endpoint.outcomes.clear();
+    endpoint.failuresInRow = 0;
+    endpoint.trialSent = false;
+    std::cerr << "Circuit for " << name << " closed" << std::endl;
+}
+
+void CircuitBreaker::scheduleProbe(const std::string& name) {
+    // Runs on the main loop, whichever thread opened the circuit
+    Glib::signal_timeout().connect_once([name]() {
+        CircuitBreaker::getInstance().probe(name);
+    }, static_cast<unsigned int>(settings.probeInterval.count()));
+}
+
+void CircuitBreaker::probe(const std::string& name) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = endpoints.find(name);
+        if (it == endpoints.end() || it->second.state == State::Closed) {
+            if (it != endpoints.end()) {
+                it->second.probing = false;
+            }
+            return;
+        }
+    }
+
+    // Probes go around the circuit and get one short attempt
+    if (!probeClient) {
+        probeClient = std::make_unique<HttpClient>();
+        probeClient->setCircuitBreakerEnabled(false);
+        probeClient->disableRetries();
+
+        RequestTimeouts timeouts;
+        timeouts.connect = std::chrono::seconds(5);
+        timeouts.total = std::chrono::seconds(10);
+        probeClient->setTimeouts(timeouts);
+    }
+
+    try {
+        probeClient->sendAsync("HEAD", name, "", nullptr, [name](const AsyncRequest::Result& result) {
+            // Any answer short of a server error means the endpoint is up
+            CircuitBreaker::getInstance().onProbeResult(name, result.statusCode > 0 && result.statusCode < 500);
+        });
+    } catch (const std::exception& e) {
+        std::cerr << "Error probing " << name << ": " << e.what() << std::endl;
+        onProbeResult(name, false);
+    }
+}
+
+void CircuitBreaker::onProbeResult(const std::string& name, bool alive) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = endpoints.find(name);
+    if (it == endpoints.end()) {
+        return;
+    }
+
+    Endpoint& endpoint = it->second;
+    if (endpoint.state == State::Closed) {
+        endpoint.probing = false;
+        return;
+    }
+
+    if (alive) {
+        endpoint.probing = false;
+        close(name, endpoint);
+        return;
+    }
+    scheduleProbe(name);
+}
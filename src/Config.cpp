@@ -7,7 +7,7 @@
 
 namespace fs = std::filesystem;
 
-Config::Config() {
+Config::Config() : prewarm(true), prewarmModels(false), maxConnectionsPerHost(6) {
     // Initialize default endpoints
     initDefaultEndpoints();
     
@@ -53,6 +53,45 @@ void Config::setLastUsedModel(const std::string& api, const std::string& model)
     lastUsedModel = model;
 }
 
+bool Config::getPrewarm() const {
+    return prewarm;
+}
+
+void Config::setPrewarm(bool prewarm) {
+    this->prewarm = prewarm;
+}
+
+bool Config::getPrewarmModels() const {
+    return prewarmModels;
+}
+
+void Config::setPrewarmModels(bool prewarmModels) {
+    this->prewarmModels = prewarmModels;
+}
+
+int Config::getMaxConnectionsPerHost() const {
+    return maxConnectionsPerHost;
+}
+
+void Config::setMaxConnectionsPerHost(int maxConnections) {
+    maxConnectionsPerHost = maxConnections > 0 ? maxConnections : 1;
+}
+
+Config::RateLimit Config::getRateLimit(const std::string& apiName, const std::string& model) const {
+    auto it = rateLimits.find(apiName + "/" + model);
+    if (it == rateLimits.end()) {
+        it = rateLimits.find(apiName);
+    }
+    if (it != rateLimits.end()) {
+        return it->second;
+    }
+    return RateLimit();
+}
+
+void Config::setRateLimit(const std::string& apiName, const std::string& model, const RateLimit& limit) {
+    rateLimits[model.empty() ? apiName : apiName + "/" + model] = limit;
+}
+
 std::string Config::getConfigPath() const {
     // Get home directory
     std::string homePath;
@@ -94,6 +133,25 @@ void Config::save() {
     root.addToObject("lastUsedApi", SimpleJson(lastUsedApi));
     root.addToObject("lastUsedModel", SimpleJson(lastUsedModel));
     
+    // Add startup connection settings
+    root.addToObject("prewarm", SimpleJson(prewarm));
+    root.addToObject("prewarmModels", SimpleJson(prewarmModels));
+    
+    // Add connection limit
+    root.addToObject("maxConnectionsPerHost", SimpleJson(static_cast<double>(maxConnectionsPerHost)));
+    
+    // Add rate limits
+    if (!rateLimits.empty()) {
+        SimpleJson rateLimitsJson;
+        for (const auto& [name, limit] : rateLimits) {
+            SimpleJson limitJson;
+            limitJson.addToObject("requestsPerMinute", SimpleJson(limit.requestsPerMinute));
+            limitJson.addToObject("tokensPerMinute", SimpleJson(limit.tokensPerMinute));
+            rateLimitsJson.addToObject(name, limitJson);
+        }
+        root.addToObject("rateLimits", rateLimitsJson);
+    }
+    
     // Get config file path
     std::string configPath = getConfigPath();
     
@@ -150,8 +208,12 @@ SimpleJson parseJson(std::istream& input) {
             if (pos < i) {
                 keyValuePair = content.substr(pos, i - pos);
                 
-                // Find the colon separator
+                // Find the colon separator; quoted keys such as model names may contain colons
                 size_t colonPos = keyValuePair.find(':');
+                if (!keyValuePair.empty() && keyValuePair.front() == '"') {
+                    size_t keyEnd = keyValuePair.find('"', 1);
+                    colonPos = keyEnd == std::string::npos ? std::string::npos : keyValuePair.find(':', keyEnd);
+                }
                 if (colonPos != std::string::npos) {
                     std::string key = keyValuePair.substr(0, colonPos);
                     std::string value = keyValuePair.substr(colonPos + 1);
@@ -260,6 +322,36 @@ void Config::load() {
     if (root.hasKey("lastUsedModel")) {
         lastUsedModel = root["lastUsedModel"].asString();
     }
+    
+    // Load startup connection settings
+    if (root.hasKey("prewarm")) {
+        prewarm = root["prewarm"].asBool();
+    }
+    
+    if (root.hasKey("prewarmModels")) {
+        prewarmModels = root["prewarmModels"].asBool();
+    }
+    
+    // Load connection limit
+    if (root.hasKey("maxConnectionsPerHost")) {
+        setMaxConnectionsPerHost(static_cast<int>(root["maxConnectionsPerHost"].asNumber()));
+    }
+    
+    // Load rate limits
+    if (root.hasKey("rateLimits")) {
+        const SimpleJson& rateLimitsJson = root["rateLimits"];
+        for (const auto& name : rateLimitsJson.getKeys()) {
+            const SimpleJson& limitJson = rateLimitsJson[name];
+            RateLimit limit;
+            if (limitJson.hasKey("requestsPerMinute")) {
+                limit.requestsPerMinute = limitJson["requestsPerMinute"].asNumber();
+            }
+            if (limitJson.hasKey("tokensPerMinute")) {
+                limit.tokensPerMinute = limitJson["tokensPerMinute"].asNumber();
+            }
+            rateLimits[name] = limit;
+        }
+    }
 }
 
 void Config::initDefaultEndpoints() {
@@ -0,0 +1,297 @@
+#include "ConnectionPool.h"
+
+ConnectionPool::ConnectionPool()
+    : idleTimeout(30),
+      maxConnectionsPerHost(6) {
+}
+
+ConnectionPool& ConnectionPool::getInstance() {
+    static ConnectionPool instance;
+    return instance;
+}
+
+std::string ConnectionPool::makeKey(const std::string& scheme, const std::string& host, int port) {
+    return scheme + "://" + host + ":" + std::to_string(port);
+}
+
+ConnectionPool::Connection ConnectionPool::acquire(const std::string& key, const Connector& connect) {
+    std::vector<Connection> stale;
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        Host& host = hosts[key];
+
+        while (true) {
+            // Prefer the most recently parked connection
+            auto now = std::chrono::steady_clock::now();
+            while (!host.idle.empty()) {
+                Connection connection = std::move(host.idle.back());
+                host.idle.pop_back();
+
+                if (isUsable(connection, now)) {
+                    lock.unlock();
+                    for (auto& old : stale) {
+                        closeQuietly(old);
+                    }
+                    return connection;
+                }
+
+                stale.push_back(std::move(connection));
+                host.open--;
+            }
+
+            // Reserve a slot for a new connection if the host is below its cap
+            if (host.open < maxConnectionsPerHost) {
+                host.open++;
+                break;
+            }
+
+            // Wait for another request to finish with its connection
+            slotAvailable.wait(lock);
+        }
+    }
+
+    for (auto& old : stale) {
+        closeQuietly(old);
+    }
+
+    // Open the new connection outside the lock
+    Connection connection;
+
+    try {
+        connection = connect();
+        connection.key = key;
+        connection.useCount = 0;
+    } catch (...) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            hosts[key].open--;
+        }
+        wakeWaiters(key);
+        throw;
+    }
+
+    return connection;
+}
+
+ConnectionPool::Lease ConnectionPool::tryAcquire(const std::string& key, Connection& connection) {
+    std::vector<Connection> stale;
+    Lease lease = Lease::Full;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Host& host = hosts[key];
+        auto now = std::chrono::steady_clock::now();
+
+        // Prefer the most recently parked connection
+        while (!host.idle.empty()) {
+            Connection candidate = std::move(host.idle.back());
+            host.idle.pop_back();
+
+            if (isUsable(candidate, now)) {
+                connection = std::move(candidate);
+                lease = Lease::Idle;
+                break;
+            }
+
+            stale.push_back(std::move(candidate));
+            host.open--;
+        }
+
+        if (lease != Lease::Idle && host.open < maxConnectionsPerHost) {
+            host.open++;
+            lease = Lease::Reserved;
+        }
+    }
+
+    for (auto& old : stale) {
+        closeQuietly(old);
+    }
+
+    return lease;
+}
+
+void ConnectionPool::cancelReservation(const std::string& key) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        hosts[key].open--;
+    }
+    wakeWaiters(key);
+}
+
+void ConnectionPool::notifyWhenAvailable(const std::string& key, const std::function<void()>& callback) {
+    bool available;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Host& host = hosts[key];
+        available = !host.idle.empty() || host.open < maxConnectionsPerHost;
+        if (!available) {
+            host.waiters.push_back(callback);
+        }
+    }
+
+    // A slot was freed between tryAcquire and now
+    if (available) {
+        callback();
+    }
+}
+
+void ConnectionPool::wakeWaiters(const std::string& key) {
+    std::vector<std::function<void()>> waiters;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        waiters.swap(hosts[key].waiters);
+    }
+
+    slotAvailable.notify_all();
+
+    // Waiters that lose the race register again
+    for (auto& waiter : waiters) {
+        waiter();
+    }
+}
+
+void ConnectionPool::release(Connection& connection, bool reusable) {
+    if (!connection) {
+        return;
+    }
+
+    std::vector<Connection> stale;
+    std::string key = connection.key;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Host& host = hosts[key];
+        auto now = std::chrono::steady_clock::now();
+
+        // Drop idle connections that have timed out, oldest first
+        while (!host.idle.empty() && now - host.idle.front().idleSince >= idleTimeout) {
+            stale.push_back(std::move(host.idle.front()));
+            host.idle.pop_front();
+            host.open--;
+        }
+
+        if (reusable && !connection.stream->is_closed()) {
+            connection.useCount++;
+            connection.idleSince = now;
+            host.idle.push_back(std::move(connection));
+        } else {
+            stale.push_back(std::move(connection));
+            host.open--;
+        }
+    }
+
+    connection = Connection();
+
+    for (auto& old : stale) {
+        closeQuietly(old);
+    }
+
+    wakeWaiters(key);
+}
+
+void ConnectionPool::clear() {
+    std::vector<Connection> stale;
+    std::vector<std::string> keys;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& [key, host] : hosts) {
+            while (!host.idle.empty()) {
+                stale.push_back(std::move(host.idle.front()));
+                host.idle.pop_front();
+                host.open--;
+            }
+            keys.push_back(key);
+        }
+    }
+
+    for (auto& old : stale) {
+        closeQuietly(old);
+    }
+
+    for (const auto& key : keys) {
+        wakeWaiters(key);
+    }
+}
+
+void ConnectionPool::setIdleTimeout(std::chrono::seconds timeout) {
+    std::lock_guard<std::mutex> lock(mutex);
+    idleTimeout = timeout;
+}
+
+std::chrono::seconds ConnectionPool::getIdleTimeout() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return idleTimeout;
+}
+
+size_t ConnectionPool::getMaxConnectionsPerHost() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return maxConnectionsPerHost;
+}
+
+void ConnectionPool::setMaxConnectionsPerHost(size_t maxConnections) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        maxConnectionsPerHost = maxConnections > 0 ? maxConnections : 1;
+    }
+
+    std::vector<std::string> keys;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& [key, host] : hosts) {
+            keys.push_back(key);
+        }
+    }
+    for (const auto& key : keys) {
+        wakeWaiters(key);
+    }
+}
+
+size_t ConnectionPool::idleCount(const std::string& key) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = hosts.find(key);
+    return it != hosts.end() ? it->second.idle.size() : 0;
+}
+
+bool ConnectionPool::isUsable(const Connection& connection, std::chrono::steady_clock::time_point now) const {
+    if (!connection.socket || connection.stream->is_closed()) {
+        return false;
+    }
+
+    // Expired while parked
+    if (now - connection.idleSince >= idleTimeout) {
+        return false;
+    }
+
+    // An idle HTTP connection must have nothing to read; readable means the
+    // server closed it (or sent something we can't match to a request)
+    Glib::RefPtr<Gio::Socket> socket = connection.socket->get_socket();
+    if (!socket || !socket->is_connected()) {
+        return false;
+    }
+
+    return socket->condition_check(Glib::IO_IN | Glib::IO_HUP | Glib::IO_ERR) == Glib::IOCondition(0);
+}
+
+void ConnectionPool::closeQuietly(Connection& connection) {
+    // Closing a TLS stream also closes the socket under it
+    Glib::RefPtr<Gio::IOStream> stream = connection.stream;
+    if (!stream) {
+        stream = connection.socket;
+    }
+    if (stream) {
+        try {
+            stream->close();
+        } catch (...) {
+            // Ignore errors during cleanup
+        }
+    }
+    connection.stream.reset();
+    connection.socket.reset();
+
+    // Hand the read buffer on to the next connection
+    connection.buffer.reset();
+}
@@ -0,0 +1,264 @@
+#include "ContentDecoder.h"
+#include <atomic>
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+#include <stdexcept>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+
+std::atomic<unsigned long long> totalResponses(0);
+std::atomic<unsigned long long> totalBytesIn(0);
+std::atomic<unsigned long long> totalBytesOut(0);
+
+// Lower-case a coding name and strip surrounding whitespace
+std::string normalize(const std::string& value) {
+    size_t first = value.find_first_not_of(" \t");
+    if (first == std::string::npos) {
+        return "";
+    }
+    size_t last = value.find_last_not_of(" \t");
+
+    std::string result = value.substr(first, last - first + 1);
+    for (auto& c : result) {
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    return result;
+}
+
+}
+
+struct ContentDecoder::Stream {
+    z_stream zlib{};
+    bool zlibReady = false;
+
+    // Deflate bodies are meant to be zlib-wrapped, but some servers send raw
+    // deflate; the first two bytes tell them apart
+    std::string head;
+
+#ifdef HAVE_ZSTD
+    ZSTD_DStream* zstd = nullptr;
+#endif
+
+    ~Stream() {
+        if (zlibReady) {
+            inflateEnd(&zlib);
+        }
+#ifdef HAVE_ZSTD
+        if (zstd) {
+            ZSTD_freeDStream(zstd);
+        }
+#endif
+    }
+
+    void initZlib(int windowBits) {
+        if (zlibReady) {
+            inflateEnd(&zlib);
+            zlibReady = false;
+        }
+        zlib = z_stream();
+        if (inflateInit2(&zlib, windowBits) != Z_OK) {
+            throw std::runtime_error("Failed to initialize zlib");
+        }
+        zlibReady = true;
+    }
+};
+
+ContentDecoder::ContentDecoder(const Sink& sink)
+    : sink(sink),
+      coding(Coding::Identity),
+      ended(false),
+      bytesIn(0),
+      bytesOut(0) {
+}
+
+ContentDecoder::~ContentDecoder() {
+}
+
+const char* ContentDecoder::acceptEncoding() {
+#ifdef HAVE_ZSTD
+    return "zstd, gzip, deflate";
+#else
+    return "gzip, deflate";
+#endif
+}
+
+bool ContentDecoder::start(const std::string& contentEncoding) {
+    reset();
+
+    std::string name = normalize(contentEncoding);
+    if (name.empty() || name == "identity") {
+        return true;
+    }
+
+    if (name == "gzip" || name == "x-gzip") {
+        coding = Coding::Gzip;
+    } else if (name == "deflate") {
+        coding = Coding::Deflate;
+#ifdef HAVE_ZSTD
+    } else if (name == "zstd") {
+        coding = Coding::Zstd;
+#endif
+    } else {
+        // Includes stacked codings such as "deflate, gzip", which we never ask for
+        std::cerr << "Unsupported Content-Encoding: " << contentEncoding << std::endl;
+        return false;
+    }
+
+    stream.reset(new Stream());
+    if (coding == Coding::Zstd) {
+#ifdef HAVE_ZSTD
+        stream->zstd = ZSTD_createDStream();
+        if (!stream->zstd) {
+            throw std::runtime_error("Failed to initialize zstd");
+        }
+        ZSTD_initDStream(stream->zstd);
+#endif
+    } else if (coding == Coding::Gzip) {
+        // 15 + 16 expects a gzip header
+        stream->initZlib(15 + 16);
+    }
+
+    if (output.empty()) {
+        output.resize(16384);
+    }
+
+    totalResponses++;
+    return true;
+}
+
+void ContentDecoder::reset() {
+    coding = Coding::Identity;
+    stream.reset();
+    ended = false;
+    bytesIn = 0;
+    bytesOut = 0;
+}
+
+bool ContentDecoder::decode(const char* data, size_t length) {
+    if (coding == Coding::Identity) {
+        return sink(data, length);
+    }
+
+    bytesIn += length;
+    totalBytesIn += length;
+
+    if (coding == Coding::Zstd) {
+        return decodeZstd(data, length);
+    }
+
+    if (coding == Coding::Deflate && !stream->zlibReady) {
+        size_t take = std::min(length, 2 - stream->head.size());
+        stream->head.append(data, take);
+        data += take;
+        length -= take;
+        if (stream->head.size() < 2) {
+            return true;
+        }
+
+        unsigned char cmf = static_cast<unsigned char>(stream->head[0]);
+        unsigned char flg = static_cast<unsigned char>(stream->head[1]);
+        bool wrapped = (cmf & 0x0f) == 8 && ((cmf << 8) | flg) % 31 == 0;
+        stream->initZlib(wrapped ? 15 : -15);
+
+        if (!decodeZlib(stream->head.data(), stream->head.size())) {
+            return false;
+        }
+    }
+
+    return decodeZlib(data, length);
+}
+
+bool ContentDecoder::decodeZlib(const char* data, size_t length) {
+    z_stream& z = stream->zlib;
+    z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    z.avail_in = static_cast<uInt>(length);
+
+    bool outputPending = false;
+    while (z.avail_in > 0 || outputPending) {
+        if (ended) {
+            // A gzip body may hold several members back to back
+            if (coding != Coding::Gzip) {
+                break;
+            }
+            inflateReset(&z);
+            ended = false;
+        }
+
+        z.next_out = reinterpret_cast<Bytef*>(output.data());
+        z.avail_out = static_cast<uInt>(output.size());
+
+        int result = inflate(&z, Z_NO_FLUSH);
+        if (result == Z_STREAM_END) {
+            ended = true;
+        } else if (result == Z_BUF_ERROR) {
+            // No progress possible until more input arrives
+            break;
+        } else if (result != Z_OK) {
+            std::string message = z.msg ? z.msg : "inflate failed";
+            throw std::runtime_error("Malformed HTTP response: bad compressed body (" + message + ")");
+        }
+
+        size_t produced = output.size() - z.avail_out;
+        outputPending = z.avail_out == 0;
+        if (produced > 0 && !emit(produced)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool ContentDecoder::decodeZstd(const char* data, size_t length) {
+#ifdef HAVE_ZSTD
+    ZSTD_inBuffer in = {data, length, 0};
+
+    bool outputPending = false;
+    while (in.pos < in.size || outputPending) {
+        ZSTD_outBuffer out = {output.data(), output.size(), 0};
+
+        size_t result = ZSTD_decompressStream(stream->zstd, &out, &in);
+        if (ZSTD_isError(result)) {
+            throw std::runtime_error("Malformed HTTP response: bad compressed body (" +
+                                     std::string(ZSTD_getErrorName(result)) + ")");
+        }
+
+        // Zero means a frame is complete; another may follow
+        ended = result == 0;
+        outputPending = out.pos == out.size;
+        if (out.pos > 0 && !emit(out.pos)) {
+            return false;
+        }
+    }
+
+    return true;
+#else
+    (void)data;
+    (void)length;
+    return true;
+#endif
+}
+
+bool ContentDecoder::emit(size_t length) {
+    bytesOut += length;
+    totalBytesOut += length;
+    return sink(output.data(), length);
+}
+
+void ContentDecoder::finish() {
+    if (coding != Coding::Identity && bytesIn > 0 && !ended) {
+        throw std::runtime_error("Malformed HTTP response: compressed body is truncated");
+    }
+}
+
+ContentDecoder::Totals ContentDecoder::getTotals() {
+    Totals totals;
+    totals.responses = totalResponses;
+    totals.bytesIn = totalBytesIn;
+    totals.bytesOut = totalBytesOut;
+    return totals;
+}
@@ -0,0 +1,191 @@
+#include "DnsCache.h"
+#include <iostream>
+#include <stdexcept>
+
+std::chrono::microseconds DnsCache::AddressStats::averageConnectTime() const {
+    if (successes == 0) {
+        return std::chrono::microseconds(0);
+    }
+    return totalConnectTime / successes;
+}
+
+DnsCache::DnsCache() : ttl(60) {
+}
+
+DnsCache& DnsCache::getInstance() {
+    static DnsCache instance;
+    return instance;
+}
+
+DnsCache::AddressList DnsCache::resolve(const std::string& host, const Glib::RefPtr<Gio::Cancellable>& cancellable) {
+    // Literal addresses don't need a lookup
+    if (g_hostname_is_ip_address(host.c_str())) {
+        return AddressList{Gio::InetAddress::create(host)};
+    }
+
+    AddressList addresses;
+    if (lookupCached(host, addresses)) {
+        return addresses;
+    }
+
+    try {
+        auto resolver = Gio::Resolver::get_default();
+        auto resolved = cancellable ? resolver->lookup_by_name(host, cancellable) : resolver->lookup_by_name(host);
+        addresses = store(host, std::vector<Glib::RefPtr<Gio::InetAddress>>(resolved.begin(), resolved.end()));
+    } catch (const Gio::Error& e) {
+        // A cancelled lookup says nothing about the name; callers see the cancellation
+        if (e.code() == Gio::Error::CANCELLED) {
+            throw;
+        }
+        recordFailure();
+        std::cerr << "Failed to resolve " << host << " - " << e.what() << std::endl;
+        throw std::runtime_error("Failed to resolve " + host + ": " + std::string(e.what()));
+    } catch (const Glib::Error& e) {
+        recordFailure();
+        std::cerr << "Failed to resolve " << host << " - " << e.what() << std::endl;
+        throw std::runtime_error("Failed to resolve " + host + ": " + std::string(e.what()));
+    }
+
+    if (addresses.empty()) {
+        recordFailure();
+        throw std::runtime_error("No addresses found for " + host);
+    }
+
+    return addresses;
+}
+
+void DnsCache::resolveAsync(const std::string& host,
+                            const Glib::RefPtr<Gio::Cancellable>& cancellable,
+                            const ResolveCallback& callback) {
+    if (g_hostname_is_ip_address(host.c_str())) {
+        callback(AddressList{Gio::InetAddress::create(host)}, "");
+        return;
+    }
+
+    AddressList addresses;
+    if (lookupCached(host, addresses)) {
+        callback(addresses, "");
+        return;
+    }
+
+    auto resolver = Gio::Resolver::get_default();
+    resolver->lookup_by_name_async(host,
+        [this, resolver, host, cancellable, callback](Glib::RefPtr<Gio::AsyncResult>& result) {
+            AddressList addresses;
+            try {
+                auto resolved = resolver->lookup_by_name_finish(result);
+                addresses = store(host, std::vector<Glib::RefPtr<Gio::InetAddress>>(resolved.begin(), resolved.end()));
+            } catch (const Glib::Error& e) {
+                // A cancelled lookup says nothing about the name
+                if (!cancellable || !cancellable->is_cancelled()) {
+                    recordFailure();
+                }
+                std::cerr << "Failed to resolve " << host << " - " << e.what() << std::endl;
+                callback(AddressList(), "Failed to resolve " + host + ": " + std::string(e.what()));
+                return;
+            }
+
+            if (addresses.empty()) {
+                recordFailure();
+                callback(addresses, "No addresses found for " + host);
+                return;
+            }
+            callback(addresses, "");
+        },
+        cancellable);
+}
+
+bool DnsCache::lookupCached(const std::string& host, AddressList& addresses) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = entries.find(host);
+    if (it != entries.end() && it->second.expires > std::chrono::steady_clock::now()) {
+        stats.hits++;
+        addresses = it->second.addresses;
+        return true;
+    }
+
+    stats.misses++;
+    return false;
+}
+
+DnsCache::AddressList DnsCache::store(const std::string& host,
+                                      const std::vector<Glib::RefPtr<Gio::InetAddress>>& resolved) {
+    AddressList addresses = interleave(resolved);
+    if (addresses.empty()) {
+        return addresses;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry& entry = entries[host];
+    entry.addresses = addresses;
+    entry.expires = std::chrono::steady_clock::now() + ttl;
+    return addresses;
+}
+
+void DnsCache::recordFailure() {
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.failures++;
+}
+
+DnsCache::AddressList DnsCache::interleave(const std::vector<Glib::RefPtr<Gio::InetAddress>>& resolved) {
+    AddressList first;
+    AddressList second;
+
+    for (const auto& address : resolved) {
+        if (!address) {
+            continue;
+        }
+        if (first.empty() || address->get_family() == first.front()->get_family()) {
+            first.push_back(address);
+        } else {
+            second.push_back(address);
+        }
+    }
+
+    AddressList ordered;
+    for (size_t i = 0; i < first.size() || i < second.size(); i++) {
+        if (i < first.size()) {
+            ordered.push_back(first[i]);
+        }
+        if (i < second.size()) {
+            ordered.push_back(second[i]);
+        }
+    }
+    return ordered;
+}
+
+void DnsCache::recordConnect(const Glib::RefPtr<Gio::InetAddress>& address,
+                             std::chrono::microseconds elapsed, bool success) {
+    std::lock_guard<std::mutex> lock(mutex);
+    AddressStats& entry = addressStats[address->to_string()];
+
+    entry.attempts++;
+    if (success) {
+        entry.successes++;
+        entry.totalConnectTime += elapsed;
+        entry.lastConnectTime = elapsed;
+    } else {
+        entry.failures++;
+    }
+}
+
+void DnsCache::setTtl(std::chrono::seconds ttl) {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->ttl = ttl;
+}
+
+void DnsCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+}
+
+DnsCache::Stats DnsCache::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+std::map<std::string, DnsCache::AddressStats> DnsCache::getAddressStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return addressStats;
+}
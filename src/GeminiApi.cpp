@@ -3,14 +3,17 @@
 #include <iostream>
 #include <regex>
 
-GeminiApi::GeminiApi() : cancelRequestFlag(false) {
+GeminiApi::GeminiApi() {
     // Set default endpoint
     setEndpoint("https://generativelanguage.googleapis.com/v1beta");
+    
+    // Record request timings under the provider's name
+    httpClient.setMetricsLabel(getName());
 }
 
 GeminiApi::~GeminiApi() {
-    // Cleanup thread
-    cleanupThread();
+    // Stop the request in flight
+    cancelRequest();
 }
 
 void GeminiApi::setApiKey(const std::string& apiKey) {
@@ -21,64 +24,50 @@ void GeminiApi::setEndpoint(const std::string& endpoint) {
     LLMApi::setEndpoint(endpoint);
 }
 
-std::vector<std::string> GeminiApi::getAvailableModels() {
-    if (!availableModels.empty()) {
-        return availableModels;
+std::string GeminiApi::getModelsUrl() const {
+    // Listing the models needs a key
+    if (getApiKey().empty()) {
+        return "";
     }
+    return getEndpoint() + "/models?key=" + getApiKey();
+}
+
+std::vector<std::string> GeminiApi::getDefaultModels() const {
+    // Gemini models are predefined
+    return {"gemini-pro", "gemini-pro-vision"};
+}
 
+std::vector<std::string> GeminiApi::parseModelsResponse(const std::string& response) {
+    std::vector<std::string> models;
+    
     try {
-        if (getApiKey().empty()) {
-            throw std::runtime_error("API key not set");
-        }
-        
-        // Try to fetch models from API if needed
-        std::string url = getEndpoint() + "/models?key=" + getApiKey();
+        std::regex modelRegex("\"name\"\\s*:\\s*\"([^\"]+)\"");
+        std::smatch match;
+        std::string::const_iterator searchStart(response.cbegin());
         
-        try {
-            // Set headers
-            httpClient.clearHeaders();
-            
-            // Perform request with a timeout
-            std::string response = httpClient.get(url);
-            
-            // Parse response
-            std::regex modelRegex("\"name\"\\s*:\\s*\"([^\"]+)\"");
-            std::smatch match;
-            std::string::const_iterator searchStart(response.cbegin());
-            
-            while (std::regex_search(searchStart, response.cend(), match, modelRegex)) {
-                if (match.size() > 1) {
-                    // Extract model name
-                    std::string fullName = match[1].str();
-                    // The API returns full paths like "models/gemini-pro", extract just the model name
-                    size_t lastSlash = fullName.find_last_of('/');
-                    if (lastSlash != std::string::npos) {
-                        availableModels.push_back(fullName.substr(lastSlash + 1));
-                    } else {
-                        availableModels.push_back(fullName);
-                    }
+        while (std::regex_search(searchStart, response.cend(), match, modelRegex)) {
+            if (match.size() > 1) {
+                // Extract model name
+                std::string fullName = match[1].str();
+                // The API returns full paths like "models/gemini-pro", extract just the model name
+                size_t lastSlash = fullName.find_last_of('/');
+                if (lastSlash != std::string::npos) {
+                    models.push_back(fullName.substr(lastSlash + 1));
+                } else {
+                    models.push_back(fullName);
                 }
-                searchStart = match.suffix().first;
             }
-        } catch (const std::exception& e) {
-            std::cerr << "Error fetching models from API: " << e.what() << std::endl;
+            searchStart = match.suffix().first;
         }
     } catch (const std::exception& e) {
-        std::cerr << "Error in getAvailableModels: " << e.what() << std::endl;
+        std::cerr << "Error parsing models: " << e.what() << std::endl;
     }
     
-    // If no models were found or there was an error, use defaults
-    if (availableModels.empty()) {
-        // Gemini models are predefined
-        availableModels.push_back("gemini-pro");
-        availableModels.push_back("gemini-pro-vision");
-    }
-    
-    return availableModels;
+    return models;
 }
 
-void GeminiApi::sendMessage(const std::string& message, const std::string& model, 
-                          const std::function<void(const std::string&, bool)>& callback) {
+std::shared_ptr<CancellationToken> GeminiApi::sendMessage(const std::string& message, const std::string& model, 
+                          const ResponseCallback& callback) {
     // Create a message vector with a single user message
     std::vector<Message> messages;
     Message userMessage;
@@ -87,48 +76,85 @@ void GeminiApi::sendMessage(const std::string& message, const std::string& model
     messages.push_back(userMessage);
     
     // Call the chat request method
-    sendChatRequest(messages, model, callback);
+    return sendChatRequest(messages, model, callback);
 }
 
-void GeminiApi::sendChatRequest(const std::vector<Message>& messages, 
+std::shared_ptr<CancellationToken> GeminiApi::sendChatRequest(const std::vector<Message>& messages, 
                               const std::string& model,
-                              const std::function<void(const std::string&, bool)>& callback) {
-    // Clean up previous request
-    cleanupThread();
+                              const ResponseCallback& callback) {
+    // Create URL with API key; alt=sse streams the reply as Server-Sent Events
+    std::string url = getEndpoint() + "/models/" + model + ":streamGenerateContent?alt=sse&key=" + getApiKey();
     
-    // Reset cancel flag
-    cancelRequestFlag = false;
+    // Create payload
+    SimpleJson payload = createRequestPayload(messages, model);
     
-    // Create a new thread for the request
-    requestThread = std::thread([this, messages, model, callback]() {
-        try {
-            // Create URL with API key
-            std::string url = getEndpoint() + "/models/" + model + ":generateContent?key=" + getApiKey();
-            
-            // Create payload
-            SimpleJson payload = createRequestPayload(messages, model);
-            
-            // Convert to string
-            std::string jsonPayload = payload.toJsonString();
-            
-            // Set headers
-            httpClient.clearHeaders();
-            httpClient.setHeader("Content-Type", "application/json");
-            
-            // Perform request
-            std::string response = httpClient.post(url, jsonPayload);
-            
-            // Extract the content from the response
-            std::string content = parseCompletionResponse(response);
-            
-            // Send the response to the callback
-            callback(content, true);
-            
-        } catch (const std::exception& e) {
-            // Handle errors
-            callback("Error: " + std::string(e.what()), true);
+    // Serialize while sending, so a long history starts going out before
+    // all of it has been converted; only its length is worked out up front
+    auto body = std::make_shared<JsonBodyProducer>(std::move(payload));
+    
+    // Wait for room under the rate limits; the estimate includes the reply budget
+    httpClient.setAdmission(getName(), model, RateLimiter::estimateTokens(static_cast<size_t>(body->length())) + 800);
+    
+    // Set headers
+    httpClient.clearHeaders();
+    httpClient.setHeader("Content-Type", "application/json");
+    httpClient.setHeader("Accept", "text/event-stream");
+    
+    // Scratch space for unescaping, reused across events, and whether an
+    // error event already ended the reply
+    auto unescaped = std::make_shared<std::string>();
+    auto done = std::make_shared<bool>(false);
+    
+    try {
+        // Stream the reply on the main loop
+        auto request = httpClient.postEventStreamAsync(url, body,
+            [unescaped, done, callback](const SseParser::Event& event) {
+                *done = !handleStreamEvent(event.data, *unescaped, callback);
+                return !*done;
+            },
+            [done, callback](const AsyncRequest::Result& result) {
+                // Cancelled requests end silently
+                if (result.cancelled || *done) {
+                    return;
+                }
+                
+                if (!result.ok()) {
+                    callback("Error: " + result.error, true);
+                    return;
+                }
+                
+                // Gemini ends the stream without a closing event
+                callback("", true);
+            });
+        
+        // Keep it alive until it finishes, alongside any others
+        requests.add(request);
+        return request->getToken();
+    } catch (const std::exception& e) {
+        // Handle errors
+        callback("Error: " + std::string(e.what()), true);
+        return nullptr;
+    }
+}
+
+bool GeminiApi::handleStreamEvent(std::string_view data, std::string& scratch, const ResponseCallback& callback) {
+    size_t candidates = data.find("\"candidates\"");
+    if (candidates == std::string_view::npos) {
+        // An error after the stream started comes as an event of its own
+        if (data.find("\"error\"") != std::string_view::npos) {
+            std::string_view message = findJsonString(data, "message", scratch);
+            callback("Error: " + std::string(message.empty() ? data : message), true);
+            return false;
         }
-    });
+        return true;
+    }
+    
+    // The last event may only carry the finish reason
+    std::string_view text = findJsonString(data, "text", scratch, candidates);
+    if (!text.empty()) {
+        callback(text, false);
+    }
+    return true;
 }
 
 std::string GeminiApi::performHttpRequest(const std::string& url, const std::string& jsonPayload) {
@@ -198,70 +224,11 @@ SimpleJson GeminiApi::createRequestPayload(const std::vector<Message>& messages,
     return payload;
 }
 
-std::string GeminiApi::parseCompletionResponse(const std::string& response) {
-    try {
-        // Simple parsing - look for text content in the response
-        std::regex contentRegex("\"text\"\\s*:\\s*\"((?:\\\\.|[^\"])*?)\"");
-        std::smatch match;
-        
-        if (std::regex_search(response, match, contentRegex) && match.size() > 1) {
-            std::string content = match[1].str();
-            
-            // Unescape JSON string
-            std::string unescaped;
-            for (size_t i = 0; i < content.length(); ++i) {
-                if (content[i] == '\\' && i + 1 < content.length()) {
-                    if (content[i + 1] == 'n') {
-                        unescaped += '\n';
-                    } else if (content[i + 1] == 'r') {
-                        unescaped += '\r';
-                    } else if (content[i + 1] == 't') {
-                        unescaped += '\t';
-                    } else if (content[i + 1] == '\"') {
-                        unescaped += '\"';
-                    } else if (content[i + 1] == '\\') {
-                        unescaped += '\\';
-                    } else {
-                        unescaped += content[i + 1];
-                    }
-                    i++; // Skip the escaped character
-                } else {
-                    unescaped += content[i];
-                }
-            }
-            
-            return unescaped;
-        }
-        
-        // Also check for error messages
-        std::regex errorRegex("\"message\"\\s*:\\s*\"((?:\\\\.|[^\"])*?)\"");
-        if (std::regex_search(response, match, errorRegex) && match.size() > 1) {
-            return "Error: " + match[1].str();
-        }
-    } catch (const std::exception& e) {
-        std::cerr << "Error parsing completion response: " << e.what() << std::endl;
-    }
-    
-    return "";
-}
-
 bool GeminiApi::isConfigured() const {
     return !getApiKey().empty() && !getEndpoint().empty();
 }
 
 void GeminiApi::cancelRequest() {
-    cancelRequestFlag = true;
+    requests.cancelAll();
     httpClient.cancelRequest();
-}
-
-void GeminiApi::cleanupThread() {
-    if (requestThread.joinable()) {
-        {
-            std::lock_guard<std::mutex> lock(threadMutex);
-            cancelRequestFlag = true;
-        }
-        
-        httpClient.cancelRequest();
-        requestThread.join();
-    }
-} 
\ No newline at end of file
+} 
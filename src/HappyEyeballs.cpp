@@ -0,0 +1,388 @@
+#include "HappyEyeballs.h"
+#include "DnsCache.h"
+#include "RequestTimeouts.h"
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+std::chrono::microseconds elapsedSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+}
+
+void closeQuietly(const Glib::RefPtr<Gio::Socket>& socket) {
+    try {
+        socket->close();
+    } catch (const Glib::Error&) {
+    }
+}
+
+}
+
+// State of one connectAsync call. Lives as long as a callback holds on to it.
+struct HappyEyeballs::Race : std::enable_shared_from_this<HappyEyeballs::Race> {
+    Glib::RefPtr<Gio::SocketClient> client;
+    int port = 0;
+    std::chrono::milliseconds attemptDelay{0};
+    Glib::RefPtr<Gio::Cancellable> cancellable;
+    gulong cancelHandler = 0;
+    ConnectCallback callback;
+    ResolvedCallback onResolved;
+
+    DnsCache::AddressList addresses;
+    size_t next = 0;
+
+    // Cancellation for each started attempt, so the losers can be stopped
+    std::vector<Glib::RefPtr<Gio::Cancellable>> attempts;
+    int pending = 0;
+    bool done = false;
+    std::string lastError;
+    sigc::connection timer;
+
+    void start(const std::string& host);
+    void startNext();
+    void onAttempt(const Glib::RefPtr<Gio::InetAddress>& address,
+                   std::chrono::steady_clock::time_point started,
+                   Glib::RefPtr<Gio::AsyncResult>& result);
+    void cancelAttempts();
+    void finish(const Glib::RefPtr<Gio::SocketConnection>& connection, const std::string& error);
+
+    bool isCancelled() const { return cancellable && cancellable->is_cancelled(); }
+};
+
+void HappyEyeballs::Race::start(const std::string& host) {
+    auto self = shared_from_this();
+
+    // Cancelling the request stops every attempt. The handler runs inside
+    // Cancellable::cancel(), so the work is deferred to the main loop.
+    if (cancellable) {
+        std::weak_ptr<Race> weak = self;
+        cancelHandler = cancellable->connect([weak]() {
+            Glib::signal_idle().connect_once([weak]() {
+                if (auto race = weak.lock()) {
+                    race->cancelAttempts();
+                }
+            });
+        });
+    }
+
+    DnsCache::getInstance().resolveAsync(host, cancellable,
+        [self](const DnsCache::AddressList& addresses, const std::string& error) {
+            if (addresses.empty()) {
+                self->finish(Glib::RefPtr<Gio::SocketConnection>(), error);
+                return;
+            }
+            self->addresses = addresses;
+            if (self->onResolved) {
+                self->onResolved();
+            }
+            self->startNext();
+        });
+}
+
+void HappyEyeballs::Race::startNext() {
+    timer.disconnect();
+
+    if (done || next >= addresses.size()) {
+        return;
+    }
+
+    if (isCancelled()) {
+        if (pending == 0) {
+            finish(Glib::RefPtr<Gio::SocketConnection>(), "Operation was cancelled");
+        }
+        return;
+    }
+
+    auto address = addresses[next++];
+    auto attempt = Gio::Cancellable::create();
+    attempts.push_back(attempt);
+    pending++;
+
+    auto self = shared_from_this();
+    auto started = std::chrono::steady_clock::now();
+    client->connect_async(Gio::InetSocketAddress::create(address, port), attempt,
+        [self, address, started](Glib::RefPtr<Gio::AsyncResult>& result) {
+            self->onAttempt(address, started, result);
+        });
+
+    // Give this attempt a head start before racing the next address
+    if (next < addresses.size()) {
+        std::weak_ptr<Race> weak = self;
+        timer = Glib::signal_timeout().connect([weak]() {
+            if (auto race = weak.lock()) {
+                race->timer = sigc::connection();
+                race->startNext();
+            }
+            return false;
+        }, attemptDelay.count());
+    }
+}
+
+void HappyEyeballs::Race::onAttempt(const Glib::RefPtr<Gio::InetAddress>& address,
+                                    std::chrono::steady_clock::time_point started,
+                                    Glib::RefPtr<Gio::AsyncResult>& result) {
+    pending--;
+
+    Glib::RefPtr<Gio::SocketConnection> connection;
+    std::string error;
+    try {
+        connection = client->connect_finish(result);
+    } catch (const Glib::Error& e) {
+        error = e.what();
+    }
+
+    // Another attempt already won
+    if (done) {
+        if (connection) {
+            try {
+                connection->close();
+            } catch (const Glib::Error&) {
+            }
+        }
+        return;
+    }
+
+    if (connection) {
+        DnsCache::getInstance().recordConnect(address, elapsedSince(started), true);
+        finish(connection, "");
+        return;
+    }
+
+    if (isCancelled()) {
+        if (pending == 0) {
+            finish(Glib::RefPtr<Gio::SocketConnection>(), error);
+        }
+        return;
+    }
+
+    DnsCache::getInstance().recordConnect(address, elapsedSince(started), false);
+    std::cerr << "Connection attempt to " << address->to_string() << ":" << port << " failed - " << error << std::endl;
+    lastError = error;
+
+    // Don't wait out the delay once an attempt has failed
+    if (next < addresses.size()) {
+        startNext();
+    } else if (pending == 0) {
+        finish(Glib::RefPtr<Gio::SocketConnection>(), lastError);
+    }
+}
+
+void HappyEyeballs::Race::cancelAttempts() {
+    for (auto& attempt : attempts) {
+        attempt->cancel();
+    }
+
+    // Nothing in flight to report the cancellation, e.g. while waiting on the timer
+    if (!done && pending == 0) {
+        finish(Glib::RefPtr<Gio::SocketConnection>(), "Operation was cancelled");
+    }
+}
+
+void HappyEyeballs::Race::finish(const Glib::RefPtr<Gio::SocketConnection>& connection, const std::string& error) {
+    if (done) {
+        return;
+    }
+    done = true;
+
+    timer.disconnect();
+    for (auto& attempt : attempts) {
+        attempt->cancel();
+    }
+
+    if (cancelHandler) {
+        cancellable->disconnect(cancelHandler);
+        cancelHandler = 0;
+    }
+
+    ConnectCallback report = std::move(callback);
+    callback = nullptr;
+    onResolved = nullptr;
+    if (report) {
+        report(connection, error);
+    }
+}
+
+HappyEyeballs::HappyEyeballs()
+    : attemptDelay(250),
+      connectTimeout(30000) {
+}
+
+HappyEyeballs& HappyEyeballs::getInstance() {
+    static HappyEyeballs instance;
+    return instance;
+}
+
+Glib::RefPtr<Gio::SocketConnection> HappyEyeballs::connect(const std::string& host, int port,
+                                                           std::chrono::milliseconds timeout,
+                                                           const Glib::RefPtr<Gio::Cancellable>& cancellable,
+                                                           const ResolvedCallback& onResolved) {
+    std::chrono::milliseconds attemptDelay;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        attemptDelay = this->attemptDelay;
+        if (timeout.count() <= 0) {
+            timeout = connectTimeout;
+        }
+    }
+
+    DnsCache::AddressList addresses = DnsCache::getInstance().resolve(host, cancellable);
+    if (onResolved) {
+        onResolved();
+    }
+
+    struct Attempt {
+        Glib::RefPtr<Gio::InetAddress> address;
+        Glib::RefPtr<Gio::Socket> socket;
+        std::chrono::steady_clock::time_point started;
+    };
+
+    std::vector<Attempt> pending;
+    size_t next = 0;
+    std::string lastError = "no address could be reached";
+
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    auto nextStart = std::chrono::steady_clock::now();
+
+    // Hand the winning socket over and drop the others
+    auto win = [&pending](Attempt& winner) {
+        DnsCache::getInstance().recordConnect(winner.address, elapsedSince(winner.started), true);
+        for (auto& other : pending) {
+            if (other.socket != winner.socket) {
+                closeQuietly(other.socket);
+            }
+        }
+        winner.socket->set_blocking(true);
+        return Gio::SocketConnection::create(winner.socket);
+    };
+
+    while (true) {
+        auto now = std::chrono::steady_clock::now();
+
+        if (cancellable && cancellable->is_cancelled()) {
+            for (auto& attempt : pending) {
+                closeQuietly(attempt.socket);
+            }
+            throw Gio::Error(Gio::Error::CANCELLED, "Operation was cancelled");
+        }
+
+        // Start the next attempt when its turn comes, or right away if nothing is in flight
+        if (next < addresses.size() && (now >= nextStart || pending.empty())) {
+            Attempt attempt{addresses[next++], Glib::RefPtr<Gio::Socket>(), now};
+            nextStart = now + attemptDelay;
+
+            try {
+                attempt.socket = Gio::Socket::create(attempt.address->get_family(),
+                                                     Gio::SOCKET_TYPE_STREAM,
+                                                     Gio::SOCKET_PROTOCOL_TCP);
+                attempt.socket->set_blocking(false);
+                try {
+                    attempt.socket->connect(Gio::InetSocketAddress::create(attempt.address, port));
+                    return win(attempt);
+                } catch (const Gio::Error& e) {
+                    if (e.code() != Gio::Error::PENDING) {
+                        throw;
+                    }
+                }
+                pending.push_back(attempt);
+            } catch (const Glib::Error& e) {
+                DnsCache::getInstance().recordConnect(attempt.address, elapsedSince(now), false);
+                std::cerr << "Connection attempt to " << attempt.address->to_string() << ":" << port << " failed - " << e.what() << std::endl;
+                lastError = e.what();
+                if (attempt.socket) {
+                    closeQuietly(attempt.socket);
+                }
+            }
+            continue;
+        }
+
+        if (pending.empty()) {
+            throw std::runtime_error("Connection failed: " + lastError);
+        }
+
+        if (now >= deadline) {
+            for (auto& attempt : pending) {
+                closeQuietly(attempt.socket);
+            }
+            std::cerr << "Timed out connecting to " << host << ":" << port << std::endl;
+            throw TimeoutError(TimeoutPhase::Connect, timeout);
+        }
+
+        // Wait for an attempt to complete, the next attempt's turn, or the deadline
+        auto wakeAt = deadline;
+        if (next < addresses.size() && nextStart < wakeAt) {
+            wakeAt = nextStart;
+        }
+        auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(wakeAt - now).count() + 1;
+
+        std::vector<GPollFD> fds;
+        for (auto& attempt : pending) {
+            GPollFD fd;
+            fd.fd = attempt.socket->get_fd();
+            fd.events = G_IO_OUT;
+            fd.revents = 0;
+            fds.push_back(fd);
+        }
+        size_t socketCount = fds.size();
+
+        // The cancellable's fd wakes the poll when the request is cancelled
+        GPollFD cancelFd;
+        bool watchCancel = cancellable && g_cancellable_make_pollfd(cancellable->gobj(), &cancelFd);
+        if (watchCancel) {
+            fds.push_back(cancelFd);
+        }
+        g_poll(fds.data(), fds.size(), static_cast<gint>(wait));
+        if (watchCancel) {
+            g_cancellable_release_fd(cancellable->gobj());
+        }
+
+        for (size_t i = socketCount; i-- > 0;) {
+            if (fds[i].revents == 0) {
+                continue;
+            }
+
+            try {
+                pending[i].socket->check_connect_result();
+                return win(pending[i]);
+            } catch (const Glib::Error& e) {
+                DnsCache::getInstance().recordConnect(pending[i].address, elapsedSince(pending[i].started), false);
+                std::cerr << "Connection attempt to " << pending[i].address->to_string() << ":" << port << " failed - " << e.what() << std::endl;
+                lastError = e.what();
+                closeQuietly(pending[i].socket);
+                pending.erase(pending.begin() + i);
+
+                // Don't wait out the delay once an attempt has failed
+                nextStart = std::chrono::steady_clock::now();
+            }
+        }
+    }
+}
+
+void HappyEyeballs::connectAsync(const Glib::RefPtr<Gio::SocketClient>& client,
+                                 const std::string& host, int port,
+                                 const Glib::RefPtr<Gio::Cancellable>& cancellable,
+                                 const ConnectCallback& callback,
+                                 const ResolvedCallback& onResolved) {
+    auto race = std::make_shared<Race>();
+    race->client = client;
+    race->port = port;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        race->attemptDelay = attemptDelay;
+    }
+    race->cancellable = cancellable;
+    race->callback = callback;
+    race->onResolved = onResolved;
+    race->start(host);
+}
+
+void HappyEyeballs::setAttemptDelay(std::chrono::milliseconds delay) {
+    std::lock_guard<std::mutex> lock(mutex);
+    attemptDelay = delay;
+}
+
+void HappyEyeballs::setConnectTimeout(std::chrono::milliseconds timeout) {
+    std::lock_guard<std::mutex> lock(mutex);
+    connectTimeout = timeout;
+}
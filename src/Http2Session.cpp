@@ -0,0 +1,538 @@
+#include "Http2Session.h"
+#include "ConnectionPool.h"
+#include <iostream>
+#include <stdexcept>
+#include <cctype>
+#include <cstdlib>
+#include <algorithm>
+#ifdef HAVE_NGHTTP2
+#include <nghttp2/nghttp2.h>
+#endif
+
+std::map<std::string, std::weak_ptr<Http2Session>> Http2Session::sessions;
+
+bool Http2Session::isSupported() {
+#ifdef HAVE_NGHTTP2
+    return true;
+#else
+    return false;
+#endif
+}
+
+std::shared_ptr<Http2Session> Http2Session::find(const std::string& key) {
+    auto it = sessions.find(key);
+    if (it == sessions.end()) {
+        return std::shared_ptr<Http2Session>();
+    }
+
+    auto session = it->second.lock();
+    if (!session || !session->isUsable()) {
+        return std::shared_ptr<Http2Session>();
+    }
+    return session;
+}
+
+void Http2Session::retire() {
+    auto it = sessions.find(key);
+    if (it != sessions.end()) {
+        auto current = it->second.lock();
+        if (!current || current.get() == this) {
+            sessions.erase(it);
+        }
+    }
+}
+
+#ifdef HAVE_NGHTTP2
+
+struct Http2Session::Callbacks {
+    static int onHeader(nghttp2_session*, const nghttp2_frame* frame,
+                        const uint8_t* name, size_t nameLength,
+                        const uint8_t* value, size_t valueLength,
+                        uint8_t, void* data) {
+        auto self = static_cast<Http2Session*>(data);
+        if (frame->hd.type != NGHTTP2_HEADERS || frame->headers.cat != NGHTTP2_HCAT_RESPONSE) {
+            return 0;
+        }
+
+        auto it = self->streams.find(frame->hd.stream_id);
+        if (it == self->streams.end() || it->second.cancelled) {
+            return 0;
+        }
+
+        std::string headerName(reinterpret_cast<const char*>(name), nameLength);
+        std::string headerValue(reinterpret_cast<const char*>(value), valueLength);
+        if (headerName == ":status") {
+            it->second.status = std::atoi(headerValue.c_str());
+        } else if (!headerName.empty() && headerName[0] != ':') {
+            it->second.headers.emplace_back(headerName, headerValue);
+        }
+        return 0;
+    }
+
+    static int onFrameReceived(nghttp2_session*, const nghttp2_frame* frame, void* data) {
+        auto self = static_cast<Http2Session*>(data);
+
+        if (frame->hd.type == NGHTTP2_GOAWAY) {
+            // Streams already open run to completion, new requests go elsewhere
+            self->goingAway = true;
+            self->retire();
+            return 0;
+        }
+
+        if (frame->hd.type != NGHTTP2_HEADERS || frame->headers.cat != NGHTTP2_HCAT_RESPONSE ||
+            !(frame->hd.flags & NGHTTP2_FLAG_END_HEADERS)) {
+            return 0;
+        }
+
+        auto it = self->streams.find(frame->hd.stream_id);
+        if (it == self->streams.end() || it->second.cancelled) {
+            return 0;
+        }
+
+        // Informational responses are followed by the real one
+        Stream& stream = it->second;
+        if (stream.status >= 100 && stream.status < 200) {
+            stream.status = 0;
+            stream.headers.clear();
+            return 0;
+        }
+
+        if (stream.handler.onHeaders) {
+            stream.handler.onHeaders(stream.status, stream.headers);
+        }
+        return 0;
+    }
+
+    static int onDataChunk(nghttp2_session* session, uint8_t, int32_t streamId,
+                           const uint8_t* chunk, size_t length, void* data) {
+        auto self = static_cast<Http2Session*>(data);
+
+        auto it = self->streams.find(streamId);
+        if (it == self->streams.end() || it->second.cancelled) {
+            return 0;
+        }
+
+        if (it->second.handler.onData &&
+            !it->second.handler.onData(reinterpret_cast<const char*>(chunk), length)) {
+            // The handler may already have cancelled the stream
+            it = self->streams.find(streamId);
+            if (it != self->streams.end() && !it->second.cancelled) {
+                it->second.cancelled = true;
+                nghttp2_submit_rst_stream(session, NGHTTP2_FLAG_NONE, streamId, NGHTTP2_CANCEL);
+            }
+        }
+        return 0;
+    }
+
+    static int onStreamClose(nghttp2_session*, int32_t streamId, uint32_t errorCode, void* data) {
+        auto self = static_cast<Http2Session*>(data);
+
+        auto it = self->streams.find(streamId);
+        if (it == self->streams.end()) {
+            return 0;
+        }
+
+        StreamHandler handler = std::move(it->second.handler);
+        bool cancelled = it->second.cancelled;
+        self->streams.erase(it);
+        self->updateIdleTimer();
+
+        if (!cancelled && handler.onClose) {
+            std::string error;
+            if (errorCode != NGHTTP2_NO_ERROR) {
+                error = "HTTP/2 stream reset: " + std::string(nghttp2_http2_strerror(errorCode));
+            }
+            handler.onClose(error);
+        }
+        return 0;
+    }
+
+    static ssize_t readBody(nghttp2_session*, int32_t streamId, uint8_t* buffer, size_t length,
+                            uint32_t* flags, nghttp2_data_source*, void* data) {
+        auto self = static_cast<Http2Session*>(data);
+
+        auto it = self->streams.find(streamId);
+        if (it == self->streams.end()) {
+            *flags |= NGHTTP2_DATA_FLAG_EOF;
+            return 0;
+        }
+
+        Stream& stream = it->second;
+        if (stream.producer) {
+            return readProduced(stream, buffer, length, flags);
+        }
+        if (!stream.body) {
+            *flags |= NGHTTP2_DATA_FLAG_EOF;
+            return 0;
+        }
+
+        const std::string& body = *stream.body;
+        size_t count = std::min(length, body.size() - stream.bodyOffset);
+        std::copy(body.data() + stream.bodyOffset, body.data() + stream.bodyOffset + count, buffer);
+        stream.bodyOffset += count;
+
+        if (stream.bodyOffset == body.size()) {
+            *flags |= NGHTTP2_DATA_FLAG_EOF;
+            // The body isn't needed once it has been framed
+            stream.body.reset();
+            stream.bodyOffset = 0;
+        }
+        return static_cast<ssize_t>(count);
+    }
+
+    // Frame a produced body, asking the producer for a piece whenever the
+    // last one has been taken
+    static ssize_t readProduced(Stream& stream, uint8_t* buffer, size_t length, uint32_t* flags) {
+        while (stream.bodyOffset == stream.piece.size() && !stream.produced) {
+            stream.piece.clear();
+            stream.bodyOffset = 0;
+            stream.produced = !stream.producer->produce(stream.piece);
+        }
+
+        size_t count = std::min(length, stream.piece.size() - stream.bodyOffset);
+        std::copy(stream.piece.data() + stream.bodyOffset, stream.piece.data() + stream.bodyOffset + count, buffer);
+        stream.bodyOffset += count;
+
+        if (stream.produced && stream.bodyOffset == stream.piece.size()) {
+            *flags |= NGHTTP2_DATA_FLAG_EOF;
+            stream.producer.reset();
+            stream.piece.clear();
+            stream.bodyOffset = 0;
+        }
+        return static_cast<ssize_t>(count);
+    }
+};
+
+Http2Session::Http2Session(const std::string& key,
+                           const Glib::RefPtr<Gio::SocketConnection>& socket,
+                           const Glib::RefPtr<Gio::IOStream>& stream)
+    : key(key),
+      socket(socket),
+      stream(stream),
+      session(nullptr),
+      written(0),
+      input(16384),
+      writing(false),
+      receiving(false),
+      goingAway(false),
+      closed(false) {
+    nghttp2_session_callbacks* callbacks;
+    nghttp2_session_callbacks_new(&callbacks);
+    nghttp2_session_callbacks_set_on_header_callback(callbacks, &Callbacks::onHeader);
+    nghttp2_session_callbacks_set_on_frame_recv_callback(callbacks, &Callbacks::onFrameReceived);
+    nghttp2_session_callbacks_set_on_data_chunk_recv_callback(callbacks, &Callbacks::onDataChunk);
+    nghttp2_session_callbacks_set_on_stream_close_callback(callbacks, &Callbacks::onStreamClose);
+
+    int result = nghttp2_session_client_new(&session, callbacks, this);
+    nghttp2_session_callbacks_del(callbacks);
+
+    if (result != 0) {
+        throw std::runtime_error("HTTP/2 setup failed: " + std::string(nghttp2_strerror(result)));
+    }
+}
+
+Http2Session::~Http2Session() {
+    idleTimer.disconnect();
+    if (session) {
+        nghttp2_session_del(session);
+    }
+}
+
+std::shared_ptr<Http2Session> Http2Session::create(const std::string& key,
+                                                   const Glib::RefPtr<Gio::SocketConnection>& socket,
+                                                   const Glib::RefPtr<Gio::IOStream>& stream) {
+    std::shared_ptr<Http2Session> session(new Http2Session(key, socket, stream));
+
+    // The newest session takes over for the host
+    sessions[key] = session;
+    session->start();
+
+    std::cerr << "HTTP/2 session opened to " << key << std::endl;
+    return session;
+}
+
+void Http2Session::start() {
+    // Token streams are many small DATA frames; large windows keep the
+    // server from stalling on WINDOW_UPDATE round trips
+    nghttp2_settings_entry settings[] = {
+        {NGHTTP2_SETTINGS_ENABLE_PUSH, 0},
+        {NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, 100},
+        {NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE, streamWindowSize}
+    };
+    nghttp2_submit_settings(session, NGHTTP2_FLAG_NONE, settings, sizeof(settings) / sizeof(settings[0]));
+    nghttp2_session_set_local_window_size(session, NGHTTP2_FLAG_NONE, 0, connectionWindowSize);
+
+    flush();
+    readMore();
+}
+
+bool Http2Session::isUsable() const {
+    if (closed || goingAway || !nghttp2_session_check_request_allowed(session)) {
+        return false;
+    }
+    uint32_t maxStreams = nghttp2_session_get_remote_settings(session, NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS);
+    return streams.size() < maxStreams;
+}
+
+int Http2Session::submit(const std::string& method, const std::string& authority, const std::string& path,
+                         const HttpResponseParser::HeaderList& headers, const RequestWriter::Body& body,
+                         const std::shared_ptr<BodyProducer>& producer, const StreamHandler& handler) {
+    if (!isUsable()) {
+        throw std::runtime_error("HTTP/2 session can't take more requests");
+    }
+
+    // HTTP/2 field names are lower case and connection-specific fields are not allowed
+    std::vector<std::pair<std::string, std::string>> fields = {
+        {":method", method},
+        {":scheme", "https"},
+        {":authority", authority},
+        {":path", path}
+    };
+    for (const auto& [name, value] : headers) {
+        std::string lower = name;
+        for (auto& c : lower) {
+            c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+        if (lower == "host" || lower == "connection" || lower == "keep-alive" ||
+            lower == "transfer-encoding" || lower == "upgrade" || lower == "proxy-connection") {
+            continue;
+        }
+        fields.emplace_back(lower, value);
+    }
+
+    std::vector<nghttp2_nv> nva;
+    for (auto& [name, value] : fields) {
+        nghttp2_nv nv;
+        nv.name = reinterpret_cast<uint8_t*>(const_cast<char*>(name.data()));
+        nv.namelen = name.size();
+        nv.value = reinterpret_cast<uint8_t*>(const_cast<char*>(value.data()));
+        nv.valuelen = value.size();
+        nv.flags = NGHTTP2_NV_FLAG_NONE;
+        nva.push_back(nv);
+    }
+
+    nghttp2_data_provider provider;
+    provider.source.ptr = nullptr;
+    provider.read_callback = &Callbacks::readBody;
+
+    bool hasBody = (body && !body->empty()) || producer;
+    if (producer) {
+        producer->rewind();
+    }
+    int streamId = nghttp2_submit_request(session, nullptr, nva.data(), nva.size(),
+                                          hasBody ? &provider : nullptr, nullptr);
+    if (streamId < 0) {
+        throw std::runtime_error("HTTP/2 request failed: " + std::string(nghttp2_strerror(streamId)));
+    }
+
+    Stream& entry = streams[streamId];
+    entry.handler = handler;
+    entry.body = body;
+    entry.producer = producer;
+    updateIdleTimer();
+
+    flush();
+    return streamId;
+}
+
+void Http2Session::cancel(int streamId) {
+    auto it = streams.find(streamId);
+    if (it == streams.end() || it->second.cancelled) {
+        return;
+    }
+
+    it->second.cancelled = true;
+    if (!closed) {
+        nghttp2_submit_rst_stream(session, NGHTTP2_FLAG_NONE, streamId, NGHTTP2_CANCEL);
+        flush();
+    }
+}
+
+void Http2Session::flush() {
+    if (writing || receiving || closed) {
+        return;
+    }
+
+    // Collect everything nghttp2 has queued into one write
+    const uint8_t* data = nullptr;
+    ssize_t length;
+    while ((length = nghttp2_session_mem_send(session, &data)) > 0) {
+        output.append(reinterpret_cast<const char*>(data), length);
+    }
+    if (length < 0) {
+        fail("HTTP/2 error: " + std::string(nghttp2_strerror(static_cast<int>(length))));
+        return;
+    }
+    if (output.empty()) {
+        return;
+    }
+
+    writing = true;
+    written = 0;
+    auto self = shared_from_this();
+    stream->get_output_stream()->write_async(output.data(), output.size(),
+        [self](Glib::RefPtr<Gio::AsyncResult>& result) {
+            self->onWritten(result);
+        });
+}
+
+void Http2Session::onWritten(Glib::RefPtr<Gio::AsyncResult>& result) {
+    try {
+        written += stream->get_output_stream()->write_finish(result);
+    } catch (const Glib::Error& e) {
+        writing = false;
+        fail("HTTP/2 write failed: " + std::string(e.what()));
+        return;
+    }
+
+    if (written < output.size()) {
+        auto self = shared_from_this();
+        stream->get_output_stream()->write_async(output.data() + written, output.size() - written,
+            [self](Glib::RefPtr<Gio::AsyncResult>& result) {
+                self->onWritten(result);
+            });
+        return;
+    }
+
+    output.clear();
+    writing = false;
+    flush();
+}
+
+void Http2Session::readMore() {
+    auto self = shared_from_this();
+    stream->get_input_stream()->read_async(input.data(), input.size(),
+        [self](Glib::RefPtr<Gio::AsyncResult>& result) {
+            self->onRead(result);
+        });
+}
+
+void Http2Session::onRead(Glib::RefPtr<Gio::AsyncResult>& result) {
+    if (closed) {
+        return;
+    }
+
+    gssize count;
+    try {
+        count = stream->get_input_stream()->read_finish(result);
+    } catch (const Glib::Error& e) {
+        fail("HTTP/2 read failed: " + std::string(e.what()));
+        return;
+    }
+
+    if (count <= 0) {
+        fail("HTTP/2 connection closed by the server");
+        return;
+    }
+
+    receiving = true;
+    ssize_t processed = nghttp2_session_mem_recv(session, reinterpret_cast<const uint8_t*>(input.data()), count);
+    receiving = false;
+
+    if (processed < 0) {
+        fail("HTTP/2 protocol error: " + std::string(nghttp2_strerror(static_cast<int>(processed))));
+        return;
+    }
+
+    // Send SETTINGS acks, WINDOW_UPDATEs and anything callbacks queued
+    flush();
+
+    if (!nghttp2_session_want_read(session) && !nghttp2_session_want_write(session)) {
+        fail("");
+        return;
+    }
+
+    if (!closed) {
+        readMore();
+    }
+}
+
+void Http2Session::updateIdleTimer() {
+    idleTimer.disconnect();
+    if (!streams.empty() || closed) {
+        return;
+    }
+
+    std::weak_ptr<Http2Session> weak = shared_from_this();
+    idleTimer = Glib::signal_timeout().connect_seconds([weak]() {
+        if (auto self = weak.lock()) {
+            self->idleTimer = sigc::connection();
+            if (self->streams.empty()) {
+                nghttp2_session_terminate_session(self->session, NGHTTP2_NO_ERROR);
+                self->flush();
+                self->retire();
+                self->goingAway = true;
+            }
+        }
+        return false;
+    }, ConnectionPool::getInstance().getIdleTimeout().count());
+}
+
+void Http2Session::fail(const std::string& error) {
+    if (closed) {
+        return;
+    }
+    closed = true;
+    retire();
+    idleTimer.disconnect();
+
+    if (!error.empty()) {
+        std::cerr << error << " (" << key << ")" << std::endl;
+    }
+
+    // Tell the open streams; a session closing cleanly has none left
+    std::map<int, Stream> open;
+    open.swap(streams);
+    for (auto& [id, entry] : open) {
+        if (!entry.cancelled && entry.handler.onClose) {
+            entry.handler.onClose(error.empty() ? "HTTP/2 connection closed" : error);
+        }
+    }
+
+    try {
+        stream->close();
+    } catch (const Glib::Error&) {
+    }
+}
+
+#else
+
+// Without nghttp2 no session is ever created, so find() never returns one
+
+Http2Session::Http2Session(const std::string& key,
+                           const Glib::RefPtr<Gio::SocketConnection>& socket,
+                           const Glib::RefPtr<Gio::IOStream>& stream)
+    : key(key),
+      socket(socket),
+      stream(stream),
+      session(nullptr),
+      written(0),
+      writing(false),
+      receiving(false),
+      goingAway(true),
+      closed(true) {
+}
+
+Http2Session::~Http2Session() {
+}
+
+std::shared_ptr<Http2Session> Http2Session::create(const std::string&,
+                                                   const Glib::RefPtr<Gio::SocketConnection>&,
+                                                   const Glib::RefPtr<Gio::IOStream>&) {
+    throw std::runtime_error("HTTP/2 support is not built in");
+}
+
+bool Http2Session::isUsable() const {
+    return false;
+}
+
+int Http2Session::submit(const std::string&, const std::string&, const std::string&,
+                         const HttpResponseParser::HeaderList&, const RequestWriter::Body&,
+                         const std::shared_ptr<BodyProducer>&, const StreamHandler&) {
+    throw std::runtime_error("HTTP/2 support is not built in");
+}
+
+void Http2Session::cancel(int) {
+}
+
+#endif
@@ -1,21 +1,26 @@
 #include "HttpClient.h"
+#include "CircuitBreaker.h"
+#include "TlsContext.h"
+#include "HappyEyeballs.h"
+#include "Http2Session.h"
 #include <sstream>
 #include <iostream>
 #include <regex>
+#include <algorithm>
+#include <thread>
+#include <sys/stat.h>
 
-HttpClient::HttpClient() : cancelled(false) {
+HttpClient::HttpClient()
+    : http2Enabled(Http2Session::isSupported()),
+      circuitBreakerEnabled(true),
+      uringEnabled(UringTransport::isSupported()),
+      retryPolicy(std::make_shared<RetryPolicy>()) {
     client = Gio::SocketClient::create();
 }
 
 HttpClient::~HttpClient() {
     // Ensure connection is closed
-    if (connection) {
-        try {
-            connection->close();
-        } catch (...) {
-            // Ignore errors during cleanup
-        }
-    }
+    releaseConnection(false);
 }
 
 void HttpClient::setHeader(const std::string& name, const std::string& value) {
@@ -26,6 +31,40 @@ void HttpClient::clearHeaders() {
     headers.clear();
 }
 
+void HttpClient::setTimeouts(const RequestTimeouts& timeouts) {
+    this->timeouts = timeouts;
+}
+
+void HttpClient::setRetryPolicy(const RetryPolicy::Settings& settings) {
+    retryPolicy = std::make_shared<RetryPolicy>(settings);
+}
+
+void HttpClient::disableRetries() {
+    retryPolicy.reset();
+}
+
+void HttpClient::setHttp2Enabled(bool enabled) {
+    http2Enabled = enabled && Http2Session::isSupported();
+}
+
+void HttpClient::setCircuitBreakerEnabled(bool enabled) {
+    circuitBreakerEnabled = enabled;
+}
+
+void HttpClient::setUringEnabled(bool enabled) {
+    uringEnabled = enabled && UringTransport::isSupported();
+}
+
+void HttpClient::setMetricsLabel(const std::string& label) {
+    metricsLabel = label;
+}
+
+void HttpClient::setAdmission(const std::string& provider, const std::string& model, long estimatedTokens) {
+    admission.provider = provider;
+    admission.model = model;
+    admission.tokens = estimatedTokens;
+}
+
 std::string HttpClient::get(const std::string& url) {
     return makeRequest("GET", url, "");
 }
@@ -34,9 +73,36 @@ std::string HttpClient::post(const std::string& url, const std::string& data) {
     return makeRequest("POST", url, data);
 }
 
+std::string HttpClient::post(const std::string& url, const std::shared_ptr<BodyProducer>& body) {
+    UrlParts parts = parseUrl(url);
+    
+    // Each attempt rewinds the producer and writes the body as it is made
+    RequestWriter request(buildHead("POST", parts, body ? body->length() : 0), body);
+    
+    return makeRequest("POST", url, parts, request);
+}
+
 HttpClient::UrlParts HttpClient::parseUrl(const std::string& url) {
     UrlParts parts;
     
+    // unix:///path/to/socket/request/path; the socket is the longest prefix
+    // of the path that is a socket on disk
+    const std::string unixScheme = "unix://";
+    if (url.compare(0, unixScheme.size(), unixScheme) == 0) {
+        std::string path = url.substr(unixScheme.size());
+        for (size_t end = path.size(); end != std::string::npos && end > 0; end = path.rfind('/', end - 1)) {
+            struct stat info;
+            if (stat(path.substr(0, end).c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+                parts.protocol = "unix";
+                parts.host = path.substr(0, end);
+                parts.port = 0;
+                parts.path = end < path.size() ? path.substr(end) : "/";
+                return parts;
+            }
+        }
+        throw std::runtime_error("No Unix socket found in URL: " + url);
+    }
+    
     // Use regex to parse URL
     std::regex urlRegex("(http|https)://([^:/]+)(:[0-9]+)?(/.*)?");
     std::smatch match;
@@ -65,248 +131,687 @@ HttpClient::UrlParts HttpClient::parseUrl(const std::string& url) {
     return parts;
 }
 
-std::string HttpClient::makeRequest(const std::string& method, const std::string& url, const std::string& data) {
-    // Reset cancellation flag
-    cancelled = false;
+HttpResponseParser::HeaderList HttpClient::buildHeaders(long long bodyLength) {
+    HttpResponseParser::HeaderList list(headers.begin(), headers.end());
     
-    // Parse URL
-    UrlParts parts = parseUrl(url);
-    
-    // Create connection
-    try {
-        connection = client->connect_to_host(parts.host, parts.port);
-    } catch (const Glib::Error& e) {
-        std::cerr << "Connection failed to " << parts.host << ":" << parts.port << " - " << e.what() << std::endl;
-        throw std::runtime_error("Connection failed: " + std::string(e.what()));
+    // Ask for a compressed response; the parser decodes it as it arrives
+    if (headers.find("Accept-Encoding") == headers.end()) {
+        list.emplace_back("Accept-Encoding", ContentDecoder::acceptEncoding());
     }
     
-    // Create request
-    std::stringstream request;
-    request << method << " " << parts.path << " HTTP/1.1\r\n";
-    request << "Host: " << parts.host << "\r\n";
-    
-    // Add headers
-    for (const auto& [name, value] : headers) {
-        request << name << ": " << value << "\r\n";
-    }
-    
-    // Add content length if we have data
-    if (!data.empty()) {
-        request << "Content-Length: " << data.length() << "\r\n";
+    // Add content length if we have data, or chunk a body of unknown length
+    if (bodyLength != 0) {
+        if (bodyLength > 0) {
+            list.emplace_back("Content-Length", std::to_string(bodyLength));
+        } else {
+            list.emplace_back("Transfer-Encoding", "chunked");
+        }
         // If no content type is specified, add a default one
         if (headers.find("Content-Type") == headers.end()) {
-            request << "Content-Type: application/json\r\n";
+            list.emplace_back("Content-Type", "application/json");
         }
     }
     
-    // End headers
-    request << "Connection: close\r\n"; // Add this to ensure the server closes the connection after response
-    request << "\r\n";
+    return list;
+}
+
+std::string HttpClient::buildHead(const std::string& method, const UrlParts& parts,
+                                  long long bodyLength) {
+    std::string head;
+    head.reserve(256);
+    head += method + " " + parts.path + " HTTP/1.1\r\n";
+    head += "Host: " + (parts.protocol == "unix" ? std::string("localhost") : parts.host) + "\r\n";
     
-    // Add data if we have it
-    if (!data.empty()) {
-        request << data;
+    // Add headers
+    for (const auto& [name, value] : buildHeaders(bodyLength)) {
+        head += name + ": " + value + "\r\n";
     }
     
-    // Send request
-    std::string requestStr = request.str();
+    // Persistent connections are the HTTP/1.1 default, but say so explicitly for proxies
+    head += "Connection: keep-alive\r\n";
+    head += "\r\n";
     
-    // Debug output
-    std::cerr << "Sending request to: " << url << std::endl;
+    return head;
+}
+
+void HttpClient::openConnection(const UrlParts& parts, const RequestDeadline& deadline, const CancellationToken& token,
+                                RequestTiming& timing) {
+    std::string key = ConnectionPool::makeKey(parts.protocol, parts.host, parts.port);
+    
+    // A new connection has to be ready before the next limit
+    std::chrono::steady_clock::time_point limit;
+    TimeoutPhase phase;
+    bool limited = deadline.next(limit, phase);
     
     try {
-        connection->get_output_stream()->write(requestStr.data(), requestStr.size());
+        connection = ConnectionPool::getInstance().acquire(key, [this, &parts, &token, &timing, limited, limit]() {
+            std::chrono::milliseconds timeout(0);
+            if (limited) {
+                timeout = std::max(std::chrono::milliseconds(1),
+                                   std::chrono::duration_cast<std::chrono::milliseconds>(limit - std::chrono::steady_clock::now()));
+            }
+            
+            ConnectionPool::Connection newConnection;
+            try {
+                if (parts.protocol == "unix") {
+                    // Local sockets connect at once or not at all
+                    newConnection.socket = client->connect(Gio::UnixSocketAddress::create(parts.host),
+                                                           token.getCancellable());
+                } else {
+                    newConnection.socket = HappyEyeballs::getInstance().connect(parts.host, parts.port, timeout,
+                                                                                token.getCancellable(), [&timing]() {
+                        timing.mark(RequestPhase::Dns);
+                    });
+                }
+                timing.mark(RequestPhase::Connect);
+            } catch (const Glib::Error& e) {
+                throw ConnectionError("Connection failed: " + std::string(e.what()));
+            } catch (const TimeoutError&) {
+                throw;
+            } catch (const std::runtime_error& e) {
+                // Nothing reached the server, so this is safe to retry
+                throw ConnectionError(e.what());
+            }
+            
+            // Run TLS on top of the socket for https endpoints
+            if (parts.protocol == "https") {
+                // Blocking socket timeouts have a granularity of seconds
+                auto socket = newConnection.socket->get_socket();
+                if (limited) {
+                    socket->set_timeout((timeout.count() + 999) / 1000);
+                }
+                newConnection.stream = TlsContext::getInstance().connect(newConnection.socket, parts.host, parts.port,
+                                                                         token.getCancellable());
+                socket->set_timeout(0);
+                timing.mark(RequestPhase::Tls);
+            } else {
+                newConnection.stream = newConnection.socket;
+            }
+            
+            return newConnection;
+        });
     } catch (const Glib::Error& e) {
-        std::cerr << "Failed to send request: " << e.what() << std::endl;
-        throw std::runtime_error("Failed to send request: " + std::string(e.what()));
+        std::cerr << "Connection failed to " << parts.host << ":" << parts.port << " - " << e.what() << std::endl;
+        throw std::runtime_error("Connection failed: " + std::string(e.what()));
+    } catch (const std::exception& e) {
+        // Report running out of time as the limit that was reached
+        if (limited && std::chrono::steady_clock::now() >= limit) {
+            throw deadline.error(phase);
+        }
+        throw;
+    }
+}
+
+void HttpClient::waitForData(const RequestDeadline& deadline, const CancellationToken& token) {
+    std::chrono::steady_clock::time_point limit;
+    TimeoutPhase phase;
+    if (!deadline.next(limit, phase)) {
+        return;
+    }
+    
+    // Data TLS has already decrypted doesn't show up on the socket
+    GInputStream* input = connection.stream->get_input_stream()->gobj();
+    if (G_IS_POLLABLE_INPUT_STREAM(input) &&
+        g_pollable_input_stream_can_poll(G_POLLABLE_INPUT_STREAM(input)) &&
+        g_pollable_input_stream_is_readable(G_POLLABLE_INPUT_STREAM(input))) {
+        return;
     }
     
-    // Read response
-    char buffer[4096];
-    std::string response;
+    auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(limit - std::chrono::steady_clock::now());
+    if (remaining.count() <= 0) {
+        throw deadline.error(phase);
+    }
     
     try {
-        while (!cancelled) {
-            gssize bytes_read = connection->get_input_stream()->read(buffer, sizeof(buffer));
-            if (bytes_read <= 0) break;
-            response.append(buffer, bytes_read);
-            
-            // Check if we've received the full headers
-            size_t headerEnd = response.find("\r\n\r\n");
-            if (headerEnd != std::string::npos) {
-                // Extract headers
-                std::string headers = response.substr(0, headerEnd);
-                
-                // Debug output
-                std::cerr << "Response headers: " << std::endl << headers << std::endl;
-                
-                // Extract status code
-                std::regex statusRegex("HTTP/[0-9.]+ ([0-9]+)");
-                std::smatch match;
-                if (std::regex_search(headers, match, statusRegex)) {
-                    int statusCode = std::stoi(match[1].str());
-                    if (statusCode >= 400) {
-                        // Get response body for error details
-                        std::string errorBody = response.substr(headerEnd + 4);
-                        std::cerr << "HTTP error " << statusCode << ": " << errorBody << std::endl;
-                        throw std::runtime_error("HTTP error " + std::to_string(statusCode) + ": " + errorBody);
+        connection.socket->get_socket()->condition_timed_wait(Glib::IO_IN | Glib::IO_HUP | Glib::IO_ERR, remaining.count(),
+                                                              token.getCancellable());
+    } catch (const Gio::Error& e) {
+        if (e.code() == Gio::Error::TIMED_OUT) {
+            throw deadline.error(phase);
+        }
+        throw;
+    }
+}
+
+void HttpClient::releaseConnection(bool reusable) {
+    ConnectionPool::getInstance().release(connection, reusable);
+}
+
+void HttpClient::exchange(const UrlParts& parts, const RequestWriter& request, HttpResponseParser& parser,
+                          const CancellationToken& token, RequestTiming& timing) {
+    RequestDeadline deadline(timeouts);
+    const Glib::RefPtr<Gio::Cancellable>& cancellable = token.getCancellable();
+    
+    // An idle pooled connection may have been closed by the server just as we
+    // picked it up; in that case retry once on a fresh connection
+    for (int attempt = 0; ; attempt++) {
+        timing.start();
+        deadline.startConnect();
+        try {
+            openConnection(parts, deadline, token, timing);
+        } catch (...) {
+            // A cancelled connect is not a failure
+            if (token.isCancelled()) {
+                return;
+            }
+            throw;
+        }
+        bool retryable = connection.isReused() && attempt == 0;
+        timing.reusedConnection = connection.isReused();
+        
+        deadline.awaitResponse();
+        try {
+            request.write(connection.stream->get_output_stream(), cancellable);
+            timing.mark(RequestPhase::RequestSent);
+        } catch (const Glib::Error& e) {
+            releaseConnection(false);
+            if (token.isCancelled()) {
+                return;
+            }
+            if (retryable) {
+                continue;
+            }
+            std::cerr << "Failed to send request: " << e.what() << std::endl;
+            throw std::runtime_error("Failed to send request: " + std::string(e.what()));
+        }
+        
+        // Read response into the connection's buffer; the parser hands the
+        // body on as spans of it
+        ReadBuffer& buffer = connection.readBuffer();
+        size_t received = 0;
+        bool trailingData = false;
+        
+        try {
+            while (!token.isCancelled() && !parser.isComplete() && !parser.isAborted()) {
+                waitForData(deadline, token);
+                auto [space, size] = buffer.prepare();
+                gssize bytes_read = connection.stream->get_input_stream()->read(space, size, cancellable);
+                if (bytes_read <= 0) {
+                    // A reused connection that closes without answering is retried below
+                    if (!(retryable && received == 0)) {
+                        parser.finish();
                     }
+                    break;
                 }
+                buffer.commit(bytes_read);
+                received += bytes_read;
+                deadline.onData();
+                timing.mark(RequestPhase::FirstByte);
                 
-                // Extract content length if available
-                std::regex contentLengthRegex("Content-Length: ([0-9]+)");
-                if (std::regex_search(headers, match, contentLengthRegex)) {
-                    size_t contentLength = std::stoull(match[1].str());
-                    size_t bodyStart = headerEnd + 4;
-                    size_t bodySize = response.size() - bodyStart;
-                    
-                    // If we have the full content, return it
-                    if (bodySize >= contentLength) {
-                        return response.substr(bodyStart, contentLength);
-                    }
-                } else {
-                    // Check for chunked transfer encoding
-                    std::regex chunkedRegex("Transfer-Encoding:\\s*chunked", std::regex::icase);
-                    if (std::regex_search(headers, chunkedRegex)) {
-                        // Handle chunked response
-                        std::string body = response.substr(headerEnd + 4);
-                        // For now, just return the raw chunked body
-                        return body;
-                    } else {
-                        // If no content length and not chunked, assume we got everything
-                        return response.substr(headerEnd + 4);
-                    }
+                // Anything after the end of the response leaves the connection in an unknown state
+                if (parser.feed(buffer) && parser.isComplete()) {
+                    trailingData = true;
                 }
+                if (parser.getDecodedBytes() > 0) {
+                    timing.mark(RequestPhase::FirstToken);
+                }
+            }
+            if (parser.isComplete()) {
+                timing.mark(RequestPhase::LastByte);
             }
+        } catch (const Glib::Error& e) {
+            releaseConnection(false);
+            if (token.isCancelled()) {
+                return;
+            }
+            if (retryable && received == 0) {
+                continue;
+            }
+            std::cerr << "Error reading response: " << e.what() << std::endl;
+            throw std::runtime_error("Error reading response: " + std::string(e.what()));
+        } catch (const std::exception& e) {
+            std::cerr << "Error reading response: " << e.what() << std::endl;
+            releaseConnection(false);
+            throw;
         }
-    } catch (const Glib::Error& e) {
-        std::cerr << "Error reading response: " << e.what() << std::endl;
-        throw std::runtime_error("Error reading response: " + std::string(e.what()));
+        
+        // The server closed a reused connection without answering
+        if (retryable && received == 0 && !token.isCancelled()) {
+            releaseConnection(false);
+            continue;
+        }
+        
+        // Only a connection positioned exactly at the end of a response can be reused
+        releaseConnection(parser.isComplete() && parser.keepAlive() && !trailingData && !token.isCancelled());
+        return;
     }
+}
+
+bool HttpClient::waitToRetry(int attempt, int statusCode, const HttpResponseParser::HeaderList& headers,
+                             std::chrono::milliseconds& delay, const CancellationToken& token) {
+    if (!retryPolicy || token.isCancelled() || !retryPolicy->shouldRetry(attempt, statusCode, headers, delay)) {
+        return false;
+    }
+    
+    std::cerr << "Retrying in " << delay.count() << " ms ("
+              << (statusCode != 0 ? "HTTP " + std::to_string(statusCode) : std::string("connection failed")) << ")" << std::endl;
     
-    if (cancelled) {
+    // Wait on the token's cancellable so cancelRequest() cuts the wait short
+    GCancellable* cancellable = token.getCancellable()->gobj();
+    auto until = std::chrono::steady_clock::now() + delay;
+    while (!token.isCancelled() && std::chrono::steady_clock::now() < until) {
+        auto step = std::chrono::duration_cast<std::chrono::milliseconds>(until - std::chrono::steady_clock::now());
+        GPollFD fd;
+        if (g_cancellable_make_pollfd(cancellable, &fd)) {
+            g_poll(&fd, 1, static_cast<gint>(step.count()) + 1);
+            g_cancellable_release_fd(cancellable);
+        } else {
+            std::this_thread::sleep_for(std::min(step, std::chrono::milliseconds(50)));
+        }
+    }
+    return !token.isCancelled();
+}
+
+void HttpClient::exchangeWithRetry(const UrlParts& parts, const RequestWriter& request,
+                                   HttpResponseParser& parser, const CancellationToken& token,
+                                   const std::function<void()>& restart) {
+    std::chrono::milliseconds delay(0);
+    RequestTiming timing;
+    CircuitBreaker& breaker = CircuitBreaker::getInstance();
+    std::string endpoint = CircuitBreaker::endpointUrl(parts.protocol, parts.host, parts.port);
+    for (int attempt = 1; ; attempt++) {
+        // Don't wait on an endpoint that is known to be down
+        if (circuitBreakerEnabled && !breaker.allowRequest(endpoint)) {
+            throw std::runtime_error(CircuitBreaker::unavailableError(endpoint));
+        }
+        
+        try {
+            exchange(parts, request, parser, token, timing);
+        } catch (const ConnectionError&) {
+            if (circuitBreakerEnabled) {
+                breaker.record(endpoint, 0, !token.isCancelled(), timing);
+            }
+            if (waitToRetry(attempt, 0, HttpResponseParser::HeaderList(), delay, token)) {
+                parser.reset();
+                restart();
+                continue;
+            }
+            throw;
+        } catch (...) {
+            if (circuitBreakerEnabled) {
+                breaker.record(endpoint, parser.getStatusCode(), !token.isCancelled(), timing);
+            }
+            throw;
+        }
+        
+        if (circuitBreakerEnabled) {
+            breaker.record(endpoint, parser.getStatusCode(), false, timing);
+        }
+        
+        // Error responses never reach a streaming callback, so nothing was shown yet
+        int status = parser.getStatusCode();
+        if (!token.isCancelled() && RetryPolicy::isRetryableStatus(status) &&
+            waitToRetry(attempt, status, parser.getHeaders(), delay, token)) {
+            parser.reset();
+            restart();
+            continue;
+        }
+        
+        if (retryPolicy && !token.isCancelled() && status > 0 && status < 400) {
+            retryPolicy->onSuccess();
+        }
+        
+        // Only requests that got an answer say anything about the server
+        if (!token.isCancelled() && status > 0) {
+            RequestMetrics::getInstance().record(metricsLabel.empty() ? parts.host : metricsLabel, timing);
+        }
+        return;
+    }
+}
+
+void HttpClient::trackToken(const std::shared_ptr<CancellationToken>& token) {
+    std::lock_guard<std::mutex> lock(tokenMutex);
+    tokens.erase(std::remove_if(tokens.begin(), tokens.end(),
+                                [](const std::weak_ptr<CancellationToken>& entry) { return entry.expired(); }),
+                 tokens.end());
+    tokens.push_back(token);
+}
+
+std::string HttpClient::makeRequest(const std::string& method, const std::string& url, const std::string& data) {
+    // Parse URL
+    UrlParts parts = parseUrl(url);
+    
+    // Create request; the body is written straight from the caller's string
+    RequestWriter request(buildHead(method, parts, static_cast<long long>(data.length())), data);
+    
+    return makeRequest(method, url, parts, request);
+}
+
+std::string HttpClient::makeRequest(const std::string& method, const std::string& url,
+                                    const UrlParts& parts, const RequestWriter& request) {
+    // Each request gets its own token, so cancelling it can't affect any other
+    auto token = CancellationToken::create();
+    trackToken(token);
+    
+    // Debug output
+    std::cerr << "Sending request to: " << url << std::endl;
+    
+    // Collect the decoded body
+    std::string body;
+    HttpResponseParser parser;
+    parser.setHeadRequest(method == "HEAD");
+    parser.setBodyHandler([&body](const char* data, size_t length) {
+        body.append(data, length);
+        return true;
+    });
+    
+    exchangeWithRetry(parts, request, parser, *token, [&body]() {
+        body.clear();
+    });
+    
+    if (token->isCancelled()) {
         throw std::runtime_error("Request cancelled");
     }
     
-    return response;
+    // Debug output
+    std::cerr << "Response status: " << parser.getStatusCode() << " " << parser.getReason() << std::endl;
+    
+    if (parser.getStatusCode() >= 400) {
+        std::cerr << "HTTP error " << parser.getStatusCode() << ": " << body << std::endl;
+        throw std::runtime_error("HTTP error " + std::to_string(parser.getStatusCode()) + ": " + body);
+    }
+    
+    return body;
 }
 
 void HttpClient::postStreaming(
     const std::string& url, 
     const std::string& data,
-    const std::function<bool(const std::string&)>& dataCallback
+    const StreamCallback& dataCallback
 ) {
-    // Reset cancellation flag
-    cancelled = false;
+    // Each request gets its own token, so cancelling it can't affect any other
+    auto token = CancellationToken::create();
+    trackToken(token);
     
     // Parse URL
     UrlParts parts = parseUrl(url);
     
-    // Create connection
-    try {
-        connection = client->connect_to_host(parts.host, parts.port);
-    } catch (const Glib::Error& e) {
-        throw std::runtime_error("Connection failed: " + std::string(e.what()));
-    }
+    // Create request; the body is written straight from the caller's string
+    RequestWriter request(buildHead("POST", parts, static_cast<long long>(data.length())), data);
     
-    // Create request
-    std::stringstream request;
-    request << "POST " << parts.path << " HTTP/1.1\r\n";
-    request << "Host: " << parts.host << "\r\n";
+    // Pass decoded payload on as soon as it arrives; chunk framing never
+    // reaches the callback, wherever the chunk boundaries fall
+    std::string errorBody;
+    HttpResponseParser parser;
+    parser.setBodyHandler([&parser, &errorBody, &dataCallback](const char* chunk, size_t length) {
+        // Keep error details for the exception instead of streaming them
+        if (parser.getStatusCode() >= 400) {
+            errorBody.append(chunk, length);
+            return true;
+        }
+        return dataCallback(std::string_view(chunk, length));
+    });
     
-    // Add headers
-    for (const auto& [name, value] : headers) {
-        request << name << ": " << value << "\r\n";
-    }
+    exchangeWithRetry(parts, request, parser, *token, [&errorBody]() {
+        errorBody.clear();
+    });
     
-    // Add content length
-    request << "Content-Length: " << data.length() << "\r\n";
+    // The callback asked to stop
+    bool stopped = token->isCancelled() || parser.isAborted();
     
-    // If no content type is specified, add a default one
-    if (headers.find("Content-Type") == headers.end()) {
-        request << "Content-Type: application/json\r\n";
+    if (!stopped && parser.getStatusCode() >= 400) {
+        throw std::runtime_error("HTTP error " + std::to_string(parser.getStatusCode()) + ": " + errorBody);
     }
+}
+
+void HttpClient::postEventStream(
+    const std::string& url,
+    const std::string& data,
+    const SseParser::EventCallback& eventCallback
+) {
+    // Events cut by chunk boundaries are put back together by the parser
+    SseParser parser;
+    postStreaming(url, data, [&parser, &eventCallback](std::string_view chunk) {
+        return parser.feed(chunk, eventCallback);
+    });
+    parser.finish();
+}
+
+std::shared_ptr<AsyncRequest> HttpClient::sendAsync(
+    const std::string& method,
+    const std::string& url,
+    const std::string& data,
+    const AsyncRequest::DataCallback& onData,
+    const AsyncRequest::CompletionCallback& onComplete
+) {
+    // The request outlives the caller's string, so it needs its own copy
+    return sendAsync(method, url, std::make_shared<const std::string>(data), onData, onComplete);
+}
+
+std::shared_ptr<AsyncRequest> HttpClient::sendAsync(
+    const std::string& method,
+    const std::string& url,
+    const RequestWriter::Body& body,
+    const AsyncRequest::DataCallback& onData,
+    const AsyncRequest::CompletionCallback& onComplete
+) {
+    // Parse URL
+    UrlParts parts = parseUrl(url);
     
-    // End headers
-    request << "\r\n";
+    // Debug output
+    std::cerr << "Sending request to: " << url << std::endl;
     
-    // Add data
-    request << data;
+    long long bodyLength = body ? static_cast<long long>(body->length()) : 0;
     
-    // Send request
-    std::string requestStr = request.str();
-    connection->get_output_stream()->write(requestStr.data(), requestStr.size());
+    // The request carries everything it needs, so this client can be reused
+    // or destroyed while it runs
+    AsyncRequest::Message message;
+    message.method = method;
+    message.path = parts.path;
+    message.headers = buildHeaders(bodyLength);
+    message.head = buildHead(method, parts, bodyLength);
+    message.body = body;
     
-    // Read response
-    char buffer[4096];
-    std::string response;
-    bool headersReceived = false;
-    size_t bodyStart = 0;
+    return startAsync(parts, message, onData, onComplete);
+}
+
+std::shared_ptr<AsyncRequest> HttpClient::sendAsync(
+    const std::string& method,
+    const std::string& url,
+    const std::shared_ptr<BodyProducer>& body,
+    const AsyncRequest::DataCallback& onData,
+    const AsyncRequest::CompletionCallback& onComplete
+) {
+    // Parse URL
+    UrlParts parts = parseUrl(url);
     
-    while (!cancelled) {
-        gssize bytes_read = connection->get_input_stream()->read(buffer, sizeof(buffer));
-        if (bytes_read <= 0) break;
-        response.append(buffer, bytes_read);
-        
-        if (!headersReceived) {
-            // Check if we've received the full headers
-            size_t headerEnd = response.find("\r\n\r\n");
-            if (headerEnd != std::string::npos) {
-                // Extract headers
-                std::string headers = response.substr(0, headerEnd);
-                
-                // Extract status code
-                std::regex statusRegex("HTTP/[0-9.]+ ([0-9]+)");
-                std::smatch match;
-                if (std::regex_search(headers, match, statusRegex)) {
-                    int statusCode = std::stoi(match[1].str());
-                    if (statusCode >= 400) {
-                        throw std::runtime_error("HTTP error: " + std::to_string(statusCode));
-                    }
-                }
-                
-                headersReceived = true;
-                bodyStart = headerEnd + 4;
-                
-                // Process any body data we already have
-                if (response.size() > bodyStart) {
-                    std::string chunk = response.substr(bodyStart);
-                    if (!dataCallback(chunk)) {
-                        cancelled = true;
-                        break;
-                    }
-                    response.erase(bodyStart);
-                }
-            }
-        } else {
-            // Process body data
-            if (!dataCallback(std::string(buffer, bytes_read))) {
-                cancelled = true;
-                break;
-            }
-        }
+    // Debug output
+    std::cerr << "Sending request to: " << url << std::endl;
+    
+    // The body is made as it is written; only its length is needed now
+    long long bodyLength = body ? body->length() : 0;
+    
+    AsyncRequest::Message message;
+    message.method = method;
+    message.path = parts.path;
+    message.headers = buildHeaders(bodyLength);
+    message.head = buildHead(method, parts, bodyLength);
+    message.producer = body;
+    
+    return startAsync(parts, message, onData, onComplete);
+}
+
+std::shared_ptr<AsyncRequest> HttpClient::startAsync(const UrlParts& parts, const AsyncRequest::Message& message,
+                                                     const AsyncRequest::DataCallback& onData,
+                                                     const AsyncRequest::CompletionCallback& onComplete) {
+    auto request = std::make_shared<AsyncRequest>(
+        client, parts.protocol, parts.host, parts.port,
+        message, onData, onComplete);
+    request->setTimeouts(timeouts);
+    request->setHttp2Enabled(http2Enabled);
+    request->setRetryPolicy(retryPolicy);
+    request->setMetricsLabel(metricsLabel);
+    request->setAdmission(admission);
+    request->setCircuitBreakerEnabled(circuitBreakerEnabled);
+    trackToken(request->getToken());
+    request->start();
+    
+    return request;
+}
+
+std::shared_ptr<AsyncRequest> HttpClient::getAsync(const std::string& url, const AsyncRequest::CompletionCallback& onComplete) {
+    return sendAsync("GET", url, "", nullptr, onComplete);
+}
+
+std::shared_ptr<AsyncRequest> HttpClient::postAsync(const std::string& url, const std::string& data,
+                                                    const AsyncRequest::CompletionCallback& onComplete) {
+    return sendAsync("POST", url, data, nullptr, onComplete);
+}
+
+std::shared_ptr<AsyncRequest> HttpClient::postAsync(const std::string& url, const RequestWriter::Body& body,
+                                                    const AsyncRequest::CompletionCallback& onComplete) {
+    return sendAsync("POST", url, body, nullptr, onComplete);
+}
+
+std::shared_ptr<AsyncRequest> HttpClient::postAsync(const std::string& url,
+                                                    const std::shared_ptr<BodyProducer>& body,
+                                                    const AsyncRequest::CompletionCallback& onComplete) {
+    return sendAsync("POST", url, body, nullptr, onComplete);
+}
+
+std::shared_ptr<AsyncRequest> HttpClient::postStreamingAsync(
+    const std::string& url,
+    const std::string& data,
+    const AsyncRequest::DataCallback& onData,
+    const AsyncRequest::CompletionCallback& onComplete
+) {
+    return sendAsync("POST", url, data, onData, onComplete);
+}
+
+std::shared_ptr<AsyncRequest> HttpClient::postStreamingAsync(
+    const std::string& url,
+    const RequestWriter::Body& body,
+    const AsyncRequest::DataCallback& onData,
+    const AsyncRequest::CompletionCallback& onComplete
+) {
+    return sendAsync("POST", url, body, onData, onComplete);
+}
+
+std::shared_ptr<AsyncRequest> HttpClient::postStreamingAsync(
+    const std::string& url,
+    const std::shared_ptr<BodyProducer>& body,
+    const AsyncRequest::DataCallback& onData,
+    const AsyncRequest::CompletionCallback& onComplete
+) {
+    return sendAsync("POST", url, body, onData, onComplete);
+}
+
+std::shared_ptr<AsyncRequest> HttpClient::postEventStreamAsync(
+    const std::string& url,
+    const std::shared_ptr<BodyProducer>& body,
+    const SseParser::EventCallback& onEvent,
+    const AsyncRequest::CompletionCallback& onComplete
+) {
+    auto parser = std::make_shared<SseParser>();
+    return sendAsync("POST", url, body,
+        [parser, onEvent](std::string_view chunk) {
+            return parser->feed(chunk, onEvent);
+        },
+        onComplete);
+}
+
+std::vector<AsyncRequest::Result> HttpClient::runBatch(const std::vector<BatchRequest>& requests) {
+    std::vector<UrlParts> parts;
+    bool plain = true;
+    for (const auto& request : requests) {
+        parts.push_back(parseUrl(request.url));
+        plain = plain && (parts.back().protocol == "http" || parts.back().protocol == "unix");
     }
     
-    // Close connection
-    if (connection) {
+    batchStats = UringTransport::Stats();
+    
+    // TLS stays with GIO
+    if (uringEnabled && plain && !requests.empty()) {
+        return runUringBatch(requests, parts);
+    }
+    
+    std::vector<AsyncRequest::Result> results(requests.size());
+    auto loop = Glib::MainLoop::create();
+    size_t remaining = requests.size();
+    std::vector<std::shared_ptr<AsyncRequest>> running;
+    for (size_t i = 0; i < requests.size(); i++) {
+        const BatchRequest& request = requests[i];
         try {
-            connection->close();
-            connection.reset();
-        } catch (...) {
-            // Ignore errors during cleanup
+            running.push_back(sendAsync(request.method, request.url, request.data, request.onData,
+                [&results, &remaining, &loop, i](const AsyncRequest::Result& result) {
+                    results[i] = result;
+                    if (--remaining == 0) {
+                        loop->quit();
+                    }
+                }));
+        } catch (const std::exception& e) {
+            results[i].error = e.what();
+            remaining--;
         }
     }
+    
+    // Requests that failed right away have already counted down
+    if (remaining > 0) {
+        loop->run();
+    }
+    return results;
 }
 
-void HttpClient::cancelRequest() {
-    cancelled = true;
+std::vector<AsyncRequest::Result> HttpClient::runUringBatch(const std::vector<BatchRequest>& requests,
+                                                            const std::vector<UrlParts>& parts) {
+    // Reads may wait as long as the longest per-phase limit
+    UringTransport::Settings settings;
+    settings.maxInFlight = static_cast<unsigned>(ConnectionPool::getInstance().getMaxConnectionsPerHost());
+    settings.ioTimeout = std::max({timeouts.connect, timeouts.firstByte, timeouts.idle});
+    UringTransport transport(settings);
     
-    // Close connection to interrupt any in-progress operations
-    if (connection) {
-        try {
-            connection->close();
-        } catch (...) {
-            // Ignore errors during cancellation
+    std::vector<UringTransport::Request> batch(requests.size());
+    for (size_t i = 0; i < requests.size(); i++) {
+        batch[i].scheme = parts[i].protocol;
+        batch[i].host = parts[i].host;
+        batch[i].port = parts[i].port;
+        batch[i].head = buildHead(requests[i].method, parts[i], static_cast<long long>(requests[i].data.size()));
+        batch[i].body = std::make_shared<const std::string>(requests[i].data);
+        batch[i].onData = requests[i].onData;
+    }
+    
+    std::vector<UringTransport::Result> done = transport.run(batch);
+    
+    batchStats = transport.getStats();
+    
+    std::vector<AsyncRequest::Result> results(requests.size());
+    for (size_t i = 0; i < done.size(); i++) {
+        results[i].statusCode = done[i].statusCode;
+        results[i].body = std::move(done[i].body);
+        results[i].error = std::move(done[i].error);
+    }
+    return results;
+}
+
+std::shared_ptr<AsyncRequest> HttpClient::preconnectAsync(const std::string& url,
+                                                          const AsyncRequest::CompletionCallback& onComplete) {
+    UrlParts parts = parseUrl(url);
+    
+    AsyncRequest::Message message;
+    message.method = "GET";
+    message.path = parts.path;
+    
+    auto request = std::make_shared<AsyncRequest>(
+        client, parts.protocol, parts.host, parts.port,
+        message, nullptr, onComplete);
+    request->setTimeouts(timeouts);
+    request->setHttp2Enabled(http2Enabled);
+    request->setConnectOnly(true);
+    request->setMetricsLabel(metricsLabel);
+    trackToken(request->getToken());
+    request->start();
+    
+    return request;
+}
+
+void HttpClient::cancelRequest() {
+    // Cancelling a token wakes whatever its request is blocked on; the
+    // connection is closed by the thread using it, never from here
+    std::lock_guard<std::mutex> lock(tokenMutex);
+    for (const auto& entry : tokens) {
+        if (auto token = entry.lock()) {
+            token->cancel();
         }
     }
+    tokens.clear();
 } 
\ No newline at end of file
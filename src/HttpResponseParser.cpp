@@ -0,0 +1,411 @@
+#include "HttpResponseParser.h"
+#include <cstring>
+#include <stdexcept>
+
+// Compare two ASCII strings ignoring case
+static bool equalsIgnoreCase(const std::string& a, const char* b) {
+    size_t length = std::strlen(b);
+    if (a.size() != length) {
+        return false;
+    }
+    for (size_t i = 0; i < length; ++i) {
+        char x = a[i];
+        char y = b[i];
+        if (x >= 'A' && x <= 'Z') x += 'a' - 'A';
+        if (y >= 'A' && y <= 'Z') y += 'a' - 'A';
+        if (x != y) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Strip spaces and tabs from both ends
+static std::string trim(const std::string& value) {
+    size_t first = value.find_first_not_of(" \t");
+    if (first == std::string::npos) {
+        return "";
+    }
+    size_t last = value.find_last_not_of(" \t");
+    return value.substr(first, last - first + 1);
+}
+
+// Check if a comma separated header value contains a token, ignoring case
+static bool containsToken(const std::string& value, const char* token) {
+    size_t start = 0;
+    while (start < value.size()) {
+        size_t end = value.find(',', start);
+        if (end == std::string::npos) {
+            end = value.size();
+        }
+        if (equalsIgnoreCase(trim(value.substr(start, end - start)), token)) {
+            return true;
+        }
+        start = end + 1;
+    }
+    return false;
+}
+
+HttpResponseParser::HttpResponseParser()
+    : headRequest(false),
+      chunkedDecoder([this](const char* data, size_t length) { return deliver(data, length); }),
+      contentDecoder([this](const char* data, size_t length) { return deliverDecoded(data, length); }) {
+    reset();
+}
+
+void HttpResponseParser::reset() {
+    state = State::StatusLine;
+    framing = Framing::None;
+    versionMajor = 0;
+    versionMinor = 0;
+    statusCode = 0;
+    reason.clear();
+    headers.clear();
+    trailers.clear();
+    line.clear();
+    remaining = 0;
+    chunkedDecoder.reset();
+    contentDecoder.reset();
+    bodyBytes = 0;
+}
+
+void HttpResponseParser::setBodyHandler(const BodyHandler& handler) {
+    bodyHandler = handler;
+}
+
+void HttpResponseParser::setHeadRequest(bool head) {
+    headRequest = head;
+}
+
+bool HttpResponseParser::headersComplete() const {
+    return state != State::StatusLine && state != State::HeaderLine;
+}
+
+bool HttpResponseParser::isComplete() const {
+    return state == State::Complete;
+}
+
+bool HttpResponseParser::isAborted() const {
+    return state == State::Aborted;
+}
+
+std::string HttpResponseParser::getHeader(const std::string& name) const {
+    for (const auto& [headerName, value] : headers) {
+        if (equalsIgnoreCase(headerName, name.c_str())) {
+            return value;
+        }
+    }
+    return "";
+}
+
+unsigned long long HttpResponseParser::getDecodedBytes() const {
+    return contentDecoder.isActive() ? contentDecoder.getBytesOut() : bodyBytes;
+}
+
+bool HttpResponseParser::keepAlive() const {
+    if (framing == Framing::UntilClose) {
+        return false;
+    }
+
+    std::string connection = getHeader("Connection");
+    if (containsToken(connection, "close")) {
+        return false;
+    }
+
+    // HTTP/1.1 is persistent by default, HTTP/1.0 only on request
+    if (versionMajor == 1 && versionMinor == 0) {
+        return containsToken(connection, "keep-alive");
+    }
+    return versionMajor == 1;
+}
+
+bool HttpResponseParser::readLine(const char* data, size_t length, size_t& pos) {
+    const char* start = data + pos;
+    const char* newline = static_cast<const char*>(std::memchr(start, '\n', length - pos));
+
+    if (!newline) {
+        line.append(start, length - pos);
+        pos = length;
+        if (line.size() > maxLineLength) {
+            throw std::runtime_error("Malformed HTTP response: header line too long");
+        }
+        return false;
+    }
+
+    line.append(start, newline - start);
+    pos = newline - data + 1;
+
+    // Accept bare LF as well as CRLF
+    if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+    }
+    if (line.size() > maxLineLength) {
+        throw std::runtime_error("Malformed HTTP response: header line too long");
+    }
+    return true;
+}
+
+void HttpResponseParser::parseStatusLine() {
+    // HTTP/<major>.<minor> <code> [reason]
+    if (line.size() < 12 || line.compare(0, 5, "HTTP/") != 0 ||
+        line[5] < '0' || line[5] > '9' || line[6] != '.' ||
+        line[7] < '0' || line[7] > '9' || line[8] != ' ') {
+        throw std::runtime_error("Malformed HTTP response: bad status line");
+    }
+
+    versionMajor = line[5] - '0';
+    versionMinor = line[7] - '0';
+
+    statusCode = 0;
+    for (size_t i = 9; i < 12; ++i) {
+        if (line[i] < '0' || line[i] > '9') {
+            throw std::runtime_error("Malformed HTTP response: bad status code");
+        }
+        statusCode = statusCode * 10 + (line[i] - '0');
+    }
+
+    reason = line.size() > 13 ? line.substr(13) : "";
+}
+
+void HttpResponseParser::parseHeaderLine(HeaderList& list) {
+    size_t colon = line.find(':');
+    if (colon == std::string::npos || colon == 0) {
+        throw std::runtime_error("Malformed HTTP response: bad header line");
+    }
+
+    list.emplace_back(line.substr(0, colon), trim(line.substr(colon + 1)));
+}
+
+void HttpResponseParser::onHeadersComplete() {
+    // Informational responses are followed by the real one
+    if (statusCode >= 100 && statusCode < 200) {
+        headers.clear();
+        state = State::StatusLine;
+        return;
+    }
+
+    // Responses that never have a body
+    if (headRequest || statusCode == 204 || statusCode == 304) {
+        framing = Framing::None;
+        state = State::Complete;
+        return;
+    }
+
+    // Unsupported codings are passed on as they are
+    contentDecoder.start(getHeader("Content-Encoding"));
+
+    std::string transferEncoding = getHeader("Transfer-Encoding");
+    if (!transferEncoding.empty()) {
+        // Chunked must be the final coding; anything else runs until close
+        size_t comma = transferEncoding.rfind(',');
+        std::string finalCoding = trim(comma == std::string::npos ? transferEncoding
+                                                                  : transferEncoding.substr(comma + 1));
+
+        if (equalsIgnoreCase(finalCoding, "chunked")) {
+            framing = Framing::Chunked;
+            state = State::ChunkedBody;
+            chunkedDecoder.reset();
+        } else {
+            framing = Framing::UntilClose;
+            state = State::Body;
+        }
+        return;
+    }
+
+    std::string contentLength = getHeader("Content-Length");
+    if (!contentLength.empty()) {
+        unsigned long long length = 0;
+        for (char c : contentLength) {
+            if (c < '0' || c > '9') {
+                throw std::runtime_error("Malformed HTTP response: bad Content-Length");
+            }
+            if (length > (~0ULL - 9) / 10) {
+                throw std::runtime_error("Malformed HTTP response: Content-Length too large");
+            }
+            length = length * 10 + (c - '0');
+        }
+
+        framing = Framing::ContentLength;
+        remaining = length;
+        state = length > 0 ? State::Body : State::Complete;
+        return;
+    }
+
+    framing = Framing::UntilClose;
+    state = State::Body;
+}
+
+bool HttpResponseParser::deliver(const char* data, size_t length) {
+    bodyBytes += length;
+    if (!contentDecoder.decode(data, length)) {
+        state = State::Aborted;
+        return false;
+    }
+    return true;
+}
+
+bool HttpResponseParser::deliverDecoded(const char* data, size_t length) {
+    return !bodyHandler || bodyHandler(data, length);
+}
+
+void HttpResponseParser::finishBody() {
+    contentDecoder.finish();
+}
+
+size_t HttpResponseParser::feed(const char* data, size_t length) {
+    size_t pos = 0;
+
+    while (pos < length) {
+        switch (state) {
+            case State::StatusLine:
+                if (readLine(data, length, pos)) {
+                    // Tolerate stray empty lines before the status line
+                    if (!line.empty()) {
+                        parseStatusLine();
+                        state = State::HeaderLine;
+                    }
+                    line.clear();
+                }
+                break;
+
+            case State::HeaderLine:
+                if (readLine(data, length, pos)) {
+                    if (line.empty()) {
+                        onHeadersComplete();
+                    } else {
+                        parseHeaderLine(headers);
+                    }
+                    line.clear();
+                }
+                break;
+
+            case State::Body: {
+                size_t available = length - pos;
+                if (framing == Framing::ContentLength && available > remaining) {
+                    available = static_cast<size_t>(remaining);
+                }
+
+                const char* start = data + pos;
+                pos += available;
+
+                if (framing == Framing::ContentLength) {
+                    remaining -= available;
+                    if (remaining == 0) {
+                        state = State::Complete;
+                    }
+                }
+
+                if (!deliver(start, available)) {
+                    return pos;
+                }
+                break;
+            }
+
+            case State::ChunkedBody:
+                pos += chunkedDecoder.decode(data + pos, length - pos);
+                if (chunkedDecoder.isStopped()) {
+                    return pos;
+                }
+                if (chunkedDecoder.isDone()) {
+                    state = State::TrailerLine;
+                }
+                break;
+
+            case State::TrailerLine:
+                if (readLine(data, length, pos)) {
+                    if (line.empty()) {
+                        state = State::Complete;
+                    } else {
+                        parseHeaderLine(trailers);
+                    }
+                    line.clear();
+                }
+                break;
+
+            case State::Complete:
+                finishBody();
+                return pos;
+
+            case State::Aborted:
+                return pos;
+        }
+    }
+
+    if (state == State::Complete) {
+        finishBody();
+    }
+    return pos;
+}
+
+void HttpResponseParser::setHead(int status, const HeaderList& headerList) {
+    reset();
+    versionMajor = 2;
+    versionMinor = 0;
+    statusCode = status;
+    headers = headerList;
+
+    if (headRequest || statusCode == 204 || statusCode == 304) {
+        state = State::Complete;
+        return;
+    }
+
+    // The body is delimited by the end of the stream
+    contentDecoder.start(getHeader("Content-Encoding"));
+    framing = Framing::UntilClose;
+    state = State::Body;
+}
+
+bool HttpResponseParser::feed(ReadBuffer& buffer) {
+    while (!buffer.empty()) {
+        std::string_view span = buffer.peek();
+        size_t used = feed(span.data(), span.size());
+        buffer.consume(used);
+        if (used < span.size()) {
+            buffer.clear();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool HttpResponseParser::feedBody(const char* data, size_t length) {
+    if (state != State::Body) {
+        return state != State::Aborted;
+    }
+    return deliver(data, length);
+}
+
+void HttpResponseParser::endBody() {
+    if (state == State::Body) {
+        state = State::Complete;
+        finishBody();
+    }
+}
+
+void HttpResponseParser::finish() {
+    switch (state) {
+        case State::Complete:
+        case State::Aborted:
+            return;
+
+        case State::Body:
+            if (framing == Framing::UntilClose) {
+                state = State::Complete;
+                finishBody();
+                return;
+            }
+            throw std::runtime_error("Connection closed before the response body was complete");
+
+        case State::StatusLine:
+            if (line.empty()) {
+                throw std::runtime_error("Connection closed before a response was received");
+            }
+            throw std::runtime_error("Connection closed before the response headers were complete");
+
+        case State::HeaderLine:
+            throw std::runtime_error("Connection closed before the response headers were complete");
+
+        default:
+            throw std::runtime_error("Connection closed before the chunked body was complete");
+    }
+}
@@ -1,61 +1,166 @@
 #include "LLMApi.h"
+#include "ModelCatalog.h"
 #include <sstream>
 
+namespace {
+
+// Numbers are written the way a stream writes a double
+std::string formatNumber(double value) {
+    std::ostringstream ss;
+    ss << value;
+    return ss.str();
+}
+
+// Append a code point as UTF-8
+void appendUtf8(std::string& out, unsigned codePoint) {
+    if (codePoint < 0x80) {
+        out += static_cast<char>(codePoint);
+    } else if (codePoint < 0x800) {
+        out += static_cast<char>(0xC0 | (codePoint >> 6));
+        out += static_cast<char>(0x80 | (codePoint & 0x3F));
+    } else if (codePoint < 0x10000) {
+        out += static_cast<char>(0xE0 | (codePoint >> 12));
+        out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (codePoint & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (codePoint >> 18));
+        out += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (codePoint & 0x3F));
+    }
+}
+
+// Read the four hex digits of a \u escape; -1 if they aren't hex
+long readHex4(std::string_view text) {
+    if (text.size() < 4) {
+        return -1;
+    }
+    long value = 0;
+    for (size_t i = 0; i < 4; i++) {
+        char c = text[i];
+        int digit = c >= '0' && c <= '9' ? c - '0'
+                  : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                  : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        if (digit < 0) {
+            return -1;
+        }
+        value = value * 16 + digit;
+    }
+    return value;
+}
+
+}
+
 std::string SimpleJson::toJsonString() const {
-    std::stringstream ss;
-    
+    std::string out;
+    appendJson(out);
+    return out;
+}
+
+void SimpleJson::appendJson(std::string& out) const {
     switch (type) {
         case Null:
-            ss << "null";
+            out += "null";
             break;
         case Boolean:
-            ss << (boolValue ? "true" : "false");
+            out += boolValue ? "true" : "false";
             break;
         case Number:
-            ss << numberValue;
+            out += formatNumber(numberValue);
             break;
         case String:
-            ss << "\"";
+            out += '"';
             // Escape special characters
             for (char c : stringValue) {
                 if (c == '\"' || c == '\\') {
-                    ss << '\\';
+                    out += '\\';
                 }
-                ss << c;
+                out += c;
             }
-            ss << "\"";
+            out += '"';
             break;
         case Array:
-            ss << "[";
+            out += '[';
             for (size_t i = 0; i < arrayValues.size(); ++i) {
-                if (i > 0) ss << ",";
-                ss << arrayValues[i].toJsonString();
+                if (i > 0) out += ',';
+                arrayValues[i].appendJson(out);
             }
-            ss << "]";
+            out += ']';
             break;
         case Object:
-            ss << "{";
+            out += '{';
             {
                 bool first = true;
                 for (const auto& [key, value] : objectValues) {
-                    if (!first) ss << ",";
+                    if (!first) out += ',';
                     first = false;
-                    ss << "\"" << key << "\":" << value.toJsonString();
+                    out += '"';
+                    out += key;
+                    out += "\":";
+                    value.appendJson(out);
                 }
             }
-            ss << "}";
+            out += '}';
             break;
     }
-    
-    return ss.str();
+}
+
+size_t SimpleJson::jsonLength() const {
+    size_t length = 0;
+    switch (type) {
+        case Null:
+            length = 4;
+            break;
+        case Boolean:
+            length = boolValue ? 4 : 5;
+            break;
+        case Number:
+            length = formatNumber(numberValue).size();
+            break;
+        case String:
+            length = stringValue.size() + 2;
+            for (char c : stringValue) {
+                if (c == '\"' || c == '\\') {
+                    length++;
+                }
+            }
+            break;
+        case Array:
+            // Brackets and the commas between items
+            length = 2 + (arrayValues.empty() ? 0 : arrayValues.size() - 1);
+            for (const auto& value : arrayValues) {
+                length += value.jsonLength();
+            }
+            break;
+        case Object:
+            // Braces and the commas between members
+            length = 2 + (objectValues.empty() ? 0 : objectValues.size() - 1);
+            for (const auto& [key, value] : objectValues) {
+                length += key.size() + 3 + value.jsonLength();
+            }
+            break;
+    }
+    return length;
 }
 
 void LLMApi::setApiKey(const std::string& apiKey) {
+    if (apiKey == this->apiKey) {
+        return;
+    }
     this->apiKey = apiKey;
+    
+    // The model list may differ for another account
+    ModelCatalog::getInstance().invalidate(getName());
 }
 
 void LLMApi::setEndpoint(const std::string& endpoint) {
+    if (endpoint == this->endpoint) {
+        return;
+    }
     this->endpoint = endpoint;
+    
+    // Models cached for the old endpoint are no use
+    ModelCatalog::getInstance().invalidate(getName());
 }
 
 std::string LLMApi::getApiKey() const {
@@ -66,9 +171,21 @@ std::string LLMApi::getEndpoint() const {
     return endpoint;
 }
 
-void LLMApi::sendChatRequest(const std::vector<Message>& messages, 
+std::vector<std::string> LLMApi::getAvailableModels() {
+    return ModelCatalog::getInstance().getModels(shared_from_this());
+}
+
+std::map<std::string, std::string> LLMApi::getModelsHeaders() const {
+    return {};
+}
+
+std::vector<std::string> LLMApi::getDefaultModels() const {
+    return {};
+}
+
+std::shared_ptr<CancellationToken> LLMApi::sendChatRequest(const std::vector<Message>& messages, 
                            const std::string& model,
-                           const std::function<void(const std::string&, bool)>& callback) {
+                           const ResponseCallback& callback) {
     // Default implementation: extract the last user message and send it
     std::string lastUserMessage;
     
@@ -83,11 +200,113 @@ void LLMApi::sendChatRequest(const std::vector<Message>& messages,
     // If no user message found, return an error
     if (lastUserMessage.empty()) {
         callback("Error: No user message found", true);
-        return;
+        return nullptr;
     }
     
     // Send the message
-    sendMessage(lastUserMessage, model, callback);
+    return sendMessage(lastUserMessage, model, callback);
+}
+
+std::string_view LLMApi::findJsonString(std::string_view json, std::string_view key,
+                                        std::string& scratch, size_t from) {
+    // Look for "key" followed by a colon, so a longer key ending in it doesn't match
+    size_t pos = from;
+    size_t valueStart = std::string_view::npos;
+    while ((pos = json.find(key, pos)) != std::string_view::npos) {
+        size_t end = pos + key.size();
+        if (pos > 0 && json[pos - 1] == '"' && end < json.size() && json[end] == '"') {
+            size_t colon = json.find_first_not_of(" \t\r\n", end + 1);
+            if (colon != std::string_view::npos && json[colon] == ':') {
+                valueStart = json.find_first_not_of(" \t\r\n", colon + 1);
+                break;
+            }
+        }
+        pos = end;
+    }
+    
+    // null, numbers and objects aren't strings
+    if (valueStart == std::string_view::npos || json[valueStart] != '"') {
+        return std::string_view();
+    }
+    
+    // Find the closing quote, skipping escaped ones
+    size_t quoteEnd = valueStart + 1;
+    bool escaped = false;
+    while (quoteEnd < json.size() && json[quoteEnd] != '"') {
+        escaped = escaped || json[quoteEnd] == '\\';
+        quoteEnd += json[quoteEnd] == '\\' ? 2 : 1;
+    }
+    if (quoteEnd >= json.size()) {
+        return std::string_view();
+    }
+    std::string_view value = json.substr(valueStart + 1, quoteEnd - valueStart - 1);
+    
+    // Most values have nothing to unescape
+    if (!escaped) {
+        return value;
+    }
+    
+    // Unescape into the reused scratch string
+    scratch.clear();
+    for (size_t i = 0; i < value.size(); ++i) {
+        if (value[i] != '\\' || i + 1 >= value.size()) {
+            scratch += value[i];
+            continue;
+        }
+        char c = value[++i];
+        if (c == 'n') {
+            scratch += '\n';
+        } else if (c == 'r') {
+            scratch += '\r';
+        } else if (c == 't') {
+            scratch += '\t';
+        } else if (c == 'b') {
+            scratch += '\b';
+        } else if (c == 'f') {
+            scratch += '\f';
+        } else if (c == 'u') {
+            long codePoint = readHex4(value.substr(i + 1));
+            if (codePoint < 0) {
+                scratch += c;
+                continue;
+            }
+            i += 4;
+            
+            // Characters outside the BMP come as a surrogate pair
+            if (codePoint >= 0xD800 && codePoint < 0xDC00 && value.substr(i + 1, 2) == "\\u") {
+                long low = readHex4(value.substr(i + 3));
+                if (low >= 0xDC00 && low < 0xE000) {
+                    codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                    i += 6;
+                }
+            }
+            appendUtf8(scratch, static_cast<unsigned>(codePoint));
+        } else {
+            scratch += c;
+        }
+    }
+    return scratch;
+}
+
+bool LLMApi::handleChatCompletionEvent(std::string_view data, std::string& scratch,
+                                       const ResponseCallback& callback) {
+    size_t delta = data.find("\"delta\"");
+    if (delta == std::string_view::npos) {
+        // An error after the stream started comes as an event of its own
+        if (data.find("\"error\"") != std::string_view::npos) {
+            std::string_view message = findJsonString(data, "message", scratch);
+            callback("Error: " + std::string(message.empty() ? data : message), true);
+            return false;
+        }
+        return true;
+    }
+    
+    // The first and last deltas carry no text
+    std::string_view content = findJsonString(data, "content", scratch, delta);
+    if (!content.empty()) {
+        callback(content, false);
+    }
+    return true;
 }
 
 void LLMApi::cancelRequest() {
@@ -0,0 +1,48 @@
+#include "LineSplitter.h"
+
+namespace {
+
+// Drop the "\r" of a "\r\n" line ending
+std::string_view trimLine(std::string_view line) {
+    if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+    }
+    return line;
+}
+
+}
+
+bool LineSplitter::feed(std::string_view data, const LineCallback& onLine) {
+    while (!data.empty()) {
+        size_t newline = data.find('\n');
+        if (newline == std::string_view::npos) {
+            // Keep the start of the line until the rest arrives
+            partial.append(data.data(), data.size());
+            return true;
+        }
+
+        bool keepGoing;
+        if (partial.empty()) {
+            keepGoing = onLine(trimLine(data.substr(0, newline)));
+        } else {
+            // Complete the line started by an earlier chunk
+            partial.append(data.data(), newline);
+            keepGoing = onLine(trimLine(partial));
+            partial.clear();
+        }
+        if (!keepGoing) {
+            return false;
+        }
+        data.remove_prefix(newline + 1);
+    }
+    return true;
+}
+
+bool LineSplitter::finish(const LineCallback& onLine) {
+    if (partial.empty()) {
+        return true;
+    }
+    std::string line;
+    line.swap(partial);
+    return onLine(trimLine(line));
+}
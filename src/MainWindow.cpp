@@ -1,6 +1,7 @@
 #include "MainWindow.h"
 #include "ApiManager.h"
 #include "Config.h"
+#include "RequestMetrics.h"
 #include <iostream>
 #include <gtkmm/filechooserdialog.h>
 #include <gtkmm/messagedialog.h>
@@ -41,6 +42,7 @@ MainWindow::MainWindow()
     fileMenu.items().push_back(quitMenuItem);
     
     // Add items to help menu
+    helpMenu.items().push_back(timingsMenuItem);
     helpMenu.items().push_back(aboutMenuItem);
     
     // Set up menu items
@@ -52,6 +54,8 @@ MainWindow::MainWindow()
     loadMenuItem.set_use_underline(true);
     quitMenuItem.set_label("_Quit");
     quitMenuItem.set_use_underline(true);
+    timingsMenuItem.set_label("Request _Timings");
+    timingsMenuItem.set_use_underline(true);
     aboutMenuItem.set_label("_About");
     aboutMenuItem.set_use_underline(true);
     
@@ -85,6 +89,7 @@ MainWindow::MainWindow()
     settingsMenuItem.signal_activate().connect(sigc::mem_fun(*this, &MainWindow::onSettingsClicked));
     saveMenuItem.signal_activate().connect(sigc::mem_fun(*this, &MainWindow::onSaveClicked));
     loadMenuItem.signal_activate().connect(sigc::mem_fun(*this, &MainWindow::onLoadClicked));
+    timingsMenuItem.signal_activate().connect(sigc::mem_fun(*this, &MainWindow::onTimingsClicked));
     aboutMenuItem.signal_activate().connect(sigc::mem_fun(*this, &MainWindow::onAboutClicked));
     quitMenuItem.signal_activate().connect(sigc::mem_fun(*this, &MainWindow::onQuitClicked));
     modelSelector.signal_api_config_changed().connect(sigc::mem_fun(*this, &MainWindow::onApiConfigChanged));
@@ -92,6 +97,13 @@ MainWindow::MainWindow()
     // Load last used model
     loadLastUsedModel();
     
+    // Connect to the last used API while the window is drawing
+    ApiManager::getInstance().prewarm([this]() {
+        if (Config::getInstance().getPrewarmModels()) {
+            modelSelector.refreshModels();
+        }
+    });
+    
     // Show all widgets
     show_all_children();
 }
@@ -170,6 +182,13 @@ void MainWindow::onLoadClicked() {
     }
 }
 
+void MainWindow::onTimingsClicked() {
+    // Show the timing percentiles of each provider's recent requests
+    Gtk::MessageDialog dialog(*this, "Request timings");
+    dialog.set_secondary_text("<tt>" + Glib::Markup::escape_text(RequestMetrics::getInstance().dump()) + "</tt>", true);
+    dialog.run();
+}
+
 void MainWindow::onAboutClicked() {
     // Show about dialog
     aboutDialog.show();
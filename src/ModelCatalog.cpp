@@ -0,0 +1,136 @@
+#include "ModelCatalog.h"
+#include <iostream>
+
+namespace {
+
+// A failed fetch is tried again after this, or the TTL if shorter
+const std::chrono::seconds failureRetryDelay(30);
+
+}
+
+ModelCatalog::ModelCatalog() : ttl(std::chrono::minutes(10)), fetchCount(0) {
+    // Model lists are small; don't let a slow server hold a fetch for long
+    RequestTimeouts timeouts;
+    timeouts.total = std::chrono::seconds(30);
+    httpClient.setTimeouts(timeouts);
+}
+
+ModelCatalog& ModelCatalog::getInstance() {
+    static ModelCatalog instance;
+    return instance;
+}
+
+std::vector<std::string> ModelCatalog::getModels(const std::shared_ptr<LLMApi>& api) {
+    std::string name = api->getName();
+    std::string url = api->getModelsUrl();
+
+    // Without a way to list them there are only the defaults
+    if (url.empty()) {
+        invalidate(name);
+        return api->getDefaultModels();
+    }
+
+    std::string source = url;
+    for (const auto& [header, value] : api->getModelsHeaders()) {
+        source += "\n" + header + ": " + value;
+    }
+
+    // A list from another endpoint or account doesn't count
+    Entry& entry = entries[name];
+    if (entry.source != source) {
+        invalidate(name);
+        Entry& fresh = entries[name];
+        fresh.source = source;
+        fetch(api, fresh);
+        return fresh.loaded ? fresh.models : api->getDefaultModels();
+    }
+
+    if (!entry.request && isStale(entry)) {
+        fetch(api, entry);
+    }
+    return entry.loaded ? entry.models : api->getDefaultModels();
+}
+
+void ModelCatalog::fetch(const std::shared_ptr<LLMApi>& api, Entry& entry) {
+    std::string name = api->getName();
+    unsigned long generation = entry.generation = ++fetchCount;
+    std::weak_ptr<LLMApi> weakApi = api;
+
+    httpClient.clearHeaders();
+    for (const auto& [header, value] : api->getModelsHeaders()) {
+        httpClient.setHeader(header, value);
+    }
+
+    try {
+        auto request = httpClient.getAsync(api->getModelsUrl(),
+            [this, name, generation, weakApi](const AsyncRequest::Result& result) {
+                auto it = entries.find(name);
+                if (result.cancelled || it == entries.end() || it->second.generation != generation) {
+                    return;
+                }
+                Entry& entry = it->second;
+                entry.request.reset();
+
+                auto api = weakApi.lock();
+                entry.fetched = std::chrono::steady_clock::now();
+                entry.failed = !api || !result.ok();
+                if (entry.failed) {
+                    // Keep serving what there is and try again later
+                    std::cerr << "Error fetching models for " << name << ": " << result.error << std::endl;
+                    return;
+                }
+
+                std::vector<std::string> models = api->parseModelsResponse(result.body);
+                if (models.empty()) {
+                    models = api->getDefaultModels();
+                }
+
+                bool changed = !entry.loaded || models != entry.models;
+                entry.models = std::move(models);
+                entry.loaded = true;
+                if (changed) {
+                    modelsChanged.emit(name);
+                }
+            });
+
+        // A request that failed right away has already been handled
+        if (!request->isFinished()) {
+            entry.request = request;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error fetching models for " << name << ": " << e.what() << std::endl;
+        entry.request.reset();
+        entry.fetched = std::chrono::steady_clock::now();
+        entry.failed = true;
+    }
+}
+
+bool ModelCatalog::isStale(const Entry& entry) const {
+    if (!entry.loaded && !entry.failed) {
+        return true;
+    }
+    auto age = std::chrono::steady_clock::now() - entry.fetched;
+    return age >= (entry.failed ? std::min(ttl, failureRetryDelay) : ttl);
+}
+
+void ModelCatalog::invalidate(const std::string& apiName) {
+    auto it = entries.find(apiName);
+    if (it == entries.end()) {
+        return;
+    }
+
+    // Take the entry out first, since cancelling may complete the request
+    std::shared_ptr<AsyncRequest> request = std::move(it->second.request);
+    entries.erase(it);
+    if (request) {
+        request->cancel();
+    }
+}
+
+void ModelCatalog::setTtl(std::chrono::seconds ttl) {
+    this->ttl = ttl;
+}
+
+sigc::signal<void, const std::string&> ModelCatalog::signal_models_changed() {
+    return modelsChanged;
+}
@@ -1,5 +1,6 @@
 #include "ModelSelector.h"
 #include "ApiManager.h"
+#include "ModelCatalog.h"
 #include <iostream>
 
 ModelSelector::ModelSelector() : 
@@ -60,6 +61,7 @@ ModelSelector::ModelSelector() :
     // Connect signals
     apiComboBox.signal_changed().connect(sigc::mem_fun(*this, &ModelSelector::onApiChanged));
     saveButton.signal_clicked().connect(sigc::mem_fun(*this, &ModelSelector::onSaveClicked));
+    ModelCatalog::getInstance().signal_models_changed().connect(sigc::mem_fun(*this, &ModelSelector::onModelsChanged));
     
     // Populate API ComboBox
     populateApiComboBox();
@@ -140,6 +142,16 @@ void ModelSelector::onSaveClicked() {
     config->setApiKey(apiName, apiKeyEntry.get_text());
     config->setEndpoint(apiName, endpointEntry.get_text());
     
+    // Apply them to the API, which drops its cached models if they changed
+    auto api = ApiManager::getInstance().getApi(apiName);
+    if (api) {
+        api->setApiKey(apiKeyEntry.get_text());
+        if (!endpointEntry.get_text().empty()) {
+            api->setEndpoint(endpointEntry.get_text());
+        }
+    }
+    refreshModels();
+    
     // Save selected model
     config->setLastUsedModel(apiName, modelName);
     
@@ -150,6 +162,19 @@ void ModelSelector::onSaveClicked() {
     m_signal_api_config_changed.emit();
 }
 
+void ModelSelector::onModelsChanged(const std::string& changedApiName) {
+    // A fetch finished; show the new list if it is for the selected API
+    if (changedApiName == apiName) {
+        populateModelComboBox(apiName);
+    }
+}
+
+void ModelSelector::refreshModels() {
+    if (!apiName.empty()) {
+        populateModelComboBox(apiName);
+    }
+}
+
 void ModelSelector::populateApiComboBox() {
     // Clear list store
     apiListStore->clear();
@@ -171,7 +196,8 @@ void ModelSelector::populateModelComboBox(const std::string& apiName) {
     // Clear list store
     modelListStore->clear();
     
-    // Get available models for this API
+    // Get available models for this API; a missing or stale list is
+    // fetched in the background and shown by onModelsChanged
     auto& apiManager = ApiManager::getInstance();
     auto api = apiManager.getApi(apiName);
     
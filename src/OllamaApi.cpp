@@ -1,38 +1,32 @@
 #include "OllamaApi.h"
+#include "LineSplitter.h"
 #include <sstream>
 #include <iostream>
 
-OllamaApi::OllamaApi() : cancelRequestFlag(false) {
+OllamaApi::OllamaApi() {
     // Set default endpoint
     setEndpoint("http://localhost:11434");
+    
+    // Loading a model can take a while before the first token arrives
+    RequestTimeouts timeouts;
+    timeouts.firstByte = std::chrono::minutes(5);
+    httpClient.setTimeouts(timeouts);
+    
+    // Record request timings under the provider's name
+    httpClient.setMetricsLabel(getName());
 }
 
 OllamaApi::~OllamaApi() {
-    // Cleanup thread
-    cleanupThread();
+    // Stop the request in flight
+    cancelRequest();
 }
 
-std::vector<std::string> OllamaApi::getAvailableModels() {
-    std::vector<std::string> models;
-    
-    try {
-        // Create URL
-        std::string url = getEndpoint() + "/api/tags";
-        
-        // Perform request
-        std::string response = performHttpRequest(url, "");
-        
-        // Parse response
-        models = parseModelsResponse(response);
-    } catch (const std::exception& e) {
-        std::cerr << "Error fetching models: " << e.what() << std::endl;
-    }
-    
-    return models;
+std::string OllamaApi::getModelsUrl() const {
+    return getEndpoint() + "/api/tags";
 }
 
-void OllamaApi::sendMessage(const std::string& message, const std::string& model, 
-                          const std::function<void(const std::string&, bool)>& callback) {
+std::shared_ptr<CancellationToken> OllamaApi::sendMessage(const std::string& message, const std::string& model, 
+                          const ResponseCallback& callback) {
     // Create a single message
     std::vector<Message> messages;
     Message userMessage;
@@ -41,127 +35,104 @@ void OllamaApi::sendMessage(const std::string& message, const std::string& model
     messages.push_back(userMessage);
     
     // Send the message
-    sendChatRequest(messages, model, callback);
+    return sendChatRequest(messages, model, callback);
 }
 
-void OllamaApi::sendChatRequest(const std::vector<Message>& messages, 
+std::shared_ptr<CancellationToken> OllamaApi::sendChatRequest(const std::vector<Message>& messages, 
                                const std::string& model,
-                               const std::function<void(const std::string&, bool)>& callback) {
-    // Cleanup any existing thread
-    cleanupThread();
+                               const ResponseCallback& callback) {
+    // Create URL
+    std::string url = getEndpoint() + "/api/chat";
     
-    // Reset cancel flag
-    cancelRequestFlag = false;
+    // Create request payload
+    SimpleJson payload = createRequestPayload(messages, model);
     
-    // Create a new thread for the request
-    requestThread = std::thread([this, messages, model, callback]() {
-        try {
-            // Create URL
-            std::string url = getEndpoint() + "/api/chat";
-            
-            // Create request payload
-            SimpleJson payload = createRequestPayload(messages, model);
-            
-            // Convert to string
-            std::string jsonPayload = payload.toJsonString();
-            
-            // Set content type
-            httpClient.clearHeaders();
-            httpClient.setHeader("Content-Type", "application/json");
-            
-            // Use streaming response
-            std::string buffer;
-            
-            // Make the request with streaming response
-            httpClient.postStreaming(
-                url, 
-                jsonPayload,
-                [&buffer, &callback, this](const std::string& chunk) -> bool {
-                    // Check if request was cancelled
-                    if (cancelRequestFlag) {
-                        return false;
+    // Serialize while sending, so a long history starts going out before
+    // all of it has been converted; only its length is worked out up front
+    auto body = std::make_shared<JsonBodyProducer>(std::move(payload));
+    
+    // Wait for room under any rate limits configured for the model
+    httpClient.setAdmission(getName(), model, RateLimiter::estimateTokens(static_cast<size_t>(body->length())));
+    
+    // Set content type
+    httpClient.clearHeaders();
+    httpClient.setHeader("Content-Type", "application/json");
+    
+    // Partial line carried between chunks, scratch space for unescaping,
+    // and whether the final message was seen
+    auto lines = std::make_shared<LineSplitter>();
+    auto unescaped = std::make_shared<std::string>();
+    auto done = std::make_shared<bool>(false);
+    
+    try {
+        // Make the request with streaming response on the main loop
+        auto request = httpClient.postStreamingAsync(
+            url, 
+            body,
+            [lines, unescaped, done, callback](std::string_view chunk) -> bool {
+                // Ignore anything after the final message
+                if (*done) {
+                    return true;
+                }
+                
+                // Chunks are decoded payload and may end mid-line; whole
+                // lines are parsed in place, a cut one is kept until the
+                // rest arrives
+                lines->feed(chunk, [unescaped, done, &callback](std::string_view line) {
+                    if (line.empty()) {
+                        return true;
                     }
                     
-                    buffer += chunk;
+                    // Here we're looking for JSON in the format:
+                    // {"message":{"content":"text"},"done":false|true}
                     
-                    // Process buffer line by line
-                    size_t pos = 0;
-                    while ((pos = buffer.find("\n")) != std::string::npos) {
-                        std::string line = buffer.substr(0, pos);
-                        buffer.erase(0, pos + 1);
-                        
-                        if (line.empty()) continue;
+                    // Simple JSON parsing for "done" field
+                    size_t donePos = line.find("\"done\":");
+                    if (donePos != std::string_view::npos) {
+                        size_t valueStart = donePos + 7; // Length of "done":
+                        bool isDone = (line.find("true", valueStart) != std::string_view::npos);
                         
-                        // Try to parse as JSON
-                        try {
-                            // Here we're looking for JSON in the format:
-                            // {"message":{"content":"text"},"done":false|true}
-                            
-                            // Simple JSON parsing for "done" field
-                            size_t donePos = line.find("\"done\":");
-                            if (donePos != std::string::npos) {
-                                size_t valueStart = donePos + 7; // Length of "done":
-                                bool isDone = (line.find("true", valueStart) != std::string::npos);
-                                
-                                if (isDone) {
-                                    callback("", true);
-                                    return true;
-                                }
-                            }
-                            
-                            // Simple JSON parsing for message content
-                            size_t contentPos = line.find("\"content\":");
-                            if (contentPos != std::string::npos) {
-                                size_t valueStart = contentPos + 10; // Length of "content":
-                                
-                                // Find the opening quote
-                                size_t quoteStart = line.find("\"", valueStart);
-                                if (quoteStart != std::string::npos) {
-                                    size_t quoteEnd = line.find("\"", quoteStart + 1);
-                                    if (quoteEnd != std::string::npos) {
-                                        std::string content = line.substr(quoteStart + 1, quoteEnd - quoteStart - 1);
-                                        
-                                        // Unescape JSON string
-                                        std::string unescaped;
-                                        for (size_t i = 0; i < content.length(); ++i) {
-                                            if (content[i] == '\\' && i + 1 < content.length()) {
-                                                if (content[i + 1] == 'n') {
-                                                    unescaped += '\n';
-                                                } else if (content[i + 1] == 'r') {
-                                                    unescaped += '\r';
-                                                } else if (content[i + 1] == 't') {
-                                                    unescaped += '\t';
-                                                } else if (content[i + 1] == '\"') {
-                                                    unescaped += '\"';
-                                                } else if (content[i + 1] == '\\') {
-                                                    unescaped += '\\';
-                                                } else {
-                                                    unescaped += content[i + 1];
-                                                }
-                                                i++; // Skip the escaped character
-                                            } else {
-                                                unescaped += content[i];
-                                            }
-                                        }
-                                        
-                                        callback(unescaped, false);
-                                    }
-                                }
-                            }
-                        } catch (const std::exception& e) {
-                            std::cerr << "Error parsing response: " << e.what() << std::endl;
+                        if (isDone) {
+                            *done = true;
+                            callback("", true);
+                            return false;
                         }
                     }
                     
+                    // Message content, unescaped only when it has escapes
+                    std::string_view content = findJsonString(line, "content", *unescaped);
+                    if (!content.empty()) {
+                        callback(content, false);
+                    }
                     return true;
+                });
+                
+                return true;
+            },
+            [done, callback](const AsyncRequest::Result& result) {
+                // Cancelled requests end silently
+                if (result.cancelled || *done) {
+                    return;
                 }
-            );
-            
-        } catch (const std::exception& e) {
-            // Handle errors
-            callback("Error: " + std::string(e.what()), true);
-        }
-    });
+                
+                if (!result.ok()) {
+                    callback("Error: " + result.error, true);
+                    return;
+                }
+                
+                // The stream ended without a final message
+                callback("", true);
+            }
+        );
+        
+        // Keep it alive until it finishes, alongside any others
+        requests.add(request);
+        return request->getToken();
+    } catch (const std::exception& e) {
+        // Handle errors
+        callback("Error: " + std::string(e.what()), true);
+        return nullptr;
+    }
 }
 
 bool OllamaApi::isConfigured() const {
@@ -170,29 +141,11 @@ bool OllamaApi::isConfigured() const {
 }
 
 void OllamaApi::cancelRequest() {
-    // Set the cancel flag
-    cancelRequestFlag = true;
-    
     // Cancel any ongoing HTTP request
+    requests.cancelAll();
     httpClient.cancelRequest();
 }
 
-void OllamaApi::cleanupThread() {
-    // Check if thread is running
-    if (requestThread.joinable()) {
-        {
-            std::lock_guard<std::mutex> lock(threadMutex);
-            cancelRequestFlag = true;
-        }
-        
-        // Cancel any ongoing HTTP request
-        httpClient.cancelRequest();
-        
-        // Wait for thread to finish
-        requestThread.join();
-    }
-}
-
 SimpleJson OllamaApi::createRequestPayload(const std::vector<Message>& messages, const std::string& model) {
     SimpleJson payload;
     
@@ -3,14 +3,17 @@
 #include <iostream>
 #include <regex>
 
-OpenRouterApi::OpenRouterApi() : cancelRequestFlag(false) {
+OpenRouterApi::OpenRouterApi() {
     // Set default endpoint
     setEndpoint("https://openrouter.ai/api/v1");
+    
+    // Record request timings under the provider's name
+    httpClient.setMetricsLabel(getName());
 }
 
 OpenRouterApi::~OpenRouterApi() {
-    // Cleanup thread
-    cleanupThread();
+    // Stop the request in flight
+    cancelRequest();
 }
 
 void OpenRouterApi::setApiKey(const std::string& apiKey) {
@@ -25,33 +28,16 @@ std::string OpenRouterApi::getName() const {
     return "OpenRouter";
 }
 
-std::vector<std::string> OpenRouterApi::getAvailableModels() {
-    if (!availableModels.empty()) {
-        return availableModels;
-    }
+std::string OpenRouterApi::getModelsUrl() const {
+    return getEndpoint() + "/models";
+}
 
-    try {
-        // Create URL
-        std::string url = getEndpoint() + "/models";
-        
-        // Set headers
-        httpClient.clearHeaders();
-        httpClient.setHeader("Authorization", "Bearer " + getApiKey());
-        
-        // Perform request
-        std::string response = httpClient.get(url);
-        
-        // Parse response
-        availableModels = parseModelsResponse(response);
-    } catch (const std::exception& e) {
-        std::cerr << "Error fetching models: " << e.what() << std::endl;
-    }
-    
-    return availableModels;
+std::map<std::string, std::string> OpenRouterApi::getModelsHeaders() const {
+    return {{"Authorization", "Bearer " + getApiKey()}};
 }
 
-void OpenRouterApi::sendMessage(const std::string& message, const std::string& model, 
-                            const std::function<void(const std::string&, bool)>& callback) {
+std::shared_ptr<CancellationToken> OpenRouterApi::sendMessage(const std::string& message, const std::string& model, 
+                            const ResponseCallback& callback) {
     // Create a message vector with a single user message
     std::vector<Message> messages;
     Message userMessage;
@@ -60,49 +46,67 @@ void OpenRouterApi::sendMessage(const std::string& message, const std::string& m
     messages.push_back(userMessage);
     
     // Call the chat request method
-    sendChatRequest(messages, model, callback);
+    return sendChatRequest(messages, model, callback);
 }
 
-void OpenRouterApi::sendChatRequest(const std::vector<Message>& messages, 
+std::shared_ptr<CancellationToken> OpenRouterApi::sendChatRequest(const std::vector<Message>& messages, 
                                 const std::string& model,
-                                const std::function<void(const std::string&, bool)>& callback) {
-    // Clean up any previous request
-    cleanupThread();
-    
-    // Reset cancel flag
-    cancelRequestFlag = false;
-    
-    // Create a new thread for the request
-    requestThread = std::thread([this, messages, model, callback]() {
-        try {
-            // Create URL
-            std::string url = getEndpoint() + "/chat/completions";
-            
-            // Create payload
-            SimpleJson payload = createRequestPayload(messages, model);
-            
-            // Convert to string
-            std::string jsonPayload = payload.toJsonString();
-            
-            // Set headers
-            httpClient.clearHeaders();
-            httpClient.setHeader("Content-Type", "application/json");
-            httpClient.setHeader("Authorization", "Bearer " + getApiKey());
-            
-            // Perform request
-            std::string response = httpClient.post(url, jsonPayload);
-            
-            // Extract the content from the response
-            std::string content = parseCompletionResponse(response);
-            
-            // Send the response to the callback
-            callback(content, true);
-            
-        } catch (const std::exception& e) {
-            // Handle errors
-            callback("Error: " + std::string(e.what()), true);
-        }
-    });
+                                const ResponseCallback& callback) {
+    // Create URL
+    std::string url = getEndpoint() + "/chat/completions";
+    
+    // Create payload
+    SimpleJson payload = createRequestPayload(messages, model);
+    
+    // Serialize while sending, so a long history starts going out before
+    // all of it has been converted; only its length is worked out up front
+    auto body = std::make_shared<JsonBodyProducer>(std::move(payload));
+    
+    // Wait for room under the rate limits; the estimate includes the reply budget
+    httpClient.setAdmission(getName(), model, RateLimiter::estimateTokens(static_cast<size_t>(body->length())) + 500);
+    
+    // Set headers
+    httpClient.clearHeaders();
+    httpClient.setHeader("Content-Type", "application/json");
+    httpClient.setHeader("Authorization", "Bearer " + getApiKey());
+    httpClient.setHeader("Accept", "text/event-stream");
+    
+    // Scratch space for unescaping, reused across tokens, and whether an
+    // error event already ended the reply
+    auto unescaped = std::make_shared<std::string>();
+    auto done = std::make_shared<bool>(false);
+    
+    try {
+        // Stream the reply on the main loop; the parser puts events cut by
+        // chunk boundaries back together and skips keep-alive comments
+        auto request = httpClient.postEventStreamAsync(url, body,
+            [unescaped, done, callback](const SseParser::Event& event) {
+                *done = !handleChatCompletionEvent(event.data, *unescaped, callback);
+                return !*done;
+            },
+            [done, callback](const AsyncRequest::Result& result) {
+                // Cancelled requests end silently
+                if (result.cancelled || *done) {
+                    return;
+                }
+                
+                if (!result.ok()) {
+                    callback("Error: " + result.error, true);
+                    return;
+                }
+                
+                // The stream ended, with "[DONE]" or without
+                callback("", true);
+            });
+        
+        // Keep it alive until it finishes, alongside any others
+        requests.add(request);
+        return request->getToken();
+    } catch (const std::exception& e) {
+        // Handle errors
+        callback("Error: " + std::string(e.what()), true);
+        return nullptr;
+    }
 }
 
 std::string OpenRouterApi::performHttpRequest(const std::string& url, const std::string& jsonPayload) {
@@ -146,6 +150,9 @@ SimpleJson OpenRouterApi::createRequestPayload(const std::vector<Message>& messa
     payload.addToObject("top_p", SimpleJson(0.9));
     payload.addToObject("max_tokens", SimpleJson(500.0));
     
+    // Stream the reply as Server-Sent Events
+    payload.addToObject("stream", SimpleJson(true));
+    
     return payload;
 }
 
@@ -172,64 +179,11 @@ std::vector<std::string> OpenRouterApi::parseModelsResponse(const std::string& r
     return models;
 }
 
-std::string OpenRouterApi::parseCompletionResponse(const std::string& response) {
-    try {
-        // Simple parsing - look for the content in the response
-        std::regex contentRegex("\"content\"\\s*:\\s*\"((?:\\\\.|[^\"])*?)\"");
-        std::smatch match;
-        
-        if (std::regex_search(response, match, contentRegex) && match.size() > 1) {
-            std::string content = match[1].str();
-            
-            // Unescape JSON string
-            std::string unescaped;
-            for (size_t i = 0; i < content.length(); ++i) {
-                if (content[i] == '\\' && i + 1 < content.length()) {
-                    if (content[i + 1] == 'n') {
-                        unescaped += '\n';
-                    } else if (content[i + 1] == 'r') {
-                        unescaped += '\r';
-                    } else if (content[i + 1] == 't') {
-                        unescaped += '\t';
-                    } else if (content[i + 1] == '\"') {
-                        unescaped += '\"';
-                    } else if (content[i + 1] == '\\') {
-                        unescaped += '\\';
-                    } else {
-                        unescaped += content[i + 1];
-                    }
-                    i++; // Skip the escaped character
-                } else {
-                    unescaped += content[i];
-                }
-            }
-            
-            return unescaped;
-        }
-    } catch (const std::exception& e) {
-        std::cerr << "Error parsing completion response: " << e.what() << std::endl;
-    }
-    
-    return "";
-}
-
 bool OpenRouterApi::isConfigured() const {
     return !getApiKey().empty() && !getEndpoint().empty();
 }
 
 void OpenRouterApi::cancelRequest() {
-    cancelRequestFlag = true;
+    requests.cancelAll();
     httpClient.cancelRequest();
-}
-
-void OpenRouterApi::cleanupThread() {
-    if (requestThread.joinable()) {
-        {
-            std::lock_guard<std::mutex> lock(threadMutex);
-            cancelRequestFlag = true;
-        }
-        
-        httpClient.cancelRequest();
-        requestThread.join();
-    }
-} 
\ No newline at end of file
+} 
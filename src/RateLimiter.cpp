@@ -0,0 +1,248 @@
+#include "RateLimiter.h"
+#include "RetryPolicy.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+namespace {
+
+// Parse a header count; returns -1 if it isn't a number
+double parseCount(const std::string& value) {
+    char* end = nullptr;
+    double number = std::strtod(value.c_str(), &end);
+    return end != value.c_str() ? number : -1;
+}
+
+// The lower of two limits, where zero means no limit
+double tighter(double a, double b) {
+    if (a <= 0) {
+        return b;
+    }
+    if (b <= 0) {
+        return a;
+    }
+    return std::min(a, b);
+}
+
+}
+
+void RateLimiter::Bucket::setLimit(double perMinute, std::chrono::steady_clock::time_point now) {
+    refill(now);
+    if (this->perMinute <= 0) {
+        // A new limit starts with a full minute's worth
+        level = perMinute;
+    } else {
+        level = std::min(level, perMinute);
+    }
+    this->perMinute = perMinute;
+    refilled = now;
+}
+
+void RateLimiter::Bucket::refill(std::chrono::steady_clock::time_point now) {
+    if (perMinute > 0 && now > refilled) {
+        double elapsed = std::chrono::duration<double, std::milli>(now - refilled).count();
+        level = std::min(perMinute, level + elapsed * perMinute / 60000.0);
+    }
+    refilled = now;
+}
+
+std::chrono::milliseconds RateLimiter::Bucket::waitFor(double amount) const {
+    // A request larger than the whole bucket goes once the bucket is full
+    amount = std::min(amount, perMinute);
+    if (perMinute <= 0 || level >= amount) {
+        return std::chrono::milliseconds(0);
+    }
+    return std::chrono::milliseconds(static_cast<long long>(std::ceil((amount - level) * 60000.0 / perMinute)));
+}
+
+RateLimiter::RateLimiter() {
+}
+
+RateLimiter& RateLimiter::getInstance() {
+    static RateLimiter instance;
+    return instance;
+}
+
+RateLimiter::Queue& RateLimiter::getQueue(const std::string& provider, const std::string& model) {
+    auto now = std::chrono::steady_clock::now();
+    auto [it, created] = queues.try_emplace(provider + "/" + model);
+    Queue& queue = it->second;
+    if (created) {
+        queue.provider = provider;
+        queue.model = model;
+        queue.requests.refilled = now;
+        queue.tokens.refilled = now;
+    }
+
+    // Settings may change at any time; the server's limits only ever tighten them
+    Config::RateLimit configured = Config::getInstance().getRateLimit(provider, model);
+    double requestLimit = tighter(configured.requestsPerMinute, queue.serverLimits.requestsPerMinute);
+    double tokenLimit = tighter(configured.tokensPerMinute, queue.serverLimits.tokensPerMinute);
+    if (requestLimit != queue.requests.perMinute) {
+        queue.requests.setLimit(requestLimit, now);
+    }
+    if (tokenLimit != queue.tokens.perMinute) {
+        queue.tokens.setLimit(tokenLimit, now);
+    }
+    return queue;
+}
+
+std::shared_ptr<RateLimiter::Ticket> RateLimiter::admit(const std::string& provider, const std::string& model,
+                                                        long tokens, const std::function<void()>& ready) {
+    auto ticket = std::make_shared<Ticket>();
+    ticket->tokens = std::max(0L, tokens);
+    ticket->ready = ready;
+
+    Queue& queue = getQueue(provider, model);
+    queue.waiting.push_back(ticket);
+    drain(provider + "/" + model);
+    return ticket;
+}
+
+void RateLimiter::drain(const std::string& key) {
+    auto it = queues.find(key);
+    if (it == queues.end()) {
+        return;
+    }
+    Queue& queue = it->second;
+    queue.timer.disconnect();
+
+    while (!queue.waiting.empty()) {
+        auto ticket = queue.waiting.front().lock();
+        if (!ticket) {
+            // The caller gave up on it
+            queue.waiting.pop_front();
+            continue;
+        }
+
+        getQueue(queue.provider, queue.model);
+        auto now = std::chrono::steady_clock::now();
+        queue.requests.refill(now);
+        queue.tokens.refill(now);
+
+        std::chrono::milliseconds wait(0);
+        if (now < queue.blockedUntil) {
+            wait = std::chrono::duration_cast<std::chrono::milliseconds>(queue.blockedUntil - now) +
+                   std::chrono::milliseconds(1);
+        }
+        wait = std::max(wait, queue.requests.waitFor(1));
+        wait = std::max(wait, queue.tokens.waitFor(static_cast<double>(ticket->tokens)));
+
+        if (wait.count() > 0) {
+            std::cerr << "Rate limit for " << key << ": " << queue.waiting.size()
+                      << " request(s) waiting " << wait.count() << " ms" << std::endl;
+            queue.timer = Glib::signal_timeout().connect([this, key]() {
+                queues[key].timer = sigc::connection();
+                drain(key);
+                return false;
+            }, wait.count());
+            return;
+        }
+
+        if (queue.requests.perMinute > 0) {
+            queue.requests.level -= 1;
+        }
+        if (queue.tokens.perMinute > 0) {
+            queue.tokens.level -= std::min(static_cast<double>(ticket->tokens), queue.tokens.perMinute);
+        }
+        queue.waiting.pop_front();
+
+        // The callback may queue another request, so take it off the ticket first
+        std::function<void()> ready = std::move(ticket->ready);
+        ticket->ready = nullptr;
+        if (ready) {
+            ready();
+        }
+    }
+}
+
+void RateLimiter::update(const std::string& provider, const std::string& model,
+                         int statusCode, const HttpResponseParser::HeaderList& headers) {
+    double remainingRequests = -1;
+    double remainingTokens = -1;
+    Config::RateLimit reported;
+
+    for (const auto& [name, value] : headers) {
+        std::string lower = name;
+        for (auto& c : lower) {
+            c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+
+        // OpenAI style limits are per minute; OpenRouter only says what's left
+        if (lower == "x-ratelimit-limit-requests") {
+            reported.requestsPerMinute = parseCount(value);
+        } else if (lower == "x-ratelimit-limit-tokens") {
+            reported.tokensPerMinute = parseCount(value);
+        } else if (lower == "x-ratelimit-remaining-requests" || lower == "x-ratelimit-remaining") {
+            remainingRequests = parseCount(value);
+        } else if (lower == "x-ratelimit-remaining-tokens") {
+            remainingTokens = parseCount(value);
+        }
+    }
+
+    std::string key = provider + "/" + model;
+    Queue& queue = getQueue(provider, model);
+    if (reported.requestsPerMinute > 0 || reported.tokensPerMinute > 0) {
+        if (reported.requestsPerMinute > 0) {
+            queue.serverLimits.requestsPerMinute = reported.requestsPerMinute;
+        }
+        if (reported.tokensPerMinute > 0) {
+            queue.serverLimits.tokensPerMinute = reported.tokensPerMinute;
+        }
+        getQueue(provider, model);
+    }
+
+    // The server knows better how much is left
+    auto now = std::chrono::steady_clock::now();
+    queue.requests.refill(now);
+    queue.tokens.refill(now);
+    if (remainingRequests >= 0 && queue.requests.perMinute > 0) {
+        queue.requests.level = std::min(queue.requests.level, remainingRequests);
+    }
+    if (remainingTokens >= 0 && queue.tokens.perMinute > 0) {
+        queue.tokens.level = std::min(queue.tokens.level, remainingTokens);
+    }
+
+    // Hold everything back until the limit that ran out resets; the other
+    // bucket's reset may be minutes away and says nothing about this one
+    if (statusCode == 429 || remainingRequests == 0 || remainingTokens == 0) {
+        std::chrono::milliseconds delay(0);
+        bool known = statusCode == 429 ? RetryPolicy::serverDelay(statusCode, headers, delay)
+                                       : RetryPolicy::exhaustedReset(headers, delay);
+        if (!known && statusCode == 429) {
+            delay = std::chrono::seconds(1);
+        }
+        if (delay.count() > 0) {
+            queue.blockedUntil = std::max(queue.blockedUntil, now + delay);
+            std::cerr << "Rate limit for " << key << " exhausted, holding requests for "
+                      << delay.count() << " ms" << std::endl;
+        }
+    }
+
+    drain(key);
+}
+
+long RateLimiter::estimateTokens(const std::string& text) {
+    return estimateTokens(text.size());
+}
+
+long RateLimiter::estimateTokens(size_t length) {
+    // About four characters per token for English text and JSON
+    return static_cast<long>((length + 3) / 4);
+}
+
+size_t RateLimiter::getQueueLength(const std::string& provider, const std::string& model) const {
+    auto it = queues.find(provider + "/" + model);
+    if (it == queues.end()) {
+        return 0;
+    }
+    size_t count = 0;
+    for (const auto& ticket : it->second.waiting) {
+        if (!ticket.expired()) {
+            count++;
+        }
+    }
+    return count;
+}
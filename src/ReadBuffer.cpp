@@ -0,0 +1,157 @@
+#include "ReadBuffer.h"
+#include <atomic>
+#include <mutex>
+#include <cstring>
+#include <algorithm>
+
+namespace {
+
+std::atomic<unsigned long long> totalAllocations(0);
+std::atomic<unsigned long long> totalAllocatedBytes(0);
+std::atomic<unsigned long long> totalReused(0);
+std::atomic<unsigned long long> totalReads(0);
+
+// Idle buffers waiting for a new connection
+std::mutex freeListMutex;
+std::vector<ReadBuffer*> freeList;
+
+// Buffers beyond this many, or grown beyond this size, are freed instead
+const size_t maxFreeBuffers = 16;
+const size_t maxPooledCapacity = 256 * 1024;
+
+}
+
+ReadBuffer::ReadBuffer()
+    : start(0),
+      length(0),
+      readSize(minReadSize),
+      prepared(0),
+      smallReads(0) {
+    grow(minReadSize * 4);
+}
+
+std::shared_ptr<ReadBuffer> ReadBuffer::acquire() {
+    ReadBuffer* buffer = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(freeListMutex);
+        if (!freeList.empty()) {
+            buffer = freeList.back();
+            freeList.pop_back();
+        }
+    }
+
+    if (buffer) {
+        totalReused++;
+    } else {
+        buffer = new ReadBuffer();
+    }
+    return std::shared_ptr<ReadBuffer>(buffer, &ReadBuffer::recycle);
+}
+
+void ReadBuffer::recycle(ReadBuffer* buffer) {
+    buffer->clear();
+    buffer->readSize = minReadSize;
+    buffer->smallReads = 0;
+
+    if (buffer->storage.size() <= maxPooledCapacity) {
+        std::lock_guard<std::mutex> lock(freeListMutex);
+        if (freeList.size() < maxFreeBuffers) {
+            freeList.push_back(buffer);
+            return;
+        }
+    }
+    delete buffer;
+}
+
+ReadBuffer::Stats ReadBuffer::getStats() {
+    Stats stats;
+    stats.allocations = totalAllocations;
+    stats.allocatedBytes = totalAllocatedBytes;
+    stats.reused = totalReused;
+    stats.reads = totalReads;
+    return stats;
+}
+
+std::pair<char*, size_t> ReadBuffer::prepare() {
+    size_t capacity = storage.size();
+    size_t end = start + length;
+
+    // Free space right after the unread bytes, before wrapping or reaching them
+    size_t contiguous = end < capacity ? capacity - end : capacity - length;
+    if (end >= capacity) {
+        end -= capacity;
+    }
+
+    // Ask the socket for no less than half a read; otherwise make room
+    if (contiguous < readSize / 2 || contiguous == 0) {
+        grow(std::max(capacity * 2, length + readSize));
+        end = start + length;
+        contiguous = storage.size() - end;
+    }
+
+    prepared = std::min(contiguous, readSize);
+    return {storage.data() + end, prepared};
+}
+
+void ReadBuffer::commit(size_t count) {
+    length += count;
+    totalReads++;
+
+    // A full read means more is waiting; a run of small ones means the
+    // stream is trickling in and a smaller window is enough
+    if (count == prepared && readSize < maxReadSize) {
+        readSize *= 2;
+        smallReads = 0;
+    } else if (count < readSize / 4) {
+        if (++smallReads >= 4 && readSize > minReadSize) {
+            readSize /= 2;
+            smallReads = 0;
+        }
+    } else {
+        smallReads = 0;
+    }
+    prepared = 0;
+}
+
+std::string_view ReadBuffer::peek() const {
+    size_t contiguous = std::min(length, storage.size() - start);
+    return std::string_view(storage.data() + start, contiguous);
+}
+
+void ReadBuffer::consume(size_t count) {
+    count = std::min(count, length);
+    start += count;
+    if (start >= storage.size()) {
+        start -= storage.size();
+    }
+    length -= count;
+
+    // Restart at the front so the next read gets the longest free run
+    if (length == 0) {
+        start = 0;
+    }
+}
+
+void ReadBuffer::clear() {
+    start = 0;
+    length = 0;
+    prepared = 0;
+}
+
+void ReadBuffer::grow(size_t capacity) {
+    std::vector<char> larger(capacity);
+    totalAllocations++;
+    totalAllocatedBytes += capacity;
+
+    // Copy the unread bytes to the front, joining the two halves of a wrap
+    size_t first = std::min(length, storage.size() - start);
+    if (first > 0) {
+        std::memcpy(larger.data(), storage.data() + start, first);
+    }
+    if (length > first) {
+        std::memcpy(larger.data() + first, storage.data(), length - first);
+    }
+
+    storage.swap(larger);
+    start = 0;
+}
@@ -0,0 +1,251 @@
+#include "RequestMetrics.h"
+#include "TlsContext.h"
+#include "DnsCache.h"
+#include "ContentDecoder.h"
+#include "ReadBuffer.h"
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <iomanip>
+
+namespace {
+
+const std::chrono::microseconds unset(-1);
+
+// Nearest-rank percentile of sorted samples
+std::chrono::microseconds percentile(const std::vector<std::chrono::microseconds>& sorted, double p) {
+    size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+    return sorted[std::max<size_t>(rank, 1) - 1];
+}
+
+std::string formatMs(std::chrono::microseconds value) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1) << value.count() / 1000.0;
+    return out.str();
+}
+
+// Compressed and decoded bytes over all responses
+void dumpDecoding(std::ostream& out) {
+    ContentDecoder::Totals totals = ContentDecoder::getTotals();
+    out << "Compressed responses: " << totals.responses << ", " << totals.bytesIn << " bytes in, "
+        << totals.bytesOut << " bytes out";
+    if (totals.bytesIn > 0) {
+        out << std::fixed << std::setprecision(1) << " (" << static_cast<double>(totals.bytesOut) / totals.bytesIn
+            << "x)" << std::defaultfloat;
+    }
+    out << std::endl << std::endl;
+}
+
+// Read buffer allocations, which stay flat while the read count grows
+void dumpReadBuffers(std::ostream& out) {
+    ReadBuffer::Stats buffers = ReadBuffer::getStats();
+    out << "Read buffers: " << buffers.allocations << " allocations (" << buffers.allocatedBytes << " bytes), "
+        << buffers.reused << " reused, " << buffers.reads << " reads" << std::endl << std::endl;
+}
+
+// Handshake counts and times over all TLS connections
+void dumpTls(std::ostream& out) {
+    TlsContext::Stats tls = TlsContext::getInstance().getStats();
+    out << "TLS handshakes: " << tls.handshakes << " done, " << tls.failures << " failed" << std::endl;
+    if (tls.handshakes > 0) {
+        out << "  average " << formatMs(tls.averageHandshakeTime()) << " ms, slowest "
+            << formatMs(tls.maxHandshakeTime) << " ms" << std::endl;
+
+        // GLib doesn't say if a session was resumed; compare the two averages instead
+        out << "  offered a cached session: " << tls.sessionOffers << ", average "
+            << formatMs(tls.averageOfferedTime()) << " ms; fresh average "
+            << formatMs(tls.averageFreshTime()) << " ms" << std::endl;
+    }
+    out << std::endl;
+}
+
+// Resolver cache counts and connect times for each address tried
+void dumpDns(std::ostream& out) {
+    DnsCache::Stats dns = DnsCache::getInstance().getStats();
+    out << "DNS lookups: " << dns.hits << " cached, " << dns.misses << " resolved, "
+        << dns.failures << " failed" << std::endl;
+
+    std::map<std::string, DnsCache::AddressStats> addresses = DnsCache::getInstance().getAddressStats();
+    if (!addresses.empty()) {
+        out << std::left << std::setw(40) << "address" << std::right
+            << std::setw(8) << "tries" << std::setw(8) << "failed" << std::setw(10) << "avg" << std::setw(10) << "last" << std::endl;
+        for (const auto& [address, stats] : addresses) {
+            out << std::left << std::setw(40) << address << std::right
+                << std::setw(8) << stats.attempts << std::setw(8) << stats.failures;
+            if (stats.successes > 0) {
+                out << std::setw(10) << formatMs(stats.averageConnectTime())
+                    << std::setw(10) << formatMs(stats.lastConnectTime);
+            }
+            out << std::endl;
+        }
+    }
+    out << std::endl;
+}
+
+}
+
+RequestTiming::RequestTiming() {
+    start();
+}
+
+void RequestTiming::start() {
+    started = std::chrono::steady_clock::now();
+    phases.fill(unset);
+    reusedConnection = false;
+}
+
+void RequestTiming::mark(RequestPhase phase) {
+    auto& slot = phases[static_cast<size_t>(phase)];
+    if (slot == unset) {
+        slot = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started);
+    }
+}
+
+bool RequestTiming::reached(RequestPhase phase) const {
+    return phases[static_cast<size_t>(phase)] != unset;
+}
+
+std::chrono::microseconds RequestTiming::at(RequestPhase phase) const {
+    return phases[static_cast<size_t>(phase)];
+}
+
+const char* RequestTiming::phaseName(RequestPhase phase) {
+    switch (phase) {
+        case RequestPhase::Dns: return "dns";
+        case RequestPhase::Connect: return "connect";
+        case RequestPhase::Tls: return "tls";
+        case RequestPhase::RequestSent: return "request-sent";
+        case RequestPhase::FirstByte: return "first-byte";
+        case RequestPhase::FirstToken: return "first-token";
+        case RequestPhase::LastByte: return "last-byte";
+    }
+    return "unknown";
+}
+
+RequestMetrics::RequestMetrics() : windowSize(500) {
+}
+
+RequestMetrics& RequestMetrics::getInstance() {
+    static RequestMetrics instance;
+    return instance;
+}
+
+void RequestMetrics::record(const std::string& provider, const RequestTiming& timing) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Window& window = windows[provider];
+    window.last = timing;
+
+    for (size_t i = 0; i < RequestTiming::phaseCount; i++) {
+        if (timing.phases[i] == unset) {
+            continue;
+        }
+
+        // Once the window is full the oldest sample is overwritten
+        auto& samples = window.samples[i];
+        if (samples.size() < windowSize) {
+            samples.push_back(timing.phases[i]);
+        } else {
+            samples[window.next[i]] = timing.phases[i];
+            window.next[i] = (window.next[i] + 1) % windowSize;
+        }
+    }
+}
+
+RequestMetrics::Percentiles RequestMetrics::getPercentiles(const std::string& provider, RequestPhase phase) const {
+    std::vector<std::chrono::microseconds> sorted;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = windows.find(provider);
+        if (it == windows.end()) {
+            return Percentiles();
+        }
+        sorted = it->second.samples[static_cast<size_t>(phase)];
+    }
+
+    Percentiles result;
+    result.count = sorted.size();
+    if (sorted.empty()) {
+        return result;
+    }
+
+    std::sort(sorted.begin(), sorted.end());
+    result.p50 = percentile(sorted, 0.50);
+    result.p95 = percentile(sorted, 0.95);
+    result.p99 = percentile(sorted, 0.99);
+    return result;
+}
+
+bool RequestMetrics::getLast(const std::string& provider, RequestTiming& timing) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = windows.find(provider);
+    if (it == windows.end()) {
+        return false;
+    }
+    timing = it->second.last;
+    return true;
+}
+
+std::vector<std::string> RequestMetrics::getProviders() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::string> providers;
+    for (const auto& entry : windows) {
+        providers.push_back(entry.first);
+    }
+    return providers;
+}
+
+void RequestMetrics::setWindowSize(size_t size) {
+    std::lock_guard<std::mutex> lock(mutex);
+    windowSize = std::max<size_t>(size, 1);
+
+    // Keep the newest samples of windows that are now too large
+    for (auto& entry : windows) {
+        Window& window = entry.second;
+        for (size_t i = 0; i < RequestTiming::phaseCount; i++) {
+            auto& samples = window.samples[i];
+            std::rotate(samples.begin(), samples.begin() + window.next[i], samples.end());
+            if (samples.size() > windowSize) {
+                samples.erase(samples.begin(), samples.end() - windowSize);
+            }
+            window.next[i] = 0;
+        }
+    }
+}
+
+void RequestMetrics::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    windows.clear();
+}
+
+std::string RequestMetrics::dump() const {
+    std::ostringstream out;
+    std::vector<std::string> providers = getProviders();
+    if (providers.empty()) {
+        out << "No requests recorded" << std::endl << std::endl;
+    }
+
+    for (const auto& provider : providers) {
+        out << provider << " (ms since request start)" << std::endl;
+        out << std::left << std::setw(14) << "phase" << std::right
+            << std::setw(8) << "count" << std::setw(10) << "p50" << std::setw(10) << "p95" << std::setw(10) << "p99" << std::endl;
+        for (size_t i = 0; i < RequestTiming::phaseCount; i++) {
+            RequestPhase phase = static_cast<RequestPhase>(i);
+            Percentiles stats = getPercentiles(provider, phase);
+            out << std::left << std::setw(14) << RequestTiming::phaseName(phase) << std::right
+                << std::setw(8) << stats.count;
+            if (stats.count > 0) {
+                out << std::setw(10) << formatMs(stats.p50) << std::setw(10) << formatMs(stats.p95)
+                    << std::setw(10) << formatMs(stats.p99);
+            }
+            out << std::endl;
+        }
+        out << std::endl;
+    }
+
+    // Connection-level counters shared by every provider
+    dumpDns(out);
+    dumpTls(out);
+    dumpDecoding(out);
+    dumpReadBuffers(out);
+    return out.str();
+}
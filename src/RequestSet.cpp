@@ -0,0 +1,31 @@
+#include "RequestSet.h"
+#include <algorithm>
+
+void RequestSet::add(const std::shared_ptr<AsyncRequest>& request) {
+    prune();
+    if (request && !request->isFinished()) {
+        requests.push_back(request);
+    }
+}
+
+void RequestSet::cancelAll() {
+    // Cancelling may complete a request and start another, so work on a copy
+    std::vector<std::shared_ptr<AsyncRequest>> cancelled;
+    cancelled.swap(requests);
+    for (const auto& request : cancelled) {
+        request->cancel();
+    }
+}
+
+size_t RequestSet::size() {
+    prune();
+    return requests.size();
+}
+
+void RequestSet::prune() {
+    requests.erase(std::remove_if(requests.begin(), requests.end(),
+                                  [](const std::shared_ptr<AsyncRequest>& request) {
+                                      return request->isFinished();
+                                  }),
+                   requests.end());
+}
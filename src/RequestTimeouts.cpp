@@ -0,0 +1,91 @@
+#include "RequestTimeouts.h"
+
+TimeoutError::TimeoutError(TimeoutPhase phase, std::chrono::milliseconds limit)
+    : std::runtime_error(describe(phase, limit)),
+      phase(phase) {
+}
+
+std::string TimeoutError::describe(TimeoutPhase phase, std::chrono::milliseconds limit) {
+    std::string ms = std::to_string(limit.count()) + " ms";
+
+    switch (phase) {
+        case TimeoutPhase::Connect:
+            return "Timed out connecting after " + ms;
+        case TimeoutPhase::FirstByte:
+            return "Timed out waiting " + ms + " for the response";
+        case TimeoutPhase::Idle:
+            return "Timed out: no data received for " + ms;
+        case TimeoutPhase::Total:
+            return "Request did not finish within " + ms;
+        case TimeoutPhase::None:
+            break;
+    }
+    return "Timed out";
+}
+
+RequestDeadline::RequestDeadline(const RequestTimeouts& timeouts)
+    : timeouts(timeouts),
+      stage(Stage::Connecting),
+      started(std::chrono::steady_clock::now()),
+      stageStarted(started) {
+}
+
+void RequestDeadline::startConnect() {
+    stage = Stage::Connecting;
+    stageStarted = std::chrono::steady_clock::now();
+}
+
+void RequestDeadline::awaitResponse() {
+    stage = Stage::Waiting;
+    stageStarted = std::chrono::steady_clock::now();
+}
+
+void RequestDeadline::onData() {
+    stage = Stage::Receiving;
+    stageStarted = std::chrono::steady_clock::now();
+}
+
+bool RequestDeadline::next(std::chrono::steady_clock::time_point& when, TimeoutPhase& phase) const {
+    phase = TimeoutPhase::None;
+
+    TimeoutPhase stagePhase = TimeoutPhase::Connect;
+    if (stage == Stage::Waiting) {
+        stagePhase = TimeoutPhase::FirstByte;
+    } else if (stage == Stage::Receiving) {
+        stagePhase = TimeoutPhase::Idle;
+    }
+
+    std::chrono::milliseconds stageLimit = getLimit(stagePhase);
+    if (stageLimit.count() > 0) {
+        when = stageStarted + stageLimit;
+        phase = stagePhase;
+    }
+
+    if (timeouts.total.count() > 0 &&
+        (phase == TimeoutPhase::None || started + timeouts.total < when)) {
+        when = started + timeouts.total;
+        phase = TimeoutPhase::Total;
+    }
+
+    return phase != TimeoutPhase::None;
+}
+
+std::chrono::milliseconds RequestDeadline::getLimit(TimeoutPhase phase) const {
+    switch (phase) {
+        case TimeoutPhase::Connect:
+            return timeouts.connect;
+        case TimeoutPhase::FirstByte:
+            return timeouts.firstByte;
+        case TimeoutPhase::Idle:
+            return timeouts.idle;
+        case TimeoutPhase::Total:
+            return timeouts.total;
+        case TimeoutPhase::None:
+            break;
+    }
+    return std::chrono::milliseconds(0);
+}
+
+TimeoutError RequestDeadline::error(TimeoutPhase phase) const {
+    return TimeoutError(phase, getLimit(phase));
+}
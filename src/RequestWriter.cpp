@@ -0,0 +1,306 @@
+#include "RequestWriter.h"
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+struct RequestWriter::PendingWrite {
+    // Keeps the head and a shared body alive until the write completes
+    RequestWriter request;
+    Glib::RefPtr<Gio::OutputStream> stream;
+    Glib::RefPtr<Gio::Cancellable> cancellable;
+    WriteCallback callback;
+
+    // The vectors are updated in place by GIO as it makes progress
+    GOutputVector vectors[2];
+    size_t count;
+
+    // Next buffer to write when vectored writes aren't available
+    size_t next;
+
+    explicit PendingWrite(const RequestWriter& request)
+        : request(request),
+          count(0),
+          next(0) {
+        vectors[count].buffer = this->request.head.data();
+        vectors[count].size = this->request.head.size();
+        count++;
+        if (this->request.bodyLength > 0) {
+            vectors[count].buffer = this->request.bodyData;
+            vectors[count].size = this->request.bodyLength;
+            count++;
+        }
+    }
+};
+
+struct RequestWriter::ProducedWrite {
+    // Keeps the head and the producer alive until the write completes
+    RequestWriter request;
+    Glib::RefPtr<Gio::OutputStream> stream;
+    Glib::RefPtr<Gio::Cancellable> cancellable;
+    WriteCallback callback;
+
+    // Piece being written and its chunk size line
+    std::string piece;
+    std::string chunkSize;
+
+    // What has been done so far
+    bool headSent;
+    bool more;
+    long long produced;
+
+    // Buffers of the next write: head, chunk size, piece, chunk end
+    GOutputVector vectors[4];
+    size_t count;
+
+    // The buffers joined, when vectored writes aren't available
+    std::string joined;
+
+    explicit ProducedWrite(const RequestWriter& request)
+        : request(request),
+          headSent(false),
+          more(true),
+          produced(0),
+          count(0) {
+        this->request.producer->rewind();
+    }
+
+    // Produce the next piece and point the vectors at it. Returns false
+    // when everything has been written.
+    bool next() {
+        BodyProducer& producer = *request.producer;
+        long long length = producer.length();
+        count = 0;
+        while (count == 0 && (more || !headSent)) {
+            if (!headSent) {
+                vectors[count++] = {request.head.data(), request.head.size()};
+                headSent = true;
+            }
+
+            piece.clear();
+            more = producer.produce(piece);
+            produced += static_cast<long long>(piece.size());
+
+            if (length < 0) {
+                // Frame the piece as a chunk, and end the body after the last one
+                if (!piece.empty()) {
+                    char line[32];
+                    std::snprintf(line, sizeof(line), "%zx\r\n", piece.size());
+                    chunkSize = line;
+                    vectors[count++] = {chunkSize.data(), chunkSize.size()};
+                    vectors[count++] = {piece.data(), piece.size()};
+                }
+                const char* end = piece.empty() ? (more ? "" : "0\r\n\r\n")
+                                                : (more ? "\r\n" : "\r\n0\r\n\r\n");
+                if (*end) {
+                    vectors[count++] = {end, std::char_traits<char>::length(end)};
+                }
+            } else {
+                // A wrong length would break the connection for whatever follows
+                if (produced > length || (!more && produced != length)) {
+                    throw std::runtime_error("Request body doesn't match its length");
+                }
+                if (!piece.empty()) {
+                    vectors[count++] = {piece.data(), piece.size()};
+                }
+            }
+        }
+        return count > 0;
+    }
+};
+
+RequestWriter::RequestWriter(const std::string& head)
+    : head(head),
+      bodyData(nullptr),
+      bodyLength(0) {
+}
+
+RequestWriter::RequestWriter(const std::string& head, const Body& body)
+    : head(head),
+      bodyData(body ? body->data() : nullptr),
+      bodyLength(body ? body->size() : 0),
+      owner(body) {
+}
+
+RequestWriter::RequestWriter(const std::string& head, const std::string& body)
+    : head(head),
+      bodyData(body.data()),
+      bodyLength(body.size()) {
+}
+
+RequestWriter::RequestWriter(const std::string& head, const std::shared_ptr<BodyProducer>& producer)
+    : head(head),
+      bodyData(nullptr),
+      bodyLength(0),
+      producer(producer) {
+}
+
+size_t RequestWriter::size() const {
+    if (producer) {
+        return head.size() + static_cast<size_t>(std::max(producer->length(), 0LL));
+    }
+    return head.size() + bodyLength;
+}
+
+void RequestWriter::write(const Glib::RefPtr<Gio::OutputStream>& stream,
+                          const Glib::RefPtr<Gio::Cancellable>& cancellable) const {
+    if (producer) {
+        writeProduced(stream, cancellable);
+        return;
+    }
+
+    GOutputVector vectors[2] = {
+        {head.data(), head.size()},
+        {bodyData, bodyLength}
+    };
+    size_t count = bodyLength > 0 ? 2 : 1;
+    GCancellable* cancel = cancellable ? cancellable->gobj() : nullptr;
+
+    GError* error = nullptr;
+#if GLIB_CHECK_VERSION(2, 60, 0)
+    g_output_stream_writev_all(stream->gobj(), vectors, count, nullptr, cancel, &error);
+#else
+    for (size_t i = 0; i < count && !error; i++) {
+        g_output_stream_write_all(stream->gobj(), vectors[i].buffer, vectors[i].size, nullptr, cancel, &error);
+    }
+#endif
+    if (error) {
+        Glib::Error::throw_exception(error);
+    }
+}
+
+void RequestWriter::writeAsync(const Glib::RefPtr<Gio::OutputStream>& stream,
+                               const Glib::RefPtr<Gio::Cancellable>& cancellable,
+                               const WriteCallback& callback) const {
+    if (producer) {
+        writeProducedAsync(stream, cancellable, callback);
+        return;
+    }
+
+    PendingWrite* pending = new PendingWrite(*this);
+    pending->stream = stream;
+    pending->cancellable = cancellable;
+    pending->callback = callback;
+
+    GCancellable* cancel = cancellable ? cancellable->gobj() : nullptr;
+#if GLIB_CHECK_VERSION(2, 60, 0)
+    g_output_stream_writev_all_async(stream->gobj(), pending->vectors, pending->count, G_PRIORITY_DEFAULT,
+                                     cancel, &RequestWriter::onWritten, pending);
+#else
+    g_output_stream_write_all_async(stream->gobj(), pending->vectors[0].buffer, pending->vectors[0].size,
+                                    G_PRIORITY_DEFAULT, cancel, &RequestWriter::onWritten, pending);
+#endif
+}
+
+void RequestWriter::onWritten(GObject* source, GAsyncResult* result, gpointer data) {
+    std::unique_ptr<PendingWrite> pending(static_cast<PendingWrite*>(data));
+
+    GError* error = nullptr;
+#if GLIB_CHECK_VERSION(2, 60, 0)
+    g_output_stream_writev_all_finish(G_OUTPUT_STREAM(source), result, nullptr, &error);
+#else
+    g_output_stream_write_all_finish(G_OUTPUT_STREAM(source), result, nullptr, &error);
+
+    // Without writev, send the body once the head is out
+    if (!error && ++pending->next < pending->count) {
+        PendingWrite* next = pending.release();
+        g_output_stream_write_all_async(G_OUTPUT_STREAM(source), next->vectors[next->next].buffer,
+                                        next->vectors[next->next].size, G_PRIORITY_DEFAULT,
+                                        next->cancellable ? next->cancellable->gobj() : nullptr,
+                                        &RequestWriter::onWritten, next);
+        return;
+    }
+#endif
+
+    std::string message;
+    if (error) {
+        message = error->message;
+        g_error_free(error);
+    }
+
+    pending->callback(message);
+}
+
+void RequestWriter::writeProduced(const Glib::RefPtr<Gio::OutputStream>& stream,
+                                  const Glib::RefPtr<Gio::Cancellable>& cancellable) const {
+    ProducedWrite pending(*this);
+    GCancellable* cancel = cancellable ? cancellable->gobj() : nullptr;
+
+    GError* error = nullptr;
+    while (!error && pending.next()) {
+#if GLIB_CHECK_VERSION(2, 60, 0)
+        g_output_stream_writev_all(stream->gobj(), pending.vectors, pending.count, nullptr, cancel, &error);
+#else
+        for (size_t i = 0; i < pending.count && !error; i++) {
+            g_output_stream_write_all(stream->gobj(), pending.vectors[i].buffer, pending.vectors[i].size,
+                                      nullptr, cancel, &error);
+        }
+#endif
+    }
+    if (error) {
+        Glib::Error::throw_exception(error);
+    }
+}
+
+void RequestWriter::writeProducedAsync(const Glib::RefPtr<Gio::OutputStream>& stream,
+                                       const Glib::RefPtr<Gio::Cancellable>& cancellable,
+                                       const WriteCallback& callback) const {
+    ProducedWrite* pending = new ProducedWrite(*this);
+    pending->stream = stream;
+    pending->cancellable = cancellable;
+    pending->callback = callback;
+    writeNextPiece(pending);
+}
+
+void RequestWriter::writeNextPiece(ProducedWrite* data) {
+    std::unique_ptr<ProducedWrite> pending(data);
+
+    // The next piece is made while the kernel sends the previous one
+    bool writing;
+    try {
+        writing = pending->next();
+    } catch (const std::exception& e) {
+        pending->callback(e.what());
+        return;
+    }
+    if (!writing) {
+        pending->callback("");
+        return;
+    }
+
+    GCancellable* cancel = pending->cancellable ? pending->cancellable->gobj() : nullptr;
+    GOutputStream* stream = pending->stream->gobj();
+#if GLIB_CHECK_VERSION(2, 60, 0)
+    ProducedWrite* next = pending.release();
+    g_output_stream_writev_all_async(stream, next->vectors, next->count, G_PRIORITY_DEFAULT,
+                                     cancel, &RequestWriter::onPieceWritten, next);
+#else
+    pending->joined.clear();
+    for (size_t i = 0; i < pending->count; i++) {
+        pending->joined.append(static_cast<const char*>(pending->vectors[i].buffer), pending->vectors[i].size);
+    }
+    ProducedWrite* next = pending.release();
+    g_output_stream_write_all_async(stream, next->joined.data(), next->joined.size(), G_PRIORITY_DEFAULT,
+                                    cancel, &RequestWriter::onPieceWritten, next);
+#endif
+}
+
+void RequestWriter::onPieceWritten(GObject* source, GAsyncResult* result, gpointer data) {
+    ProducedWrite* pending = static_cast<ProducedWrite*>(data);
+
+    GError* error = nullptr;
+#if GLIB_CHECK_VERSION(2, 60, 0)
+    g_output_stream_writev_all_finish(G_OUTPUT_STREAM(source), result, nullptr, &error);
+#else
+    g_output_stream_write_all_finish(G_OUTPUT_STREAM(source), result, nullptr, &error);
+#endif
+
+    if (error) {
+        std::unique_ptr<ProducedWrite> failed(pending);
+        std::string message = error->message;
+        g_error_free(error);
+        failed->callback(message);
+        return;
+    }
+
+    writeNextPiece(pending);
+}
@@ -0,0 +1,211 @@
+#include "RetryPolicy.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <ctime>
+#include <map>
+
+namespace {
+
+std::string toLower(const std::string& value) {
+    std::string result = value;
+    for (auto& c : result) {
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    return result;
+}
+
+// Parse a Retry-After value: delay in seconds, or an HTTP date
+bool parseRetryAfter(const std::string& value, std::chrono::milliseconds& delay) {
+    char* end = nullptr;
+    double seconds = std::strtod(value.c_str(), &end);
+    if (end != value.c_str() && *end == '\0') {
+        delay = std::chrono::milliseconds(static_cast<long long>(std::max(0.0, seconds) * 1000));
+        return true;
+    }
+
+    std::tm date{};
+    if (!strptime(value.c_str(), "%a, %d %b %Y %H:%M:%S", &date)) {
+        return false;
+    }
+    std::time_t when = timegm(&date);
+    std::time_t now = std::time(nullptr);
+    delay = std::chrono::seconds(std::max<std::time_t>(0, when - now));
+    return true;
+}
+
+// Parse a rate limit reset value. Providers use plain seconds, epoch
+// seconds or milliseconds (OpenRouter), or durations such as "6m0s" or
+// "250ms" (OpenAI).
+bool parseReset(const std::string& value, std::chrono::milliseconds& delay) {
+    char* end = nullptr;
+    double number = std::strtod(value.c_str(), &end);
+    if (end == value.c_str()) {
+        return false;
+    }
+
+    if (*end == '\0') {
+        auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        long long ms;
+        if (number > 1e12) {
+            ms = static_cast<long long>(number) - now;
+        } else if (number > 1e9) {
+            ms = static_cast<long long>(number * 1000) - now;
+        } else {
+            ms = static_cast<long long>(number * 1000);
+        }
+        delay = std::chrono::milliseconds(std::max(0LL, ms));
+        return true;
+    }
+
+    // Go-style duration: a sequence of number and unit pairs
+    double total = 0;
+    const char* p = value.c_str();
+    while (*p) {
+        number = std::strtod(p, &end);
+        if (end == p) {
+            return false;
+        }
+        p = end;
+        if (p[0] == 'm' && p[1] == 's') {
+            total += number;
+            p += 2;
+        } else if (*p == 'h') {
+            total += number * 3600000;
+            p++;
+        } else if (*p == 'm') {
+            total += number * 60000;
+            p++;
+        } else if (*p == 's') {
+            total += number * 1000;
+            p++;
+        } else {
+            return false;
+        }
+    }
+    delay = std::chrono::milliseconds(static_cast<long long>(total));
+    return true;
+}
+
+}
+
+RetryPolicy::RetryPolicy() : RetryPolicy(Settings()) {
+}
+
+RetryPolicy::RetryPolicy(const Settings& settings)
+    : settings(settings),
+      tokens(settings.budget),
+      random(std::random_device()()) {
+}
+
+bool RetryPolicy::isRetryableStatus(int statusCode) {
+    switch (statusCode) {
+        case 408:
+        case 425:
+        case 429:
+        case 500:
+        case 502:
+        case 503:
+        case 504:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool RetryPolicy::serverDelay(int statusCode, const HttpResponseParser::HeaderList& headers,
+                              std::chrono::milliseconds& delay) {
+    // Retry-After is authoritative
+    for (const auto& [name, value] : headers) {
+        if (toLower(name) == "retry-after" && parseRetryAfter(value, delay)) {
+            return true;
+        }
+    }
+
+    // Rate limit headers come with every response; they only explain a 429
+    return statusCode == 429 && exhaustedReset(headers, delay);
+}
+
+bool RetryPolicy::exhaustedReset(const HttpResponseParser::HeaderList& headers, std::chrono::milliseconds& delay) {
+    // Remaining count and reset of each bucket, keyed by the header suffix
+    // ("-requests", "-tokens", or "" for a single bucket)
+    std::map<std::string, double> remaining;
+    std::map<std::string, std::chrono::milliseconds> resets;
+    for (const auto& [name, value] : headers) {
+        std::string lower = toLower(name);
+        if (lower.compare(0, 21, "x-ratelimit-remaining") == 0) {
+            char* end = nullptr;
+            double count = std::strtod(value.c_str(), &end);
+            if (end != value.c_str()) {
+                remaining[lower.substr(21)] = count;
+            }
+        } else if (lower.compare(0, 17, "x-ratelimit-reset") == 0) {
+            std::chrono::milliseconds parsed(0);
+            if (parseReset(value, parsed)) {
+                resets[lower.substr(17)] = parsed;
+            }
+        }
+    }
+
+    // Wait for every bucket that is used up, and only those
+    bool found = false;
+    std::chrono::milliseconds longest(0);
+    for (const auto& [bucket, count] : remaining) {
+        auto reset = resets.find(bucket);
+        if (count <= 0 && reset != resets.end()) {
+            longest = std::max(longest, reset->second);
+            found = true;
+        }
+    }
+
+    if (found) {
+        delay = longest;
+    }
+    return found;
+}
+
+bool RetryPolicy::shouldRetry(int attempt, int statusCode, const HttpResponseParser::HeaderList& headers,
+                              std::chrono::milliseconds& delay) {
+    if (attempt >= settings.maxAttempts) {
+        return false;
+    }
+    if (statusCode != 0 && !isRetryableStatus(statusCode)) {
+        return false;
+    }
+
+    std::chrono::milliseconds wait(0);
+    bool asked = serverDelay(statusCode, headers, wait);
+    if (asked && wait > settings.maxRetryAfter) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (tokens < 1.0) {
+        return false;
+    }
+    tokens -= 1.0;
+
+    // Decorrelated jitter: random between the base and three times the last delay
+    long long base = settings.baseDelay.count();
+    long long upper = std::max(base, static_cast<long long>(delay.count()) * 3);
+    std::uniform_int_distribution<long long> pick(base, upper);
+    std::chrono::milliseconds backoff(std::min(pick(random), static_cast<long long>(settings.maxDelay.count())));
+
+    if (!asked) {
+        delay = backoff;
+        return true;
+    }
+
+    // Clients told to come back at the same moment are spread over up to a
+    // quarter of the backoff after it, without going past the longest wait
+    std::uniform_int_distribution<long long> spread(0, backoff.count() / 4);
+    delay = std::min(wait + std::chrono::milliseconds(spread(random)), settings.maxRetryAfter);
+    return true;
+}
+
+void RetryPolicy::onSuccess() {
+    std::lock_guard<std::mutex> lock(mutex);
+    tokens = std::min(settings.budget, tokens + settings.refillPerSuccess);
+}
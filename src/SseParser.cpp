@@ -0,0 +1,157 @@
+#include "SseParser.h"
+#include <algorithm>
+
+namespace {
+
+// Check if a view lies inside another
+bool within(std::string_view part, std::string_view whole) {
+    return part.data() >= whole.data() && part.data() + part.size() <= whole.data() + whole.size();
+}
+
+}
+
+bool SseParser::feed(std::string_view data, const EventCallback& onEvent) {
+    // Whatever follows "[DONE]" is read and dropped, so the response can
+    // still end normally and its connection be reused
+    if (done) {
+        return true;
+    }
+
+    // A byte order mark may open the stream
+    if (!started && !data.empty()) {
+        started = true;
+        if (data.substr(0, 3) == "\xEF\xBB\xBF") {
+            data.remove_prefix(3);
+        }
+    }
+
+    chunk = data;
+    callback = &onEvent;
+
+    // Capturing only this keeps the line callback free of allocations
+    bool keepGoing = lines.feed(data, [this](std::string_view line) {
+        return onLine(line);
+    });
+
+    // The chunk goes away when we return
+    keepData();
+    chunk = std::string_view();
+    callback = nullptr;
+    return keepGoing || done;
+}
+
+void SseParser::finish() {
+    // Per the spec an event needs its blank line to be dispatched
+    lines.clear();
+    dataBuffer.clear();
+    dataView = std::string_view();
+    hasData = false;
+    dataBuffered = false;
+    eventType.clear();
+}
+
+void SseParser::clear() {
+    finish();
+    lastId.clear();
+    retryMs = -1;
+    started = false;
+    done = false;
+}
+
+bool SseParser::onLine(std::string_view line) {
+    // A blank line ends the event
+    if (line.empty()) {
+        return dispatch();
+    }
+
+    // Comments, which servers also send as keep-alive pings
+    if (line.front() == ':') {
+        return true;
+    }
+
+    // Split "field: value"; a line without a colon is a field with no value
+    std::string_view field = line;
+    std::string_view value;
+    size_t colon = line.find(':');
+    if (colon != std::string_view::npos) {
+        field = line.substr(0, colon);
+        value = line.substr(colon + 1);
+        if (!value.empty() && value.front() == ' ') {
+            value.remove_prefix(1);
+        }
+    }
+
+    if (field == "data") {
+        if (!hasData && within(value, chunk)) {
+            // The common case: a single line that arrived whole
+            dataView = value;
+        } else {
+            // Join the lines in our buffer
+            keepData();
+            if (hasData) {
+                dataBuffer += '\n';
+            }
+            dataBuffer.append(value.data(), value.size());
+            dataView = dataBuffer;
+            dataBuffered = true;
+        }
+        hasData = true;
+    } else if (field == "event") {
+        eventType.assign(value.data(), value.size());
+    } else if (field == "id") {
+        // IDs with a NUL are ignored
+        if (value.find('\0') == std::string_view::npos) {
+            lastId.assign(value.data(), value.size());
+        }
+    } else if (field == "retry") {
+        // Only plain digits count; absurd values are capped at a day
+        if (!value.empty() && value.find_first_not_of("0123456789") == std::string_view::npos) {
+            long ms = 0;
+            for (char digit : value) {
+                ms = std::min(ms * 10 + (digit - '0'), 86400000L);
+            }
+            retryMs = ms;
+        }
+    }
+
+    // Other fields are ignored
+    return true;
+}
+
+bool SseParser::dispatch() {
+    // A blank line without data only resets the event type
+    if (!hasData) {
+        eventType.clear();
+        return true;
+    }
+
+    Event event;
+    event.type = eventType.empty() ? std::string_view("message") : std::string_view(eventType);
+    event.data = dataView;
+    event.id = lastId;
+
+    bool keepGoing;
+    if (event.data == "[DONE]") {
+        // OpenAI-style end of stream; stop looking at lines
+        done = true;
+        keepGoing = false;
+    } else {
+        keepGoing = (*callback)(event);
+    }
+
+    // Start the next event; the buffers keep their capacity
+    dataBuffer.clear();
+    dataView = std::string_view();
+    hasData = false;
+    dataBuffered = false;
+    eventType.clear();
+    return keepGoing;
+}
+
+void SseParser::keepData() {
+    if (hasData && !dataBuffered) {
+        dataBuffer.assign(dataView.data(), dataView.size());
+        dataView = dataBuffer;
+        dataBuffered = true;
+    }
+}
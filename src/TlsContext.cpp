@@ -0,0 +1,242 @@
+#include "TlsContext.h"
+#include <iostream>
+#include <cstdlib>
+#include <stdexcept>
+#include <memory>
+
+std::chrono::microseconds TlsContext::Stats::averageHandshakeTime() const {
+    if (handshakes == 0) {
+        return std::chrono::microseconds(0);
+    }
+    return totalHandshakeTime / handshakes;
+}
+
+std::chrono::microseconds TlsContext::Stats::averageOfferedTime() const {
+    if (sessionOffers == 0) {
+        return std::chrono::microseconds(0);
+    }
+    return totalOfferedTime / sessionOffers;
+}
+
+std::chrono::microseconds TlsContext::Stats::averageFreshTime() const {
+    if (handshakes == sessionOffers) {
+        return std::chrono::microseconds(0);
+    }
+    return (totalHandshakeTime - totalOfferedTime) / (handshakes - sessionOffers);
+}
+
+TlsContext::TlsContext()
+    : sessionLifetime(3600),
+      database(nullptr) {
+    // Allow pointing the client at a private CA, e.g. for a local test server
+    const char* caFile = std::getenv("GTKKS_CA_FILE");
+    if (caFile && *caFile) {
+        try {
+            setCaFile(caFile);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+        }
+    }
+}
+
+TlsContext::~TlsContext() {
+    if (database) {
+        g_object_unref(database);
+    }
+}
+
+TlsContext& TlsContext::getInstance() {
+    static TlsContext instance;
+    return instance;
+}
+
+void TlsContext::setCaFile(const std::string& path) {
+    GTlsDatabase* newDatabase = nullptr;
+
+    if (!path.empty()) {
+        GError* error = nullptr;
+        newDatabase = g_tls_file_database_new(path.c_str(), &error);
+        if (!newDatabase) {
+            std::string message = error ? error->message : "unknown error";
+            g_clear_error(&error);
+            throw std::runtime_error("Failed to load CA file " + path + ": " + message);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (database) {
+        g_object_unref(database);
+    }
+    database = newDatabase;
+
+    // Sessions were negotiated under the old trust settings
+    sessions.clear();
+}
+
+void TlsContext::setSessionLifetime(std::chrono::seconds lifetime) {
+    std::lock_guard<std::mutex> lock(mutex);
+    sessionLifetime = lifetime;
+}
+
+void TlsContext::clearSessions() {
+    std::lock_guard<std::mutex> lock(mutex);
+    sessions.clear();
+}
+
+TlsContext::Stats TlsContext::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+TlsContext::Handshake TlsContext::prepare(const Glib::RefPtr<Gio::SocketConnection>& socket,
+                                          const std::string& host, int port,
+                                          const std::vector<std::string>& protocols) {
+    std::string key = host + ":" + std::to_string(port);
+
+    // Create the client side of the TLS connection on top of the socket
+    GError* error = nullptr;
+    GSocketConnectable* identity = g_network_address_new(host.c_str(), port);
+    GIOStream* tls = g_tls_client_connection_new(G_IO_STREAM(socket->gobj()), identity, &error);
+    g_object_unref(identity);
+
+    if (!tls) {
+        std::string message = error ? error->message : "unknown error";
+        g_clear_error(&error);
+        throw std::runtime_error("TLS setup failed: " + message);
+    }
+
+    // Offer application protocols through ALPN
+    if (!protocols.empty()) {
+#if GLIB_CHECK_VERSION(2, 60, 0)
+        std::vector<const gchar*> names;
+        for (const auto& protocol : protocols) {
+            names.push_back(protocol.c_str());
+        }
+        names.push_back(nullptr);
+        g_tls_connection_set_advertised_protocols(G_TLS_CONNECTION(tls), names.data());
+#endif
+    }
+
+    Handshake handshake;
+    // Take ownership of the new connection
+    handshake.stream = Glib::wrap(tls);
+    handshake.host = host;
+    handshake.port = port;
+    handshake.offeredSession = false;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (database) {
+            g_tls_connection_set_database(G_TLS_CONNECTION(tls), database);
+        }
+
+        // Offer the session of the last connection to this host
+        auto it = sessions.find(key);
+        if (it != sessions.end()) {
+            if (std::chrono::steady_clock::now() - it->second.created < sessionLifetime) {
+                g_tls_client_connection_copy_session_state(
+                    G_TLS_CLIENT_CONNECTION(tls),
+                    G_TLS_CLIENT_CONNECTION(it->second.connection->gobj()));
+                handshake.offeredSession = true;
+            } else {
+                sessions.erase(it);
+            }
+        }
+    }
+
+    handshake.start = std::chrono::steady_clock::now();
+    return handshake;
+}
+
+std::string TlsContext::finish(Handshake& handshake, gboolean ok, GError* error) {
+    std::string key = handshake.host + ":" + std::to_string(handshake.port);
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - handshake.start);
+
+    if (!ok) {
+        std::string message = error ? error->message : "unknown error";
+
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.failures++;
+        sessions.erase(key);
+        return "TLS handshake with " + handshake.host + " failed: " + message;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.handshakes++;
+        stats.totalHandshakeTime += elapsed;
+        if (elapsed > stats.maxHandshakeTime) {
+            stats.maxHandshakeTime = elapsed;
+        }
+        if (handshake.offeredSession) {
+            stats.sessionOffers++;
+            stats.totalOfferedTime += elapsed;
+        }
+
+        // The newest connection carries the freshest session for the next one
+        sessions[key] = CachedSession{handshake.stream, std::chrono::steady_clock::now()};
+    }
+
+    return "";
+}
+
+Glib::RefPtr<Gio::IOStream> TlsContext::connect(const Glib::RefPtr<Gio::SocketConnection>& socket,
+                                                const std::string& host, int port,
+                                                const Glib::RefPtr<Gio::Cancellable>& cancellable) {
+    Handshake handshake = prepare(socket, host, port, std::vector<std::string>());
+
+    // Run the handshake now so its cost is measured on its own
+    GError* error = nullptr;
+    gboolean ok = g_tls_connection_handshake(G_TLS_CONNECTION(handshake.stream->gobj()),
+                                             cancellable ? cancellable->gobj() : nullptr, &error);
+    std::string message = finish(handshake, ok, error);
+    g_clear_error(&error);
+
+    if (!message.empty()) {
+        throw std::runtime_error(message);
+    }
+
+    return handshake.stream;
+}
+
+void TlsContext::connectAsync(const Glib::RefPtr<Gio::SocketConnection>& socket,
+                              const std::string& host, int port,
+                              const std::vector<std::string>& protocols,
+                              const Glib::RefPtr<Gio::Cancellable>& cancellable,
+                              const HandshakeCallback& callback) {
+    Handshake* handshake = new Handshake(prepare(socket, host, port, protocols));
+    handshake->callback = callback;
+
+    g_tls_connection_handshake_async(G_TLS_CONNECTION(handshake->stream->gobj()), G_PRIORITY_DEFAULT,
+                                     cancellable ? cancellable->gobj() : nullptr,
+                                     &TlsContext::onHandshakeReady, handshake);
+}
+
+void TlsContext::onHandshakeReady(GObject* source, GAsyncResult* result, gpointer data) {
+    std::unique_ptr<Handshake> handshake(static_cast<Handshake*>(data));
+
+    GError* error = nullptr;
+    gboolean ok = g_tls_connection_handshake_finish(G_TLS_CONNECTION(source), result, &error);
+    std::string message = getInstance().finish(*handshake, ok, error);
+    g_clear_error(&error);
+
+    if (message.empty()) {
+        handshake->callback(handshake->stream, "");
+    } else {
+        handshake->callback(Glib::RefPtr<Gio::IOStream>(), message);
+    }
+}
+
+std::string TlsContext::negotiatedProtocol(const Glib::RefPtr<Gio::IOStream>& stream) {
+#if GLIB_CHECK_VERSION(2, 60, 0)
+    if (stream && G_IS_TLS_CONNECTION(stream->gobj())) {
+        const gchar* protocol = g_tls_connection_get_negotiated_protocol(G_TLS_CONNECTION(stream->gobj()));
+        if (protocol) {
+            return protocol;
+        }
+    }
+#endif
+    return "";
+}
@@ -0,0 +1,588 @@
+#include "UringTransport.h"
+#include <stdexcept>
+
+#ifdef HAVE_IO_URING
+
+#include "HttpResponseParser.h"
+#include <liburing.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+// Kind of operation, kept in the low byte of the user data below the slot
+enum Operation : uint64_t {
+    Connect = 1,
+    Send,
+    Receive,
+    Close,
+    Timeout
+};
+
+uint64_t userData(size_t slot, Operation operation) {
+    return (static_cast<uint64_t>(slot) << 8) | operation;
+}
+
+// Registered buffers are limited to one iovec array
+const unsigned maxRegisteredBuffers = 1024;
+
+// Address of an endpoint, resolved once per run
+struct Address {
+    sockaddr_storage storage;
+    socklen_t length = 0;
+};
+
+}
+
+struct UringTransport::Ring {
+    // One request in flight and the connection it uses
+    struct Slot {
+        int fd = -1;
+        std::string endpoint;
+        bool keepAlive = false;
+
+        // Request being run, and whether it went out on a kept connection
+        size_t request = 0;
+        bool reused = false;
+        bool busy = false;
+
+        // What is left to send
+        iovec vectors[2];
+        msghdr message;
+
+        // Response parsing
+        std::unique_ptr<HttpResponseParser> parser;
+        size_t received = 0;
+
+        // Limit for the pending connect or read
+        __kernel_timespec timeout;
+    };
+
+    struct io_uring uring;
+    Settings settings;
+    Stats* stats;
+
+    // One region split into a registered buffer per slot
+    std::unique_ptr<char[]> buffers;
+    bool registered;
+
+    std::vector<Slot> slots;
+    std::map<std::string, Address> addresses;
+
+    // The batch being run
+    const std::vector<Request>* requests;
+    std::vector<Result>* results;
+    size_t next;
+
+    // Operations submitted whose completion hasn't been seen
+    size_t outstanding;
+
+    Ring(const Settings& settings, Stats* stats);
+    ~Ring();
+
+    void run(const std::vector<Request>& requests, std::vector<Result>& results);
+
+    // Get a free submission entry, making room if the queue is full
+    io_uring_sqe* getSqe();
+
+    // Limit the operation just prepared with a linked timeout
+    void linkTimeout(io_uring_sqe* sqe, size_t index);
+
+    // Give a slot the next request that can be started; returns false if none is left
+    bool startNext(size_t index);
+    void connect(size_t index);
+    void send(size_t index);
+    void receive(size_t index);
+
+    // Handle a completion
+    void complete(uint64_t data, int result);
+
+    // Retry on a fresh connection if a kept one was closed before
+    // answering, otherwise fail the request
+    void retryOrFinish(size_t index, const std::string& error);
+
+    // Store the outcome and move on to the next request
+    void finish(size_t index, const std::string& error);
+
+    // Close the slot's connection
+    void closeConnection(Slot& slot);
+
+    // Resolve an endpoint; throws if it can't be
+    const Address& resolve(const Request& request, const std::string& endpoint);
+};
+
+UringTransport::Ring::Ring(const Settings& settings, Stats* stats)
+    : settings(settings),
+      stats(stats),
+      registered(false),
+      requests(nullptr),
+      results(nullptr),
+      next(0),
+      outstanding(0) {
+    this->settings.maxInFlight = std::max(1u, std::min(settings.maxInFlight, maxRegisteredBuffers));
+    this->settings.bufferSize = std::max<size_t>(settings.bufferSize, 4096);
+
+    // Room for an operation and its timeout for every slot
+    int error = io_uring_queue_init(this->settings.maxInFlight * 2, &uring, 0);
+    if (error < 0) {
+        throw std::runtime_error("io_uring setup failed: " + std::string(std::strerror(-error)));
+    }
+
+    size_t count = this->settings.maxInFlight;
+    size_t size = this->settings.bufferSize;
+    buffers.reset(new char[count * size]);
+    std::vector<iovec> vectors(count);
+    for (size_t i = 0; i < count; i++) {
+        vectors[i].iov_base = buffers.get() + i * size;
+        vectors[i].iov_len = size;
+    }
+
+    // Without registration (e.g. a low memlock limit) reads still use the same buffers
+    registered = io_uring_register_buffers(&uring, vectors.data(), static_cast<unsigned>(count)) == 0;
+
+    slots.resize(count);
+    for (auto& slot : slots) {
+        slot.parser = std::make_unique<HttpResponseParser>();
+    }
+}
+
+UringTransport::Ring::~Ring() {
+    for (auto& slot : slots) {
+        if (slot.fd >= 0) {
+            ::close(slot.fd);
+        }
+    }
+    io_uring_queue_exit(&uring);
+}
+
+io_uring_sqe* UringTransport::Ring::getSqe() {
+    // An operation and its linked timeout have to go out together
+    if (io_uring_sq_space_left(&uring) < 2) {
+        io_uring_submit(&uring);
+        stats->submits++;
+    }
+    io_uring_sqe* sqe = io_uring_get_sqe(&uring);
+    if (!sqe) {
+        throw std::runtime_error("io_uring submission queue is full");
+    }
+    outstanding++;
+    return sqe;
+}
+
+void UringTransport::Ring::linkTimeout(io_uring_sqe* sqe, size_t index) {
+    if (settings.ioTimeout.count() <= 0) {
+        return;
+    }
+
+    Slot& slot = slots[index];
+    slot.timeout.tv_sec = settings.ioTimeout.count() / 1000;
+    slot.timeout.tv_nsec = (settings.ioTimeout.count() % 1000) * 1000000;
+
+    // getSqe left room for this entry, so the pair can't be split by a submit
+    sqe->flags |= IOSQE_IO_LINK;
+    io_uring_sqe* timeout = io_uring_get_sqe(&uring);
+    outstanding++;
+    io_uring_prep_link_timeout(timeout, &slot.timeout, 0);
+    io_uring_sqe_set_data64(timeout, userData(index, Timeout));
+}
+
+void UringTransport::Ring::run(const std::vector<Request>& requests, std::vector<Result>& results) {
+    this->requests = &requests;
+    this->results = &results;
+    next = 0;
+
+    for (size_t i = 0; i < slots.size() && startNext(i); i++) {
+    }
+
+    // Everything prepared while handling one batch of completions goes out
+    // with the same call that waits for the next
+    while (outstanding > 0) {
+        int error = io_uring_submit_and_wait(&uring, 1);
+        stats->submits++;
+        if (error < 0 && error != -EINTR) {
+            throw std::runtime_error("io_uring wait failed: " + std::string(std::strerror(-error)));
+        }
+
+        io_uring_cqe* cqe;
+        unsigned head;
+        unsigned count = 0;
+        io_uring_for_each_cqe(&uring, head, cqe) {
+            count++;
+            outstanding--;
+            stats->completions++;
+            complete(cqe->user_data, cqe->res);
+        }
+        io_uring_cq_advance(&uring, count);
+    }
+
+    // Kept connections don't outlive the batch
+    for (auto& slot : slots) {
+        if (slot.fd >= 0) {
+            ::close(slot.fd);
+            slot.fd = -1;
+        }
+        slot.endpoint.clear();
+        slot.keepAlive = false;
+    }
+    this->requests = nullptr;
+    this->results = nullptr;
+}
+
+bool UringTransport::Ring::startNext(size_t index) {
+    Slot& slot = slots[index];
+    while (next < requests->size()) {
+        size_t current = next++;
+        const Request& request = (*requests)[current];
+        Result& result = (*results)[current];
+
+        if (request.scheme != "http" && request.scheme != "unix") {
+            result.error = "The io_uring transport doesn't support " + request.scheme;
+            continue;
+        }
+        std::string endpoint = request.scheme + "://" + request.host + ":" + std::to_string(request.port);
+
+        slot.request = current;
+        slot.busy = true;
+        slot.received = 0;
+        slot.parser->reset();
+        slot.parser->setHeadRequest(request.head.compare(0, 5, "HEAD ") == 0);
+        slot.parser->setBodyHandler([this, &slot](const char* data, size_t length) {
+            const Request& request = (*requests)[slot.request];
+            if (!request.onData || slot.parser->getStatusCode() >= 400) {
+                (*results)[slot.request].body.append(data, length);
+                return true;
+            }
+            return request.onData(std::string_view(data, length));
+        });
+
+        slot.vectors[0].iov_base = const_cast<char*>(request.head.data());
+        slot.vectors[0].iov_len = request.head.size();
+        slot.vectors[1].iov_base = request.body ? const_cast<char*>(request.body->data()) : nullptr;
+        slot.vectors[1].iov_len = request.body ? request.body->size() : 0;
+
+        // Send right away on a connection the last response left open
+        if (slot.fd >= 0 && slot.keepAlive && slot.endpoint == endpoint) {
+            slot.reused = true;
+            stats->reused++;
+            send(index);
+            return true;
+        }
+
+        closeConnection(slot);
+        slot.endpoint = endpoint;
+        slot.reused = false;
+        try {
+            connect(index);
+        } catch (const std::exception& e) {
+            result.error = e.what();
+            closeConnection(slot);
+            continue;
+        }
+        return true;
+    }
+
+    closeConnection(slot);
+    slot.busy = false;
+    return false;
+}
+
+void UringTransport::Ring::connect(size_t index) {
+    Slot& slot = slots[index];
+    const Request& request = (*requests)[slot.request];
+    const Address& address = resolve(request, slot.endpoint);
+
+    slot.fd = ::socket(address.storage.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (slot.fd < 0) {
+        throw std::runtime_error("Connection failed: " + std::string(std::strerror(errno)));
+    }
+    if (address.storage.ss_family != AF_UNIX) {
+        int on = 1;
+        setsockopt(slot.fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+    slot.keepAlive = false;
+    stats->connects++;
+
+    io_uring_sqe* sqe = getSqe();
+    io_uring_prep_connect(sqe, slot.fd, reinterpret_cast<const sockaddr*>(&address.storage), address.length);
+    io_uring_sqe_set_data64(sqe, userData(index, Connect));
+    linkTimeout(sqe, index);
+}
+
+void UringTransport::Ring::send(size_t index) {
+    Slot& slot = slots[index];
+
+    // Skip what has been sent already
+    size_t first = slot.vectors[0].iov_len == 0 ? 1 : 0;
+    std::memset(&slot.message, 0, sizeof(slot.message));
+    slot.message.msg_iov = slot.vectors + first;
+    slot.message.msg_iovlen = 2 - first;
+
+    // A server that went away must not raise SIGPIPE
+    io_uring_sqe* sqe = getSqe();
+    io_uring_prep_sendmsg(sqe, slot.fd, &slot.message, MSG_NOSIGNAL);
+    io_uring_sqe_set_data64(sqe, userData(index, Send));
+}
+
+void UringTransport::Ring::receive(size_t index) {
+    Slot& slot = slots[index];
+    char* buffer = buffers.get() + index * settings.bufferSize;
+
+    io_uring_sqe* sqe = getSqe();
+    if (registered) {
+        io_uring_prep_read_fixed(sqe, slot.fd, buffer, static_cast<unsigned>(settings.bufferSize), 0,
+                                 static_cast<int>(index));
+    } else {
+        io_uring_prep_recv(sqe, slot.fd, buffer, settings.bufferSize, 0);
+    }
+    io_uring_sqe_set_data64(sqe, userData(index, Receive));
+    linkTimeout(sqe, index);
+}
+
+void UringTransport::Ring::complete(uint64_t data, int result) {
+    size_t index = static_cast<size_t>(data >> 8);
+    Operation operation = static_cast<Operation>(data & 0xff);
+    if (operation == Close || operation == Timeout) {
+        return;
+    }
+
+    Slot& slot = slots[index];
+    std::string timedOut = "Timed out after " + std::to_string(settings.ioTimeout.count()) + " ms";
+
+    switch (operation) {
+        case Connect:
+            if (result < 0) {
+                finish(index, result == -ECANCELED ? timedOut
+                                                   : "Connection failed: " + std::string(std::strerror(-result)));
+                return;
+            }
+            send(index);
+            return;
+
+        case Send: {
+            if (result < 0) {
+                retryOrFinish(index, "Failed to send request: " + std::string(std::strerror(-result)));
+                return;
+            }
+
+            // Move past what the socket took
+            size_t sent = static_cast<size_t>(result);
+            for (auto& vector : slot.vectors) {
+                size_t taken = std::min(sent, vector.iov_len);
+                vector.iov_base = static_cast<char*>(vector.iov_base) + taken;
+                vector.iov_len -= taken;
+                sent -= taken;
+            }
+            if (slot.vectors[0].iov_len > 0 || slot.vectors[1].iov_len > 0) {
+                send(index);
+            } else {
+                receive(index);
+            }
+            return;
+        }
+
+        case Receive: {
+            if (result < 0) {
+                retryOrFinish(index, result == -ECANCELED ? timedOut
+                                                          : "Error reading response: " +
+                                                            std::string(std::strerror(-result)));
+                return;
+            }
+
+            if (result == 0) {
+                if (slot.received == 0) {
+                    retryOrFinish(index, "Connection closed before a response was received");
+                    return;
+                }
+                try {
+                    slot.parser->finish();
+                } catch (const std::exception& e) {
+                    finish(index, e.what());
+                    return;
+                }
+                slot.keepAlive = false;
+                finish(index, "");
+                return;
+            }
+
+            slot.received += static_cast<size_t>(result);
+            const char* buffer = buffers.get() + index * settings.bufferSize;
+            size_t consumed;
+            try {
+                consumed = slot.parser->feed(buffer, static_cast<size_t>(result));
+            } catch (const std::exception& e) {
+                finish(index, e.what());
+                return;
+            }
+
+            if (slot.parser->isAborted()) {
+                slot.keepAlive = false;
+                finish(index, "");
+            } else if (slot.parser->isComplete()) {
+                // Only a connection positioned exactly at the end of the response can be kept
+                slot.keepAlive = consumed == static_cast<size_t>(result) && slot.parser->keepAlive();
+                finish(index, "");
+            } else {
+                receive(index);
+            }
+            return;
+        }
+
+        default:
+            return;
+    }
+}
+
+void UringTransport::Ring::retryOrFinish(size_t index, const std::string& error) {
+    Slot& slot = slots[index];
+
+    // The server may have closed a kept connection just as we sent on it
+    if (slot.reused && slot.received == 0) {
+        const Request& request = (*requests)[slot.request];
+        closeConnection(slot);
+        slot.reused = false;
+        slot.vectors[0].iov_base = const_cast<char*>(request.head.data());
+        slot.vectors[0].iov_len = request.head.size();
+        slot.vectors[1].iov_base = request.body ? const_cast<char*>(request.body->data()) : nullptr;
+        slot.vectors[1].iov_len = request.body ? request.body->size() : 0;
+        slot.endpoint = request.scheme + "://" + request.host + ":" + std::to_string(request.port);
+        try {
+            connect(index);
+            return;
+        } catch (const std::exception& e) {
+            finish(index, e.what());
+            return;
+        }
+    }
+
+    finish(index, error);
+}
+
+void UringTransport::Ring::finish(size_t index, const std::string& error) {
+    Slot& slot = slots[index];
+    Result& result = (*results)[slot.request];
+    result.statusCode = slot.parser->getStatusCode();
+    result.error = error;
+    if (result.error.empty() && result.statusCode >= 400) {
+        result.error = "HTTP error " + std::to_string(result.statusCode) + ": " + result.body;
+    }
+
+    if (!error.empty() || !slot.keepAlive) {
+        closeConnection(slot);
+    }
+    startNext(index);
+}
+
+void UringTransport::Ring::closeConnection(Slot& slot) {
+    if (slot.fd < 0) {
+        return;
+    }
+
+    // Closed on the ring along with everything else; the slot number is
+    // only needed to tell the completion apart
+    io_uring_sqe* sqe = getSqe();
+    io_uring_prep_close(sqe, slot.fd);
+    io_uring_sqe_set_data64(sqe, userData(static_cast<size_t>(&slot - slots.data()), Close));
+    slot.fd = -1;
+    slot.keepAlive = false;
+}
+
+const Address& UringTransport::Ring::resolve(const Request& request, const std::string& endpoint) {
+    auto it = addresses.find(endpoint);
+    if (it != addresses.end()) {
+        return it->second;
+    }
+
+    Address address;
+    std::memset(&address.storage, 0, sizeof(address.storage));
+    if (request.scheme == "unix") {
+        sockaddr_un* unixAddress = reinterpret_cast<sockaddr_un*>(&address.storage);
+        if (request.host.size() >= sizeof(unixAddress->sun_path)) {
+            throw std::runtime_error("Unix socket path is too long: " + request.host);
+        }
+        unixAddress->sun_family = AF_UNIX;
+        std::memcpy(unixAddress->sun_path, request.host.c_str(), request.host.size() + 1);
+        address.length = sizeof(sockaddr_un);
+    } else {
+        addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+
+        // Looked up once per endpoint, before its first connect
+        addrinfo* found = nullptr;
+        int error = getaddrinfo(request.host.c_str(), std::to_string(request.port).c_str(), &hints, &found);
+        if (error != 0 || !found) {
+            throw std::runtime_error("Failed to resolve " + request.host + ": " + gai_strerror(error));
+        }
+        std::memcpy(&address.storage, found->ai_addr, found->ai_addrlen);
+        address.length = found->ai_addrlen;
+        freeaddrinfo(found);
+    }
+
+    return addresses.emplace(endpoint, address).first->second;
+}
+
+bool UringTransport::isSupported() {
+    // The kernel may not have io_uring, or a sandbox may forbid it
+    struct io_uring probe;
+    if (io_uring_queue_init(2, &probe, 0) < 0) {
+        return false;
+    }
+    io_uring_queue_exit(&probe);
+    return true;
+}
+
+UringTransport::UringTransport()
+    : UringTransport(Settings()) {
+}
+
+UringTransport::UringTransport(const Settings& settings)
+    : ring(std::make_unique<Ring>(settings, &stats)),
+      settings(settings) {
+}
+
+UringTransport::~UringTransport() {
+}
+
+std::vector<UringTransport::Result> UringTransport::run(const std::vector<Request>& requests) {
+    stats = Stats();
+    std::vector<Result> results(requests.size());
+    ring->run(requests, results);
+    return results;
+}
+
+#else
+
+struct UringTransport::Ring {
+};
+
+bool UringTransport::isSupported() {
+    return false;
+}
+
+UringTransport::UringTransport()
+    : UringTransport(Settings()) {
+}
+
+UringTransport::UringTransport(const Settings& settings)
+    : settings(settings) {
+    throw std::runtime_error("io_uring support is not built in");
+}
+
+UringTransport::~UringTransport() {
+}
+
+std::vector<UringTransport::Result> UringTransport::run(const std::vector<Request>&) {
+    throw std::runtime_error("io_uring support is not built in");
+}
+
+#endif
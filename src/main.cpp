@@ -1,7 +1,10 @@
 #include <gtkmm.h>
 #include "MainWindow.h"
 #include "Config.h"
+#include "RequestMetrics.h"
 #include <iostream>
+#include <fstream>
+#include <cstdlib>
 
 int main(int argc, char *argv[]) {
     // Initialize GTK
@@ -17,5 +20,17 @@ int main(int argc, char *argv[]) {
     // Run application
     Gtk::Main::run(window);
     
+    // Write the request timings on exit when asked to; "-" means stderr
+    const char* metricsPath = std::getenv("GTKKS_METRICS_DUMP");
+    if (metricsPath && *metricsPath) {
+        std::string dump = RequestMetrics::getInstance().dump();
+        if (std::string(metricsPath) == "-") {
+            std::cerr << dump;
+        } else {
+            std::ofstream file(metricsPath);
+            file << dump;
+        }
+    }
+    
     return 0;
 } 
\ No newline at end of file
@@ -0,0 +1,1291 @@
+// Mock LLM server for offline testing and benchmarking of GTKKS.
+//
+// Serves the Ollama, OpenAI-style (also used for Deepseek and OpenRouter)
+// and Gemini APIs on localhost with generated replies. Token rate, time to
+// first token, how the bytes are fragmented on the wire, error responses,
+// stalls and dropped connections are set on the command line. With the
+// same seed and request order every run produces the same bytes.
+//
+// Plain POSIX sockets and threads, so it builds without GTK:
+//   gtkks-mock-server --port 11500 --token-rate 40 --ttft 300
+// then point an endpoint at it, e.g. Ollama at http://127.0.0.1:11500
+// or OpenAI at http://127.0.0.1:11500/v1.
+//
+// Built with OpenSSL it also serves TLS (--tls-cert, --tls-key), and with
+// nghttp2 as well it offers HTTP/2 through ALPN. Every HTTP/2 request is
+// answered on a thread of its own, so streams of one connection interleave;
+// --h2-max-streams, --h2-window and --goaway-after shape the session.
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#ifdef HAVE_OPENSSL
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#endif
+#ifdef HAVE_NGHTTP2
+#include <nghttp2/nghttp2.h>
+#endif
+
+// HTTP/2 is only offered over TLS, through ALPN
+#if defined(HAVE_OPENSSL) && defined(HAVE_NGHTTP2)
+#define MOCK_HTTP2
+#endif
+
+namespace {
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 11500;
+    std::string unixPath;
+
+    // Model names listed by the model endpoints
+    std::vector<std::string> models = {"mock-model", "gpt-mock", "deepseek-mock", "gemini-mock"};
+
+    // Reply length and pacing; a zero rate sends tokens as fast as possible
+    int tokens = 100;
+    double tokenRate = 50;
+    int ttftMs = 200;
+
+    // Split every write into fragments of this many bytes, with a pause
+    // between them; zero sends each write whole
+    size_t fragmentMin = 0;
+    size_t fragmentMax = 0;
+    int fragmentDelayUs = 0;
+
+    // Share of requests answered with an error status
+    double errorRate = 0;
+    int errorStatus = 500;
+    int retryAfter = 1;
+
+    // Share of streams that stall once, and for how long
+    double stallRate = 0;
+    int stallMs = 5000;
+
+    // Share of streams whose connection is dropped part way
+    double dropRate = 0;
+
+    // Serve TLS with this certificate chain and key, both PEM
+    std::string tlsCert;
+    std::string tlsKey;
+
+    // HTTP/2 settings sent to clients, and after how many streams a
+    // connection is sent GOAWAY; zero never sends it
+    unsigned h2MaxStreams = 100;
+    int h2Window = 65535;
+    int goawayAfter = 0;
+
+    unsigned seed = 1;
+    bool quiet = false;
+};
+
+Options options;
+std::atomic<unsigned long> requestCount(0);
+std::mutex logMutex;
+#ifdef HAVE_OPENSSL
+SSL_CTX* tlsContext = nullptr;
+#endif
+
+const char* words[] = {
+    "the", "quick", "brown", "fox", "jumps", "over", "a", "lazy", "dog", "while",
+    "streaming", "tokens", "arrive", "in", "small", "pieces", "from", "mock", "server", "and",
+    "every", "reply", "is", "generated", "deterministically", "for", "testing", "latency", "throughput", "today"
+};
+
+struct Request {
+    std::string method;
+    std::string path;
+    std::string query;
+    std::map<std::string, std::string> headers;
+    std::string body;
+    bool keepAlive = true;
+};
+
+std::string toLower(std::string value) {
+    for (auto& c : value) {
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    return value;
+}
+
+std::string jsonEscape(const std::string& value) {
+    std::string result;
+    for (char c : value) {
+        switch (c) {
+            case '"': result += "\\\""; break;
+            case '\\': result += "\\\\"; break;
+            case '\n': result += "\\n"; break;
+            case '\r': result += "\\r"; break;
+            case '\t': result += "\\t"; break;
+            default: result += c;
+        }
+    }
+    return result;
+}
+
+// Find a string field in a JSON body without parsing it
+std::string jsonField(const std::string& body, const std::string& name) {
+    std::string key = "\"" + name + "\"";
+    size_t pos = body.find(key);
+    if (pos == std::string::npos) {
+        return "";
+    }
+    pos = body.find(':', pos + key.size());
+    if (pos == std::string::npos) {
+        return "";
+    }
+    pos = body.find_first_not_of(" \t\r\n", pos + 1);
+    if (pos == std::string::npos) {
+        return "";
+    }
+    if (body[pos] == '"') {
+        size_t end = body.find('"', pos + 1);
+        return end == std::string::npos ? "" : body.substr(pos + 1, end - pos - 1);
+    }
+    size_t end = body.find_first_of(",}", pos);
+    return body.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+}
+
+// Connection to one client
+class Connection {
+public:
+    Connection(int fd, unsigned seed) : fd(fd), random(seed) {}
+
+    ~Connection() {
+#ifdef HAVE_OPENSSL
+        if (ssl) {
+            SSL_shutdown(ssl);
+            SSL_free(ssl);
+        }
+#endif
+        close(fd);
+    }
+
+#ifdef HAVE_OPENSSL
+    // Take the TLS handshake. Returns false if it failed.
+    bool startTls(SSL_CTX* context) {
+        ssl = SSL_new(context);
+        SSL_set_fd(ssl, fd);
+        return SSL_accept(ssl) == 1;
+    }
+
+    // The protocol picked through ALPN, "" if none
+    std::string protocol() const {
+        const unsigned char* name = nullptr;
+        unsigned length = 0;
+        if (ssl) {
+            SSL_get0_alpn_selected(ssl, &name, &length);
+        }
+        return length > 0 ? std::string(reinterpret_cast<const char*>(name), length) : "";
+    }
+#endif
+
+    int socket() const { return fd; }
+
+    // Check if received bytes are waiting to be taken, so there's no need
+    // to poll the socket for them
+    bool hasBuffered() const {
+#ifdef HAVE_OPENSSL
+        if (ssl && SSL_pending(ssl) > 0) {
+            return true;
+        }
+#endif
+        return !pending.empty();
+    }
+
+    // Take whatever has been received, reading once if nothing has.
+    // Returns false when the client is gone.
+    bool receive(std::string& data) {
+        if (pending.empty() && !fill()) {
+            return false;
+        }
+        data.swap(pending);
+        pending.clear();
+        return true;
+    }
+
+    // Read the next request. Returns false when the client is gone.
+    bool readRequest(Request& request) {
+        size_t headEnd;
+        while ((headEnd = pending.find("\r\n\r\n")) == std::string::npos) {
+            if (!fill()) {
+                return false;
+            }
+        }
+
+        std::istringstream head(pending.substr(0, headEnd));
+        pending.erase(0, headEnd + 4);
+
+        std::string line;
+        std::getline(head, line);
+        std::istringstream requestLine(line);
+        std::string target, version;
+        requestLine >> request.method >> target >> version;
+        size_t question = target.find('?');
+        request.path = target.substr(0, question);
+        request.query = question == std::string::npos ? "" : target.substr(question + 1);
+
+        while (std::getline(head, line)) {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            size_t colon = line.find(':');
+            if (colon == std::string::npos) {
+                continue;
+            }
+            std::string value = line.substr(colon + 1);
+            value.erase(0, value.find_first_not_of(' '));
+            request.headers[toLower(line.substr(0, colon))] = value;
+        }
+
+        request.keepAlive = toLower(request.headers["connection"]) != "close" && version == "HTTP/1.1";
+
+        // Bodies come with a length or in chunks
+        if (toLower(request.headers["transfer-encoding"]).find("chunked") != std::string::npos) {
+            return readChunkedBody(request.body);
+        }
+        size_t length = std::strtoul(request.headers["content-length"].c_str(), nullptr, 10);
+        while (pending.size() < length) {
+            if (!fill()) {
+                return false;
+            }
+        }
+        request.body = pending.substr(0, length);
+        pending.erase(0, length);
+        return true;
+    }
+
+    // Send bytes, split into fragments when configured. Returns false if the client is gone.
+    bool send(const std::string& data) {
+        size_t offset = 0;
+        while (offset < data.size()) {
+            size_t size = data.size() - offset;
+            if (options.fragmentMax > 0) {
+                std::uniform_int_distribution<size_t> pick(options.fragmentMin, options.fragmentMax);
+                size = std::min(size, std::max<size_t>(1, pick(random)));
+            }
+            if (!sendAll(data.data() + offset, size)) {
+                return false;
+            }
+            offset += size;
+            if (options.fragmentDelayUs > 0 && offset < data.size()) {
+                std::this_thread::sleep_for(std::chrono::microseconds(options.fragmentDelayUs));
+            }
+        }
+        return true;
+    }
+
+    // Send one chunk of a chunked response
+    bool sendChunk(const std::string& data) {
+        char size[32];
+        std::snprintf(size, sizeof(size), "%zx\r\n", data.size());
+        return send(size + data + "\r\n");
+    }
+
+    std::mt19937& generator() { return random; }
+
+private:
+    int fd;
+    std::mt19937 random;
+    std::string pending;
+#ifdef HAVE_OPENSSL
+    SSL* ssl = nullptr;
+#endif
+
+    bool fill() {
+        char buffer[16384];
+        ssize_t count = readSome(buffer, sizeof(buffer));
+        if (count <= 0) {
+            return false;
+        }
+        pending.append(buffer, count);
+        return true;
+    }
+
+    bool readChunkedBody(std::string& body) {
+        while (true) {
+            size_t lineEnd;
+            while ((lineEnd = pending.find("\r\n")) == std::string::npos) {
+                if (!fill()) {
+                    return false;
+                }
+            }
+            size_t size = std::strtoul(pending.substr(0, lineEnd).c_str(), nullptr, 16);
+            pending.erase(0, lineEnd + 2);
+
+            // The last chunk is followed by optional trailers and an empty line
+            if (size == 0) {
+                while ((lineEnd = pending.find("\r\n")) != 0) {
+                    if (lineEnd == std::string::npos) {
+                        if (!fill()) {
+                            return false;
+                        }
+                        continue;
+                    }
+                    pending.erase(0, lineEnd + 2);
+                }
+                pending.erase(0, 2);
+                return true;
+            }
+
+            while (pending.size() < size + 2) {
+                if (!fill()) {
+                    return false;
+                }
+            }
+            body.append(pending, 0, size);
+            pending.erase(0, size + 2);
+        }
+    }
+
+    bool sendAll(const char* data, size_t size) {
+        while (size > 0) {
+            ssize_t sent = writeSome(data, size);
+            if (sent <= 0) {
+                return false;
+            }
+            data += sent;
+            size -= sent;
+        }
+        return true;
+    }
+
+    ssize_t readSome(char* buffer, size_t size) {
+#ifdef HAVE_OPENSSL
+        if (ssl) {
+            return SSL_read(ssl, buffer, static_cast<int>(size));
+        }
+#endif
+        return recv(fd, buffer, size, 0);
+    }
+
+    ssize_t writeSome(const char* data, size_t size) {
+#ifdef HAVE_OPENSSL
+        if (ssl) {
+            return SSL_write(ssl, data, static_cast<int>(size));
+        }
+#endif
+        return ::send(fd, data, size, MSG_NOSIGNAL);
+    }
+};
+
+// The API a request is for, and how its reply is framed
+enum class Api { Ollama, OpenAI, Gemini };
+
+// Where a reply goes: an HTTP/1.1 connection or an HTTP/2 stream. The calls
+// return false once the client is gone.
+class Response {
+public:
+    virtual ~Response() = default;
+
+    // Send a whole response
+    virtual bool send(int status, const std::string& contentType, const std::string& body) = 0;
+
+    // Send the headers of a streamed response, then its parts, then its end
+    virtual bool start(int status, const std::string& contentType) = 0;
+    virtual bool write(const std::string& data) = 0;
+    virtual bool end() = 0;
+
+    // Random numbers for the faults injected into this response
+    virtual std::mt19937& generator() = 0;
+
+    // Draw a number in [0, 1)
+    double chance() {
+        return std::uniform_real_distribution<double>(0.0, 1.0)(generator());
+    }
+};
+
+// Generates and paces the tokens of one reply
+class Reply {
+public:
+    Reply(Response& response, unsigned long id) : response(response), id(id), next(0) {
+        // Decide up front whether and where this reply stalls or drops
+        stallAt = response.chance() < options.stallRate ? pickPosition() : -1;
+        dropAt = response.chance() < options.dropRate ? pickPosition() : -1;
+        started = std::chrono::steady_clock::now();
+    }
+
+    bool done() const { return next >= options.tokens; }
+
+    // Check if the connection should be dropped before the next token
+    bool dropNow() const { return next == dropAt; }
+
+    // Wait until the next token is due and return it
+    std::string nextToken() {
+        if (next == stallAt) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(options.stallMs));
+            started += std::chrono::milliseconds(options.stallMs);
+        }
+
+        auto due = started + std::chrono::milliseconds(options.ttftMs);
+        if (options.tokenRate > 0) {
+            due += std::chrono::microseconds(static_cast<long long>(next * 1000000.0 / options.tokenRate));
+        }
+        std::this_thread::sleep_until(due);
+
+        std::string token = words[(id * 7 + next) % (sizeof(words) / sizeof(words[0]))];
+        next++;
+        return next == 1 ? token : " " + token;
+    }
+
+    // The whole reply, waiting as long as streaming it would take
+    std::string all() {
+        std::string text;
+        while (!done()) {
+            text += nextToken();
+        }
+        return text;
+    }
+
+private:
+    Response& response;
+    unsigned long id;
+    int next;
+    int stallAt;
+    int dropAt;
+    std::chrono::steady_clock::time_point started;
+
+    int pickPosition() {
+        return std::uniform_int_distribution<int>(0, std::max(0, options.tokens - 1))(response.generator());
+    }
+};
+
+std::string statusText(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 429: return "Too Many Requests";
+        case 500: return "Internal Server Error";
+        case 502: return "Bad Gateway";
+        case 503: return "Service Unavailable";
+        case 504: return "Gateway Timeout";
+        default: return "Error";
+    }
+}
+
+// Headers that tell the client when to come back
+std::vector<std::pair<std::string, std::string>> retryHeaders(int status) {
+    if (status != 429 && status != 503) {
+        return {};
+    }
+    std::string seconds = std::to_string(options.retryAfter);
+    return {{"Retry-After", seconds},
+            {"x-ratelimit-remaining-requests", "0"},
+            {"x-ratelimit-reset-requests", seconds + "s"}};
+}
+
+std::string responseHead(int status, const std::string& contentType, const Request& request,
+                         const std::string& framing) {
+    std::string head = "HTTP/1.1 " + std::to_string(status) + " " + statusText(status) + "\r\n";
+    head += "Content-Type: " + contentType + "\r\n";
+    head += framing;
+    head += request.keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+    for (const auto& header : retryHeaders(status)) {
+        head += header.first + ": " + header.second + "\r\n";
+    }
+    return head + "\r\n";
+}
+
+// A response on an HTTP/1.1 connection; streamed ones are chunked
+class Http1Response : public Response {
+public:
+    Http1Response(Connection& connection, const Request& request) : connection(connection), request(request) {}
+
+    bool send(int status, const std::string& contentType, const std::string& body) override {
+        std::string framing = "Content-Length: " + std::to_string(body.size()) + "\r\n";
+        return connection.send(responseHead(status, contentType, request, framing) + body);
+    }
+
+    bool start(int status, const std::string& contentType) override {
+        return connection.send(responseHead(status, contentType, request, "Transfer-Encoding: chunked\r\n"));
+    }
+
+    bool write(const std::string& data) override {
+        return connection.sendChunk(data);
+    }
+
+    bool end() override {
+        return connection.send("0\r\n\r\n");
+    }
+
+    std::mt19937& generator() override { return connection.generator(); }
+
+private:
+    Connection& connection;
+    const Request& request;
+};
+
+bool sendJson(Response& response, int status, const std::string& body) {
+    return response.send(status, "application/json", body);
+}
+
+std::string modelList(Api api) {
+    std::string json;
+    for (const auto& model : options.models) {
+        if (!json.empty()) {
+            json += ",";
+        }
+        switch (api) {
+            case Api::Ollama: json += "{\"name\":\"" + model + "\"}"; break;
+            case Api::OpenAI: json += "{\"id\":\"" + model + "\",\"object\":\"model\"}"; break;
+            case Api::Gemini: json += "{\"name\":\"models/" + model + "\"}"; break;
+        }
+    }
+    switch (api) {
+        case Api::Ollama: return "{\"models\":[" + json + "]}";
+        case Api::OpenAI: return "{\"object\":\"list\",\"data\":[" + json + "]}";
+        case Api::Gemini: return "{\"models\":[" + json + "]}";
+    }
+    return "{}";
+}
+
+// One streamed event in the API's format
+std::string streamEvent(Api api, const std::string& model, const std::string& text) {
+    std::string content = jsonEscape(text);
+    switch (api) {
+        case Api::Ollama:
+            return "{\"model\":\"" + model + "\",\"message\":{\"role\":\"assistant\",\"content\":\"" + content +
+                   "\"},\"done\":false}\n";
+        case Api::OpenAI:
+            return "data: {\"object\":\"chat.completion.chunk\",\"model\":\"" + model +
+                   "\",\"choices\":[{\"index\":0,\"delta\":{\"content\":\"" + content + "\"}}]}\n\n";
+        case Api::Gemini:
+            return "data: {\"candidates\":[{\"content\":{\"parts\":[{\"text\":\"" + content +
+                   "\"}],\"role\":\"model\"}}]}\n\n";
+    }
+    return "";
+}
+
+// The event that ends a stream
+std::string streamEnd(Api api, const std::string& model) {
+    switch (api) {
+        case Api::Ollama:
+            return "{\"model\":\"" + model + "\",\"message\":{\"role\":\"assistant\",\"content\":\"\"},\"done\":true}\n";
+        case Api::OpenAI:
+            return "data: {\"object\":\"chat.completion.chunk\",\"model\":\"" + model +
+                   "\",\"choices\":[{\"index\":0,\"delta\":{},\"finish_reason\":\"stop\"}]}\n\ndata: [DONE]\n\n";
+        case Api::Gemini:
+            return "";
+    }
+    return "";
+}
+
+// The whole reply as one JSON document
+std::string completeBody(Api api, const std::string& model, const std::string& text) {
+    std::string content = jsonEscape(text);
+    switch (api) {
+        case Api::Ollama:
+            return "{\"model\":\"" + model + "\",\"message\":{\"role\":\"assistant\",\"content\":\"" + content +
+                   "\"},\"done\":true}";
+        case Api::OpenAI:
+            return "{\"object\":\"chat.completion\",\"model\":\"" + model +
+                   "\",\"choices\":[{\"index\":0,\"message\":{\"role\":\"assistant\",\"content\":\"" + content +
+                   "\"},\"finish_reason\":\"stop\"}]}";
+        case Api::Gemini:
+            return "{\"candidates\":[{\"content\":{\"parts\":[{\"text\":\"" + content +
+                   "\"}],\"role\":\"model\"},\"finishReason\":\"STOP\"}]}";
+    }
+    return "{}";
+}
+
+// Answer a chat request. Returns false if the connection can't be reused.
+bool serveChat(Response& response, Api api, const std::string& model, bool stream, unsigned long id,
+               int& status) {
+    if (response.chance() < options.errorRate) {
+        status = options.errorStatus;
+        std::string body = "{\"error\":{\"message\":\"Injected error from mock server\",\"code\":" +
+                           std::to_string(status) + "}}";
+        return sendJson(response, status, body);
+    }
+
+    status = 200;
+    Reply reply(response, id);
+
+    if (!stream) {
+        return sendJson(response, status, completeBody(api, model, reply.all()));
+    }
+
+    // Headers go out at once; the first token follows after the TTFT
+    std::string type = api == Api::Ollama ? "application/x-ndjson" : "text/event-stream";
+    if (!response.start(status, type)) {
+        return false;
+    }
+    while (!reply.done()) {
+        if (reply.dropNow()) {
+            return false;
+        }
+        if (!response.write(streamEvent(api, model, reply.nextToken()))) {
+            return false;
+        }
+    }
+    std::string end = streamEnd(api, model);
+    if (!end.empty() && !response.write(end)) {
+        return false;
+    }
+    return response.end();
+}
+
+// Route a request. Returns false if the connection can't be reused.
+bool serve(Response& response, const Request& request, int& status) {
+    unsigned long id = requestCount++;
+    const std::string& path = request.path;
+
+    // Ollama
+    if (path == "/api/tags") {
+        status = 200;
+        return sendJson(response, status, modelList(Api::Ollama));
+    }
+    if (path == "/api/chat" && request.method == "POST") {
+        std::string model = jsonField(request.body, "model");
+        bool stream = jsonField(request.body, "stream") != "false";
+        return serveChat(response, Api::Ollama, model, stream, id, status);
+    }
+
+    // OpenAI, Deepseek and OpenRouter, with or without the /v1 prefix
+    std::string openAiPath = path.compare(0, 3, "/v1") == 0 && path.compare(0, 7, "/v1beta") != 0 ? path.substr(3) : path;
+    if (openAiPath == "/models") {
+        status = 200;
+        return sendJson(response, status, modelList(Api::OpenAI));
+    }
+    if (openAiPath == "/chat/completions" && request.method == "POST") {
+        std::string model = jsonField(request.body, "model");
+        bool stream = jsonField(request.body, "stream") == "true";
+        return serveChat(response, Api::OpenAI, model, stream, id, status);
+    }
+
+    // Gemini
+    if (path == "/v1beta/models" || path == "/v1/models") {
+        status = 200;
+        return sendJson(response, status, modelList(Api::Gemini));
+    }
+    size_t colon = path.rfind(':');
+    if (path.compare(0, 15, "/v1beta/models/") == 0 && colon != std::string::npos && request.method == "POST") {
+        std::string model = path.substr(15, colon - 15);
+        std::string action = path.substr(colon + 1);
+        if (action == "generateContent" || action == "streamGenerateContent") {
+            return serveChat(response, Api::Gemini, model, action == "streamGenerateContent", id, status);
+        }
+    }
+
+    status = 404;
+    return sendJson(response, status, "{\"error\":{\"message\":\"Unknown path " + jsonEscape(path) + "\"}}");
+}
+
+void logRequest(const Request& request, int status, std::chrono::steady_clock::time_point started,
+                const char* note) {
+    if (options.quiet) {
+        return;
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - started).count();
+    std::lock_guard<std::mutex> lock(logMutex);
+    std::cerr << request.method << " " << request.path << " " << status << " " << elapsed << " ms"
+              << note << std::endl;
+}
+
+#ifdef MOCK_HTTP2
+
+// One request on an HTTP/2 connection and the reply queued for it. The
+// fields below request are guarded by the connection's mutex.
+struct Http2Stream {
+    int32_t id = 0;
+    Request request;
+    std::mt19937 random;
+
+    // Set by the thread answering the request
+    int status = 0;
+    std::string contentType;
+    long length = -1;
+    std::string pending;
+    bool started = false;
+    bool ended = false;
+    bool failed = false;
+
+    // Set by the connection's thread
+    bool submitted = false;
+    bool deferred = false;
+    bool reset = false;
+    bool closed = false;
+};
+
+// HTTP/2 on one TLS connection. The nghttp2 session runs on the
+// connection's thread; each request is answered on a thread of its own,
+// like a request on an HTTP/1.1 connection, which queues its reply here
+// and wakes the connection's thread to send it.
+class Http2Connection : public std::enable_shared_from_this<Http2Connection> {
+public:
+    explicit Http2Connection(Connection& connection) : connection(connection) {
+        if (pipe(wake) != 0) {
+            wake[0] = wake[1] = -1;
+        }
+        for (int fd : wake) {
+            fcntl(fd, F_SETFL, O_NONBLOCK);
+        }
+    }
+
+    ~Http2Connection() {
+        close(wake[0]);
+        close(wake[1]);
+    }
+
+    // Serve the connection until the client or a GOAWAY ends it
+    void run() {
+        nghttp2_session_callbacks* callbacks;
+        nghttp2_session_callbacks_new(&callbacks);
+        nghttp2_session_callbacks_set_on_begin_headers_callback(callbacks, onBeginHeaders);
+        nghttp2_session_callbacks_set_on_header_callback(callbacks, onHeader);
+        nghttp2_session_callbacks_set_on_data_chunk_recv_callback(callbacks, onData);
+        nghttp2_session_callbacks_set_on_frame_recv_callback(callbacks, onFrame);
+        nghttp2_session_callbacks_set_on_stream_close_callback(callbacks, onStreamClose);
+        nghttp2_session_server_new(&session, callbacks, this);
+        nghttp2_session_callbacks_del(callbacks);
+
+        nghttp2_settings_entry settings[] = {
+            {NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, options.h2MaxStreams},
+            {NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE, static_cast<uint32_t>(options.h2Window)},
+        };
+        nghttp2_submit_settings(session, NGHTTP2_FLAG_NONE, settings, 2);
+
+        std::string input;
+        while (nghttp2_session_want_read(session) || nghttp2_session_want_write(session)) {
+            if (!flush()) {
+                break;
+            }
+
+            // Wait for the client or for a reply to have something to send
+            if (!connection.hasBuffered()) {
+                pollfd fds[2] = {{connection.socket(), POLLIN, 0}, {wake[0], POLLIN, 0}};
+                if (poll(fds, 2, -1) < 0) {
+                    continue;
+                }
+                if (fds[1].revents) {
+                    char drained[64];
+                    while (read(wake[0], drained, sizeof(drained)) > 0) {
+                    }
+                }
+                if (!fds[0].revents) {
+                    continue;
+                }
+            }
+
+            if (!connection.receive(input) ||
+                nghttp2_session_mem_recv(session, reinterpret_cast<const uint8_t*>(input.data()), input.size()) < 0) {
+                break;
+            }
+        }
+
+        // Threads still answering requests find out on their next write
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+            for (auto& entry : streams) {
+                entry.second->closed = true;
+            }
+            streams.clear();
+        }
+        nghttp2_session_del(session);
+    }
+
+    // Called from the threads answering requests
+
+    bool start(Http2Stream& stream, int status, const std::string& contentType, long length) {
+        return update(stream, [&]() {
+            stream.status = status;
+            stream.contentType = contentType;
+            stream.length = length;
+            stream.started = true;
+        });
+    }
+
+    bool write(Http2Stream& stream, const std::string& data) {
+        return update(stream, [&]() { stream.pending += data; });
+    }
+
+    bool end(Http2Stream& stream) {
+        return update(stream, [&]() { stream.ended = true; });
+    }
+
+    // Reset the stream, like dropping an HTTP/1.1 connection
+    void fail(Http2Stream& stream) {
+        update(stream, [&]() { stream.failed = true; });
+    }
+
+private:
+    Connection& connection;
+    nghttp2_session* session = nullptr;
+    int wake[2];
+
+    std::mutex mutex;
+    std::map<int32_t, std::shared_ptr<Http2Stream>> streams;
+    bool closed = false;
+
+    // Streams begun so far, for --goaway-after
+    int begun = 0;
+
+    bool update(Http2Stream& stream, const std::function<void()>& change) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (closed || stream.closed) {
+                return false;
+            }
+            change();
+        }
+        char byte = 0;
+        return ::write(wake[1], &byte, 1) >= 0 || errno == EAGAIN;
+    }
+
+    // Hand what the replies queued to nghttp2 and send what it makes of it
+    bool flush() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto& entry : streams) {
+                Http2Stream& stream = *entry.second;
+                if (stream.failed && !stream.reset) {
+                    nghttp2_submit_rst_stream(session, NGHTTP2_FLAG_NONE, stream.id, NGHTTP2_INTERNAL_ERROR);
+                    stream.reset = true;
+                } else if (stream.started && !stream.submitted) {
+                    submitResponse(stream);
+                    stream.submitted = true;
+                } else if (stream.deferred && (!stream.pending.empty() || stream.ended)) {
+                    nghttp2_session_resume_data(session, stream.id);
+                    stream.deferred = false;
+                }
+            }
+        }
+
+        std::string output;
+        const uint8_t* data;
+        ssize_t size;
+        while ((size = nghttp2_session_mem_send(session, &data)) > 0) {
+            output.append(reinterpret_cast<const char*>(data), size);
+        }
+        return size == 0 && (output.empty() || connection.send(output));
+    }
+
+    void submitResponse(Http2Stream& stream) {
+        std::vector<std::pair<std::string, std::string>> headers = {
+            {":status", std::to_string(stream.status)},
+            {"content-type", stream.contentType},
+        };
+        if (stream.length >= 0) {
+            headers.emplace_back("content-length", std::to_string(stream.length));
+        }
+        for (const auto& header : retryHeaders(stream.status)) {
+            headers.emplace_back(toLower(header.first), header.second);
+        }
+
+        // nghttp2 copies the names and values
+        std::vector<nghttp2_nv> nv;
+        for (auto& header : headers) {
+            nv.push_back({reinterpret_cast<uint8_t*>(&header.first[0]), reinterpret_cast<uint8_t*>(&header.second[0]),
+                          header.first.size(), header.second.size(), NGHTTP2_NV_FLAG_NONE});
+        }
+        nghttp2_data_provider provider;
+        provider.source.ptr = &stream;
+        provider.read_callback = readBody;
+        nghttp2_submit_response(session, stream.id, nv.data(), nv.size(), &provider);
+    }
+
+    // Body bytes for a DATA frame; nghttp2 asks no more than the client's
+    // flow control windows allow
+    static ssize_t readBody(nghttp2_session*, int32_t, uint8_t* buffer, size_t length, uint32_t* flags,
+                            nghttp2_data_source* source, void* user) {
+        auto* self = static_cast<Http2Connection*>(user);
+        auto* stream = static_cast<Http2Stream*>(source->ptr);
+        std::lock_guard<std::mutex> lock(self->mutex);
+
+        size_t size = std::min(length, stream->pending.size());
+        std::memcpy(buffer, stream->pending.data(), size);
+        stream->pending.erase(0, size);
+        if (stream->pending.empty() && stream->ended) {
+            *flags |= NGHTTP2_DATA_FLAG_EOF;
+            return size;
+        }
+        if (size == 0) {
+            // Asked again once the reply has more
+            stream->deferred = true;
+            return NGHTTP2_ERR_DEFERRED;
+        }
+        return size;
+    }
+
+    static int onBeginHeaders(nghttp2_session* session, const nghttp2_frame* frame, void* user) {
+        if (frame->hd.type != NGHTTP2_HEADERS || frame->headers.cat != NGHTTP2_HCAT_REQUEST) {
+            return 0;
+        }
+        auto* self = static_cast<Http2Connection*>(user);
+        auto stream = std::make_shared<Http2Stream>();
+        stream->id = frame->hd.stream_id;
+        stream->random.seed(self->connection.generator()());
+        {
+            std::lock_guard<std::mutex> lock(self->mutex);
+            self->streams[stream->id] = stream;
+        }
+        nghttp2_session_set_stream_user_data(session, stream->id, stream.get());
+
+        // Streams after this one are refused; those begun finish normally
+        if (options.goawayAfter > 0 && ++self->begun == options.goawayAfter) {
+            nghttp2_submit_goaway(session, NGHTTP2_FLAG_NONE, stream->id, NGHTTP2_NO_ERROR, nullptr, 0);
+        }
+        return 0;
+    }
+
+    static int onHeader(nghttp2_session* session, const nghttp2_frame* frame, const uint8_t* name, size_t nameLength,
+                        const uint8_t* value, size_t valueLength, uint8_t, void*) {
+        auto* stream = static_cast<Http2Stream*>(nghttp2_session_get_stream_user_data(session, frame->hd.stream_id));
+        if (!stream) {
+            return 0;
+        }
+        std::string key(reinterpret_cast<const char*>(name), nameLength);
+        std::string text(reinterpret_cast<const char*>(value), valueLength);
+        if (key == ":method") {
+            stream->request.method = text;
+        } else if (key == ":path") {
+            size_t question = text.find('?');
+            stream->request.path = text.substr(0, question);
+            stream->request.query = question == std::string::npos ? "" : text.substr(question + 1);
+        } else if (key[0] != ':') {
+            stream->request.headers[key] = text;
+        }
+        return 0;
+    }
+
+    static int onData(nghttp2_session* session, uint8_t, int32_t id, const uint8_t* data, size_t length, void*) {
+        auto* stream = static_cast<Http2Stream*>(nghttp2_session_get_stream_user_data(session, id));
+        if (stream) {
+            stream->request.body.append(reinterpret_cast<const char*>(data), length);
+        }
+        return 0;
+    }
+
+    // A request is complete with its END_STREAM flag
+    static int onFrame(nghttp2_session*, const nghttp2_frame* frame, void* user) {
+        if ((frame->hd.type != NGHTTP2_HEADERS && frame->hd.type != NGHTTP2_DATA) ||
+            !(frame->hd.flags & NGHTTP2_FLAG_END_STREAM)) {
+            return 0;
+        }
+        auto* self = static_cast<Http2Connection*>(user);
+        std::shared_ptr<Http2Stream> stream;
+        {
+            std::lock_guard<std::mutex> lock(self->mutex);
+            auto found = self->streams.find(frame->hd.stream_id);
+            if (found == self->streams.end()) {
+                return 0;
+            }
+            stream = found->second;
+        }
+        std::thread(serveStream, self->shared_from_this(), stream).detach();
+        return 0;
+    }
+
+    static int onStreamClose(nghttp2_session*, int32_t id, uint32_t, void* user) {
+        auto* self = static_cast<Http2Connection*>(user);
+        std::lock_guard<std::mutex> lock(self->mutex);
+        auto found = self->streams.find(id);
+        if (found != self->streams.end()) {
+            found->second->closed = true;
+            self->streams.erase(found);
+        }
+        return 0;
+    }
+
+    static void serveStream(std::shared_ptr<Http2Connection> connection, std::shared_ptr<Http2Stream> stream);
+};
+
+// A response on an HTTP/2 stream
+class Http2Response : public Response {
+public:
+    Http2Response(Http2Connection& connection, Http2Stream& stream) : connection(connection), stream(stream) {}
+
+    bool send(int status, const std::string& contentType, const std::string& body) override {
+        return connection.start(stream, status, contentType, static_cast<long>(body.size())) &&
+               connection.write(stream, body) && connection.end(stream);
+    }
+
+    bool start(int status, const std::string& contentType) override {
+        return connection.start(stream, status, contentType, -1);
+    }
+
+    bool write(const std::string& data) override {
+        return connection.write(stream, data);
+    }
+
+    bool end() override {
+        return connection.end(stream);
+    }
+
+    std::mt19937& generator() override { return stream.random; }
+
+private:
+    Http2Connection& connection;
+    Http2Stream& stream;
+};
+
+void Http2Connection::serveStream(std::shared_ptr<Http2Connection> connection, std::shared_ptr<Http2Stream> stream) {
+    auto started = std::chrono::steady_clock::now();
+    Http2Response response(*connection, *stream);
+    int status = 0;
+    bool completed = serve(response, stream->request, status);
+    if (!completed) {
+        connection->fail(*stream);
+    }
+    logRequest(stream->request, status, started, completed ? " (h2)" : " (h2, reset)");
+}
+
+#endif
+
+void handleConnection(int fd, unsigned seed) {
+    Connection connection(fd, seed);
+#ifdef HAVE_OPENSSL
+    if (tlsContext && !connection.startTls(tlsContext)) {
+        return;
+    }
+#endif
+#ifdef MOCK_HTTP2
+    if (connection.protocol() == "h2") {
+        std::make_shared<Http2Connection>(connection)->run();
+        return;
+    }
+#endif
+
+    Request request;
+    while (connection.readRequest(request)) {
+        auto started = std::chrono::steady_clock::now();
+        Http1Response response(connection, request);
+        int status = 0;
+        bool reusable = serve(response, request, status);
+        logRequest(request, status, started, reusable ? "" : " (closed)");
+
+        if (!reusable || !request.keepAlive) {
+            break;
+        }
+        request = Request();
+    }
+}
+
+int listenSocket() {
+    int fd;
+    if (!options.unixPath.empty()) {
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, options.unixPath.c_str(), sizeof(address.sun_path) - 1);
+        unlink(options.unixPath.c_str());
+        if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+            std::perror("bind");
+            std::exit(1);
+        }
+    } else {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        int yes = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<uint16_t>(options.port));
+        if (inet_pton(AF_INET, options.host.c_str(), &address.sin_addr) != 1) {
+            std::cerr << "Invalid listen address " << options.host << std::endl;
+            std::exit(1);
+        }
+        if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+            std::perror("bind");
+            std::exit(1);
+        }
+    }
+    if (listen(fd, 64) != 0) {
+        std::perror("listen");
+        std::exit(1);
+    }
+    return fd;
+}
+
+#ifdef HAVE_OPENSSL
+// Pick HTTP/2 when the client offers it and it's built in, HTTP/1.1 otherwise
+int selectProtocol(SSL*, const unsigned char** out, unsigned char* outLength, const unsigned char* in,
+                   unsigned inLength, void*) {
+#ifdef MOCK_HTTP2
+    static const unsigned char supported[] = "\x02h2\x08http/1.1";
+#else
+    static const unsigned char supported[] = "\x08http/1.1";
+#endif
+    if (SSL_select_next_proto(const_cast<unsigned char**>(out), outLength, supported, sizeof(supported) - 1,
+                              in, inLength) != OPENSSL_NPN_NEGOTIATED) {
+        return SSL_TLSEXT_ERR_NOACK;
+    }
+    return SSL_TLSEXT_ERR_OK;
+}
+
+SSL_CTX* makeTlsContext() {
+    SSL_CTX* context = SSL_CTX_new(TLS_server_method());
+    SSL_CTX_set_min_proto_version(context, TLS1_2_VERSION);
+    std::string key = options.tlsKey.empty() ? options.tlsCert : options.tlsKey;
+    if (SSL_CTX_use_certificate_chain_file(context, options.tlsCert.c_str()) != 1 ||
+        SSL_CTX_use_PrivateKey_file(context, key.c_str(), SSL_FILETYPE_PEM) != 1) {
+        ERR_print_errors_fp(stderr);
+        std::exit(1);
+    }
+    SSL_CTX_set_alpn_select_cb(context, selectProtocol, nullptr);
+    return context;
+}
+#endif
+
+void usage() {
+    std::cerr <<
+        "Usage: gtkks-mock-server [options]\n"
+        "  --host ADDRESS         listen address (127.0.0.1)\n"
+        "  --port N               listen port (11500)\n"
+        "  --unix PATH            listen on a Unix domain socket instead\n"
+        "  --models A,B,...       model names to list\n"
+        "  --tokens N             tokens per reply (100)\n"
+        "  --token-rate R         tokens per second, 0 for no pacing (50)\n"
+        "  --ttft MS              time to first token (200)\n"
+        "  --fragment MIN[:MAX]   split writes into fragments of MIN..MAX bytes\n"
+        "  --fragment-delay US    pause between fragments\n"
+        "  --error-rate P         share of chat requests that fail (0)\n"
+        "  --error-status CODE    status of failed requests (500)\n"
+        "  --retry-after S        Retry-After of 429 and 503 responses (1)\n"
+        "  --stall-rate P         share of replies that stall once (0)\n"
+        "  --stall MS             length of a stall (5000)\n"
+        "  --drop-rate P          share of streams cut off part way (0)\n"
+        "  --tls-cert FILE        serve TLS with this PEM certificate chain\n"
+        "  --tls-key FILE         PEM private key (the certificate file)\n"
+        "  --h2-max-streams N     HTTP/2 concurrent streams per connection (100)\n"
+        "  --h2-window BYTES      HTTP/2 initial stream window for request bodies (65535)\n"
+        "  --goaway-after N       send HTTP/2 GOAWAY after N streams on a connection\n"
+        "  --seed N               random seed (1)\n"
+        "  --quiet                don't log requests\n";
+}
+
+bool parseOptions(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        std::string name = argv[i];
+        if (name == "--quiet") {
+            options.quiet = true;
+            continue;
+        }
+        if (name == "--help" || i + 1 >= argc) {
+            return false;
+        }
+        std::string value = argv[++i];
+
+        if (name == "--host") {
+            options.host = value;
+        } else if (name == "--port") {
+            options.port = std::atoi(value.c_str());
+        } else if (name == "--unix") {
+            options.unixPath = value;
+        } else if (name == "--models") {
+            options.models.clear();
+            std::istringstream list(value);
+            std::string model;
+            while (std::getline(list, model, ',')) {
+                options.models.push_back(model);
+            }
+        } else if (name == "--tokens") {
+            options.tokens = std::atoi(value.c_str());
+        } else if (name == "--token-rate") {
+            options.tokenRate = std::atof(value.c_str());
+        } else if (name == "--ttft") {
+            options.ttftMs = std::atoi(value.c_str());
+        } else if (name == "--fragment") {
+            size_t colon = value.find(':');
+            options.fragmentMin = std::strtoul(value.c_str(), nullptr, 10);
+            options.fragmentMax = colon == std::string::npos ? options.fragmentMin
+                                                             : std::strtoul(value.c_str() + colon + 1, nullptr, 10);
+            options.fragmentMin = std::max<size_t>(1, std::min(options.fragmentMin, options.fragmentMax));
+        } else if (name == "--fragment-delay") {
+            options.fragmentDelayUs = std::atoi(value.c_str());
+        } else if (name == "--error-rate") {
+            options.errorRate = std::atof(value.c_str());
+        } else if (name == "--error-status") {
+            options.errorStatus = std::atoi(value.c_str());
+        } else if (name == "--retry-after") {
+            options.retryAfter = std::atoi(value.c_str());
+        } else if (name == "--stall-rate") {
+            options.stallRate = std::atof(value.c_str());
+        } else if (name == "--stall") {
+            options.stallMs = std::atoi(value.c_str());
+        } else if (name == "--drop-rate") {
+            options.dropRate = std::atof(value.c_str());
+        } else if (name == "--tls-cert") {
+            options.tlsCert = value;
+        } else if (name == "--tls-key") {
+            options.tlsKey = value;
+        } else if (name == "--h2-max-streams") {
+            options.h2MaxStreams = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+        } else if (name == "--h2-window") {
+            options.h2Window = std::atoi(value.c_str());
+        } else if (name == "--goaway-after") {
+            options.goawayAfter = std::atoi(value.c_str());
+        } else if (name == "--seed") {
+            options.seed = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    if (!parseOptions(argc, argv)) {
+        usage();
+        return 2;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    std::string scheme = "http";
+    if (!options.tlsCert.empty()) {
+#ifdef HAVE_OPENSSL
+        tlsContext = makeTlsContext();
+        scheme = "https";
+#else
+        std::cerr << "Built without OpenSSL; TLS is not available" << std::endl;
+        return 1;
+#endif
+    }
+
+    int listener = listenSocket();
+    if (options.unixPath.empty()) {
+        std::cerr << "Mock LLM server listening on " << scheme << "://" << options.host << ":" << options.port
+                  << std::endl;
+    } else {
+        std::cerr << "Mock LLM server listening on unix://" << options.unixPath << std::endl;
+    }
+
+    // Each connection gets its own thread and a seed derived from the run's
+    for (unsigned connectionIndex = 0; ; connectionIndex++) {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0) {
+            continue;
+        }
+        if (options.unixPath.empty()) {
+            int yes = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+        }
+        std::thread(handleConnection, fd, options.seed * 7919u + connectionIndex).detach();
+    }
+}
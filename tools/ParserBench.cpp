@@ -0,0 +1,232 @@
+// Compares HttpResponseParser with the regex-based response handling it
+// replaced, on the same bytes fed in the same read sizes:
+//   gtkks-parser-bench --iterations 2000 --read 4096
+// "buffered" is a JSON reply with Content-Length, as makeRequest reads it;
+// "streamed" is a chunked SSE reply, as postStreaming reads it. The regex
+// path is kept here only as a baseline; it is not used by the client.
+
+#include "HttpResponseParser.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <regex>
+#include <string>
+#include <string_view>
+
+namespace {
+
+struct Options {
+    int iterations = 2000;
+
+    // Bytes handed over per read, like the client's read buffer
+    size_t readSize = 4096;
+
+    // Events in the streamed reply
+    int events = 500;
+};
+
+Options options;
+
+void usage() {
+    std::cerr <<
+        "Usage: gtkks-parser-bench [options]\n"
+        "  --iterations N         responses parsed per case (2000)\n"
+        "  --read N               bytes per read (4096)\n"
+        "  --events N             events in the streamed reply (500)\n";
+}
+
+bool parseOptions(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        std::string name = argv[i];
+        if (name == "--help" || i + 1 >= argc) {
+            return false;
+        }
+        std::string value = argv[++i];
+
+        if (name == "--iterations") {
+            options.iterations = std::atoi(value.c_str());
+        } else if (name == "--read") {
+            options.readSize = std::strtoul(value.c_str(), nullptr, 10);
+        } else if (name == "--events") {
+            options.events = std::atoi(value.c_str());
+        } else {
+            return false;
+        }
+    }
+    return options.iterations > 0 && options.readSize > 0 && options.events > 0;
+}
+
+// Headers much like a provider sends
+const char* responseHeaders =
+    "Date: Fri, 16 Oct 2026 12:00:00 GMT\r\n"
+    "Connection: keep-alive\r\n"
+    "Cache-Control: no-cache, must-revalidate\r\n"
+    "Access-Control-Expose-Headers: X-Request-ID\r\n"
+    "Openai-Processing-Ms: 412\r\n"
+    "Openai-Version: 2020-10-01\r\n"
+    "Strict-Transport-Security: max-age=31536000; includeSubDomains\r\n"
+    "X-Ratelimit-Limit-Requests: 10000\r\n"
+    "X-Ratelimit-Limit-Tokens: 2000000\r\n"
+    "X-Ratelimit-Remaining-Requests: 9999\r\n"
+    "X-Ratelimit-Remaining-Tokens: 1999950\r\n"
+    "X-Ratelimit-Reset-Requests: 6ms\r\n"
+    "X-Ratelimit-Reset-Tokens: 1ms\r\n"
+    "X-Request-Id: req_0123456789abcdef0123456789abcdef\r\n"
+    "Server: cloudflare\r\n";
+
+std::string bufferedResponse() {
+    std::string body = "{\"id\":\"chatcmpl-1\",\"object\":\"chat.completion\",\"choices\":[{\"index\":0,"
+                       "\"message\":{\"role\":\"assistant\",\"content\":\"";
+    for (int i = 0; i < 60; i++) {
+        body += "The quick brown fox jumps over the lazy dog. ";
+    }
+    body += "\"},\"finish_reason\":\"stop\"}]}";
+    return "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n" + std::string(responseHeaders) +
+           "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+std::string streamedResponse() {
+    std::string response = "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\n" +
+                           std::string(responseHeaders) + "Transfer-Encoding: chunked\r\n\r\n";
+    char size[16];
+    for (int i = 0; i < options.events; i++) {
+        std::string event = "data: {\"choices\":[{\"delta\":{\"content\":\"token" + std::to_string(i) + " \"}}]}\n\n";
+        std::snprintf(size, sizeof(size), "%zx\r\n", event.size());
+        response += size + event + "\r\n";
+    }
+    return response + "0\r\n\r\n";
+}
+
+// The old makeRequest: append each read, look for the end of the headers
+// and run the regexes over the header block until the body is complete
+size_t regexBuffered(std::string_view wire) {
+    std::string response;
+    std::string result;
+    for (size_t offset = 0; offset < wire.size(); offset += options.readSize) {
+        std::string_view read = wire.substr(offset, options.readSize);
+        response.append(read.data(), read.size());
+
+        size_t headerEnd = response.find("\r\n\r\n");
+        if (headerEnd == std::string::npos) {
+            continue;
+        }
+        std::string headers = response.substr(0, headerEnd);
+
+        std::regex statusRegex("HTTP/[0-9.]+ ([0-9]+)");
+        std::smatch match;
+        if (std::regex_search(headers, match, statusRegex) && std::stoi(match[1].str()) >= 400) {
+            return 0;
+        }
+
+        std::regex contentLengthRegex("Content-Length: ([0-9]+)");
+        if (std::regex_search(headers, match, contentLengthRegex)) {
+            size_t contentLength = std::stoull(match[1].str());
+            if (response.size() - (headerEnd + 4) >= contentLength) {
+                result = response.substr(headerEnd + 4, contentLength);
+                break;
+            }
+        }
+    }
+    return result.size();
+}
+
+// The old postStreaming: the same header search, then each read passed on
+// as a copy, chunk framing and all
+size_t regexStreamed(std::string_view wire) {
+    std::string response;
+    bool headersReceived = false;
+    size_t delivered = 0;
+    for (size_t offset = 0; offset < wire.size(); offset += options.readSize) {
+        std::string_view read = wire.substr(offset, options.readSize);
+        if (headersReceived) {
+            std::string chunk(read);
+            delivered += chunk.size();
+            continue;
+        }
+
+        response.append(read.data(), read.size());
+        size_t headerEnd = response.find("\r\n\r\n");
+        if (headerEnd == std::string::npos) {
+            continue;
+        }
+        std::string headers = response.substr(0, headerEnd);
+
+        std::regex statusRegex("HTTP/[0-9.]+ ([0-9]+)");
+        std::smatch match;
+        if (std::regex_search(headers, match, statusRegex) && std::stoi(match[1].str()) >= 400) {
+            return 0;
+        }
+        headersReceived = true;
+        std::string chunk = response.substr(headerEnd + 4);
+        delivered += chunk.size();
+    }
+    return delivered;
+}
+
+// HttpResponseParser collecting the body, as makeRequest does now
+size_t parserBuffered(std::string_view wire) {
+    std::string result;
+    HttpResponseParser parser;
+    parser.setBodyHandler([&result](const char* data, size_t length) {
+        result.append(data, length);
+        return true;
+    });
+    for (size_t offset = 0; offset < wire.size() && !parser.isComplete(); offset += options.readSize) {
+        std::string_view read = wire.substr(offset, options.readSize);
+        parser.feed(read.data(), read.size());
+    }
+    return result.size();
+}
+
+// HttpResponseParser passing decoded body bytes on in place
+size_t parserStreamed(std::string_view wire) {
+    size_t delivered = 0;
+    HttpResponseParser parser;
+    parser.setBodyHandler([&delivered](const char*, size_t length) {
+        delivered += length;
+        return true;
+    });
+    for (size_t offset = 0; offset < wire.size() && !parser.isComplete(); offset += options.readSize) {
+        std::string_view read = wire.substr(offset, options.readSize);
+        parser.feed(read.data(), read.size());
+    }
+    return delivered;
+}
+
+// Time one way of handling a response and print a line for it
+void measure(const char* name, std::string_view wire, size_t (*parse)(std::string_view)) {
+    // Warm up, and keep the result so the work isn't optimized away
+    size_t bytes = parse(wire);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < options.iterations; i++) {
+        bytes = std::max(bytes, parse(wire));
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::printf("%-16s %9.2f us/response  %8.1f MB/s  %zu body bytes\n", name,
+                seconds * 1e6 / options.iterations,
+                wire.size() * static_cast<double>(options.iterations) / seconds / 1e6, bytes);
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    if (!parseOptions(argc, argv)) {
+        usage();
+        return 2;
+    }
+
+    std::string buffered = bufferedResponse();
+    std::string streamed = streamedResponse();
+    std::printf("buffered response %zu bytes, streamed response %zu bytes, %zu bytes per read\n",
+                buffered.size(), streamed.size(), options.readSize);
+
+    measure("regex buffered", buffered, regexBuffered);
+    measure("parser buffered", buffered, parserBuffered);
+    measure("regex streamed", streamed, regexStreamed);
+    measure("parser streamed", streamed, parserStreamed);
+    return 0;
+}
@@ -0,0 +1,228 @@
+// Compares the io_uring and GIO transports of HttpClient, and loopback TCP
+// with a Unix domain socket, on one batch of streamed chat requests, e.g.
+// against two gtkks-mock-server instances:
+//   gtkks-mock-server --port 11500 --token-rate 0 --ttft 0 --quiet
+//   gtkks-mock-server --unix /tmp/gtkks-mock.sock --token-rate 0 --ttft 0 --quiet
+//   gtkks-transport-bench --requests 500 --unix-url unix:///tmp/gtkks-mock.sock/api/chat
+// For each transport and socket it prints the throughput of the batch, the
+// wall time, the CPU time spent in user and kernel mode and how many
+// requests succeeded, then the latency of requests sent one at a time; for
+// io_uring also how many system calls submitted the work. io_uring is
+// skipped when it isn't built in or the kernel doesn't allow it.
+
+#include "HttpClient.h"
+#include "ConnectionPool.h"
+#include "UringTransport.h"
+#include <giomm.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+
+namespace {
+
+struct Options {
+    std::string url = "http://127.0.0.1:11500/api/chat";
+
+    // The same endpoint over a Unix domain socket; none if empty
+    std::string unixUrl;
+
+    int requests = 200;
+    int concurrency = 64;
+
+    // Requests sent one at a time to measure latency; zero skips it
+    int latencyRequests = 100;
+
+    // "uring", "gio" or "both"
+    std::string transport = "both";
+};
+
+Options options;
+
+void usage() {
+    std::cerr <<
+        "Usage: gtkks-transport-bench [options]\n"
+        "  --url URL              chat URL over TCP (http://127.0.0.1:11500/api/chat)\n"
+        "  --unix-url URL         the same over a Unix socket, e.g. unix:///tmp/gtkks-mock.sock/api/chat\n"
+        "  --requests N           requests in the batch (200)\n"
+        "  --concurrency N        requests in flight at once (64)\n"
+        "  --latency N            requests sent one at a time for latency, 0 to skip (100)\n"
+        "  --transport T          uring, gio or both (both)\n";
+}
+
+bool parseOptions(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        std::string name = argv[i];
+        if (name == "--help" || i + 1 >= argc) {
+            return false;
+        }
+        std::string value = argv[++i];
+
+        if (name == "--url") {
+            options.url = value;
+        } else if (name == "--unix-url") {
+            options.unixUrl = value;
+        } else if (name == "--latency") {
+            options.latencyRequests = std::atoi(value.c_str());
+        } else if (name == "--requests") {
+            options.requests = std::atoi(value.c_str());
+        } else if (name == "--concurrency") {
+            options.concurrency = std::atoi(value.c_str());
+        } else if (name == "--transport") {
+            options.transport = value;
+        } else {
+            return false;
+        }
+    }
+    return options.requests > 0 && options.concurrency > 0 && options.latencyRequests >= 0;
+}
+
+double seconds(const timeval& time) {
+    return time.tv_sec + time.tv_usec / 1e6;
+}
+
+// A batch of streamed chat requests to the URL. Each request adds what it
+// receives to bytes and notes when its last bytes arrived in finished.
+std::vector<HttpClient::BatchRequest> makeBatch(const std::string& url, int count, size_t& bytes,
+                                                std::vector<std::chrono::steady_clock::time_point>& finished) {
+    finished.assign(count, std::chrono::steady_clock::time_point());
+    std::vector<HttpClient::BatchRequest> batch(count);
+    for (int i = 0; i < count; i++) {
+        HttpClient::BatchRequest& request = batch[i];
+        request.method = "POST";
+        request.url = url;
+        request.data = "{\"model\":\"mock-model\",\"stream\":true,"
+                       "\"messages\":[{\"role\":\"user\",\"content\":\"Hello\"}]}";
+        request.onData = [&bytes, &finished, i](std::string_view data) {
+            bytes += data.size();
+            finished[i] = std::chrono::steady_clock::now();
+            return true;
+        };
+    }
+    return batch;
+}
+
+double percentile(std::vector<double> values, double share) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, static_cast<size_t>(share * values.size()))];
+}
+
+// Send requests one at a time, each on the connection the last one left,
+// and print how long each took from the end of the one before it
+void measureLatency(HttpClient& client, const std::string& url) {
+    size_t bytes = 0;
+    std::vector<std::chrono::steady_clock::time_point> finished;
+    std::vector<HttpClient::BatchRequest> batch = makeBatch(url, options.latencyRequests, bytes, finished);
+
+    ConnectionPool::getInstance().setMaxConnectionsPerHost(1);
+    auto start = std::chrono::steady_clock::now();
+    client.runBatch(batch);
+    ConnectionPool::getInstance().setMaxConnectionsPerHost(options.concurrency);
+
+    // Requests that received nothing are left out
+    finished.erase(std::remove(finished.begin(), finished.end(), std::chrono::steady_clock::time_point()),
+                   finished.end());
+    std::sort(finished.begin(), finished.end());
+    std::vector<double> latencies;
+    auto previous = start;
+    for (auto time : finished) {
+        latencies.push_back(std::chrono::duration<double, std::milli>(time - previous).count());
+        previous = time;
+    }
+
+    std::printf("           latency p50 %7.3f ms  p95 %7.3f ms  p99 %7.3f ms  (%zu requests one at a time)\n",
+                percentile(latencies, 0.50), percentile(latencies, 0.95), percentile(latencies, 0.99),
+                latencies.size());
+}
+
+void runOnce(const std::string& transport, const std::string& socket, const std::string& url) {
+    HttpClient client;
+    client.setHeader("Content-Type", "application/json");
+    client.disableRetries();
+    client.setCircuitBreakerEnabled(false);
+    client.setUringEnabled(transport == "uring");
+
+    // Count the streamed bytes instead of keeping them
+    size_t bytes = 0;
+    std::vector<std::chrono::steady_clock::time_point> finished;
+    std::vector<HttpClient::BatchRequest> batch = makeBatch(url, options.requests, bytes, finished);
+
+    rusage before;
+    getrusage(RUSAGE_SELF, &before);
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<AsyncRequest::Result> results = client.runBatch(batch);
+
+    auto wall = std::chrono::steady_clock::now() - start;
+    rusage after;
+    getrusage(RUSAGE_SELF, &after);
+
+    int ok = 0;
+    std::string firstError;
+    for (const auto& result : results) {
+        if (result.error.empty() && result.statusCode == 200) {
+            ok++;
+        } else if (firstError.empty()) {
+            firstError = result.error.empty() ? "HTTP " + std::to_string(result.statusCode) : result.error;
+        }
+    }
+
+    double elapsed = std::chrono::duration<double>(wall).count();
+    std::printf("%-6s %-4s %5d/%-5d ok  %8.1f req/s  %7.1f MB/s  wall %8.1f ms  user %7.1f ms  sys %7.1f ms\n",
+                transport.c_str(), socket.c_str(), ok, options.requests, ok / elapsed, bytes / elapsed / 1e6,
+                elapsed * 1000,
+                (seconds(after.ru_utime) - seconds(before.ru_utime)) * 1000,
+                (seconds(after.ru_stime) - seconds(before.ru_stime)) * 1000);
+    if (transport == "uring") {
+        const UringTransport::Stats& stats = client.getBatchStats();
+        std::printf("           %zu submits, %zu completions, %zu connects, %zu reused\n",
+                    stats.submits, stats.completions, stats.connects, stats.reused);
+    }
+    if (!firstError.empty()) {
+        std::printf("           first error: %s\n", firstError.c_str());
+    }
+
+    if (options.latencyRequests > 0) {
+        measureLatency(client, url);
+    }
+}
+
+// Run the batch over TCP, then over the Unix socket if there is one
+void runTransport(const std::string& transport) {
+    runOnce(transport, "tcp", options.url);
+    if (!options.unixUrl.empty()) {
+        runOnce(transport, "unix", options.unixUrl);
+    }
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    if (!parseOptions(argc, argv)) {
+        usage();
+        return 2;
+    }
+    Gio::init();
+
+    // Both transports run at most this many requests at once
+    ConnectionPool::getInstance().setMaxConnectionsPerHost(options.concurrency);
+
+    if (options.transport != "gio") {
+        if (!UringTransport::isSupported()) {
+            std::cerr << "io_uring is not available; skipping it" << std::endl;
+        } else {
+            runTransport("uring");
+        }
+    }
+    if (options.transport != "uring") {
+        runTransport("gio");
+    }
+    return 0;
+}